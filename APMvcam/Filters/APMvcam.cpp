@@ -7,6 +7,8 @@
 #include <dvdmedia.h>
 #include <locale>
 #include <codecvt>
+#include <chrono>
+#include <cstdlib>
 #include "APMvcam.h"
 
 #include <algorithm>
@@ -53,11 +55,8 @@ CVCamStream::CVCamStream(HRESULT *phr, CVCam *pParent, LPCWSTR pPinName) :
     // Set the default media type as 320x240x24@15
     GetMediaType(12, &m_mt);
 
-    // 捕获摄像头
-    real_capture = new cv::VideoCapture(0);
-    real_capture->set(3, 1920);
-    real_capture->set(4, 1080);
-    
+    startup_start = std::chrono::steady_clock::now();
+
     // 获取 apm 的安装路径
     DWORD dwSize = ExpandEnvironmentStringsW(TEXT("%WONDERSHARE_APM_DIR%"), NULL, 0);
     TCHAR* pszBuffer = new TCHAR[dwSize];
@@ -65,21 +64,67 @@ CVCamStream::CVCamStream(HRESULT *phr, CVCam *pParent, LPCWSTR pPinName) :
     std::wstring apm_path_wstr = pszBuffer;
     std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> converter;
     std::string apm_path_str = converter.to_bytes(apm_path_wstr);
-    // 创建推理请求
-    ov::Core core;
-    //core.set_property(ov::cache_dir(model_path.append(L"apm_cache")));
-    core.set_property(ov::cache_dir(apm_path_str + "\\cl_cache"));
-    auto model = core.read_model(apm_path_wstr + L"\\model\\awesome_portrait_matting.xml");
-    ov::CompiledModel compiled_model = core.compile_model(model, "AUTO:GPU,CPU",
-        ov::hint::performance_mode(ov::hint::PerformanceMode::THROUGHPUT));
-    infer_request = compiled_model.create_infer_request();
-    for (const auto& name : input_to_output) {
-        input_port[name.first] = compiled_model.input(name.first);
-
-        if (name.first == "img") continue;
-        infer_request.set_tensor(name.first, ov::Tensor(input_port.at(name.first).get_element_type(),
-            input_port.at(name.first).get_shape(), init_status_handler.at(name.first).data()));
-    }
+    // 创建推理请求：编译模型从 apm --install 导出的缓存读取，没有可用的缓存时编译并导出。
+    // 编译与预热推理在后台线程进行，同时在当前线程打开摄像头；完成前 FillBuffer 输出黑帧
+    model_ready = std::async(std::launch::async, [this, apm_path_str, apm_path_wstr]() {
+        ov::Core core;
+        //core.set_property(ov::cache_dir(model_path.append(L"apm_cache")));
+        core.set_property(ov::cache_dir(apm_path_str + "\\cl_cache"));
+        std::wstring model_path = apm_path_wstr + L"\\model\\awesome_portrait_matting.xml";
+        auto model = core.read_model(model_path);
+        BlobCache blobs(core, apm_path_str + "\\blob_cache", model_path);
+        const ov::Shape img_shape = model->input("img").get_shape();
+        ov::CompiledModel compiled_model = blobs.Load(model, "AUTO:GPU,CPU",
+            ov::AnyMap{ ov::hint::performance_mode(ov::hint::PerformanceMode::THROUGHPUT) },
+            std::to_string(img_shape.at(2)) + "x" + std::to_string(img_shape.at(1)));
+        infer_request = compiled_model.create_infer_request();
+        img_port = compiled_model.input("img");
+        alp_port = compiled_model.output("alp");
+        // 隐藏状态的形状从模型推导，初始为全 0
+        hide_status = std::make_unique<RecurrentState>(compiled_model);
+        std::chrono::duration<double> startup_elapsed = std::chrono::steady_clock::now() - startup_start;
+        MattingMetrics::Get().startup_seconds.Set(startup_elapsed.count());
+        // 预热：以全 0 的帧推理一次，提前支付第一次推理的初始化，之后隐藏状态清零
+        cv::Mat dummy = cv::Mat::zeros(static_cast<int>(img_shape.at(1)), static_cast<int>(img_shape.at(2)), CV_8UC3);
+        infer_request.set_tensor(img_port, ov::Tensor(img_port.get_element_type(), img_shape, dummy.data));
+        hide_status->Bind(infer_request);
+        infer_request.start_async();
+        infer_request.wait();
+        hide_status->Reset();
+        });
+
+    // 捕获摄像头
+    real_capture = new cv::VideoCapture(0);
+    real_capture->set(3, 1920);
+    real_capture->set(4, 1080);
+
+    // 读取环境变量，未设置时为空
+    auto read_env = [&converter](LPCWSTR name) {
+        DWORD size = GetEnvironmentVariableW(name, NULL, 0);
+        if (size == 0) return std::string();
+        std::wstring value(size, L'\0');
+        GetEnvironmentVariableW(name, &value[0], size);
+        value.resize(size - 1);
+        return converter.to_bytes(value);
+    };
+
+    // 背景：APM_VCAM_BACKGROUND 为 blur 时虚化背景，为图片或视频路径时替换背景，未设置时为黑色背景
+    std::string background_str = read_env(L"APM_VCAM_BACKGROUND");
+    std::string background_mode = background_str.empty() ? "merge"
+        : background_str == "blur" ? "blur" : "replace";
+    background = std::make_unique<Background>(background_mode, background_str);
+    // 背景打开失败时退化为黑色背景
+    if (!background->IsOpened())
+        background = std::make_unique<Background>("merge");
+
+    // 静止画面检测：APM_VCAM_CHANGE_THRESHOLD 指定阈值，0 表示关闭，未设置时为 2
+    std::string threshold_str = read_env(L"APM_VCAM_CHANGE_THRESHOLD");
+    change_gate = std::make_unique<ChangeGate>(threshold_str.empty() ? 2.0 : std::atof(threshold_str.c_str()));
+
+    // 运行指标：APM_VCAM_METRICS 指定 Prometheus 文本文件的路径，每 5 秒刷新
+    std::string metrics_str = read_env(L"APM_VCAM_METRICS");
+    if (!metrics_str.empty())
+        metrics_exporter = std::make_unique<MetricsExporter>(metrics_str);
 }
 
 CVCamStream::~CVCamStream()
@@ -134,36 +179,83 @@ HRESULT CVCamStream::FillBuffer(IMediaSample *pms)
     }
     //auto input_width = static_cast<int>(capture.get(cv::CAP_PROP_FRAME_WIDTH));
     //auto input_height = static_cast<int>(capture.get(cv::CAP_PROP_FRAME_HEIGHT));
+    MattingMetrics& metrics = MattingMetrics::Get();
     cv::Mat frame;
-    real_capture->read(frame);
+    // 捕获失败时输出黑帧，计为丢弃
+    if (!real_capture->read(frame) || frame.empty()) {
+        metrics.frames_dropped.Add();
+        memset(pData, 0, lDataLen);
+        return NOERROR;
+    }
+    metrics.frames_in.Add();
+    // 模型尚未就绪时输出黑帧，计为丢弃；加载失败时一直输出黑帧
+    if (!model_loaded) {
+        if (!model_ready.valid() || model_ready.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            metrics.frames_dropped.Add();
+            memset(pData, 0, lDataLen);
+            return NOERROR;
+        }
+        try {
+            model_ready.get();
+            model_loaded = true;
+        }
+        catch (const std::exception& ex) {
+            OutputDebugStringA(("[ERROR] APM vcam: can not load model: " + std::string(ex.what()) + "\n").c_str());
+            metrics.frames_dropped.Add();
+            memset(pData, 0, lDataLen);
+            return NOERROR;
+        }
+    }
     cv::resize(frame, frame, cv::Size(160 * iPosition, 90 * iPosition));
     
-    // matting
-    cv::Mat img_mat = frame.clone();
-    infer_request.set_tensor("img", ov::Tensor(input_port.at("img").get_element_type(),
-        input_port.at("img").get_shape(), img_mat.data));
-    infer_request.start_async();
-    infer_request.wait();
-    ov::Tensor alp_tensor = infer_request.get_tensor("alp");
-    float* alp_ptr = alp_tensor.data<float>();
-    cv::Mat alp_mat(input_port.at("img").get_shape().at(1),
-        input_port.at("img").get_shape().at(2), CV_32FC1, alp_ptr);
-    cv::Mat alp3_mat;
-    std::vector<cv::Mat> alp = { alp_mat, alp_mat, alp_mat };
-    cv::merge(alp, alp3_mat);
-    frame.convertTo(frame, CV_32FC3);
-    cv::multiply(frame, alp3_mat, frame);
-    frame.convertTo(frame, CV_8UC3);
-    for (const auto& name : input_to_output) {
-        if (name.first == "img") continue;
-        infer_request.set_tensor(name.first, infer_request.get_tensor(name.second));
+    // matting，画面静止时跳过推理，推理请求中仍保留上一次的 alpha
+    if (change_gate->Unchanged(frame)) {
+        metrics.skipped_static.Add();
     }
+    else {
+        cv::Mat img_mat;
+        cv::resize(frame, img_mat, cv::Size(img_port.get_shape().at(2), img_port.get_shape().at(1)));
+        infer_request.set_tensor(img_port, ov::Tensor(img_port.get_element_type(),
+            img_port.get_shape(), img_mat.data));
+        hide_status->Bind(infer_request);
+        auto infer_start = std::chrono::steady_clock::now();
+        infer_request.start_async();
+        infer_request.wait();
+        std::chrono::duration<double> infer_elapsed = std::chrono::steady_clock::now() - infer_start;
+        metrics.inference_seconds.Observe(infer_elapsed.count());
+        metrics.inferred_full.Add();
+        hide_status->Advance();
+    }
+    // 每 300 帧向调试器输出一次跳过比例
+    if (change_gate->Enabled() && (change_gate->ProcessedCount() + change_gate->SkippedCount()) % 300 == 0) {
+        char message[96];
+        sprintf_s(message, "[INFO] APM vcam: static frames skipped %.1f%%\n", change_gate->SkipRatio() * 100);
+        OutputDebugStringA(message);
+    }
+    ov::Tensor alp_tensor = infer_request.get_tensor(alp_port);
+    float* alp_ptr = alp_tensor.data<float>();
+    cv::Mat alp_mat(img_port.get_shape().at(1),
+        img_port.get_shape().at(2), CV_32FC1, alp_ptr);
 
-
+    // 缩放 alpha 与合成到背景一次完成，结果直接写入输出缓冲区
     long lFrameLen = frame.cols * frame.rows * 3 * sizeof(unsigned char);
-    memcpy(pData, frame.data, std::min(lFrameLen, lDataLen));
+    if (lFrameLen <= lDataLen) {
+        cv::Mat output(frame.rows, frame.cols, CV_8UC3, pData);
+        background->Composite(alp_mat, frame, output);
+    }
+    else {
+        background->Composite(alp_mat, frame, frame);
+        memcpy(pData, frame.data, lDataLen);
+    }
     for (int i = lFrameLen; i < lDataLen; ++i)
         pData[i] = 255;
+    // 第一帧的延迟：从创建输出引脚到输出第一帧抠图结果
+    if (!first_frame_written) {
+        std::chrono::duration<double> first_elapsed = std::chrono::steady_clock::now() - startup_start;
+        metrics.first_frame_seconds.Set(first_elapsed.count());
+        first_frame_written = true;
+    }
+    metrics.frames_out.Add();
 
     Sleep(1);
     return NOERROR;
@@ -1,8 +1,18 @@
 #pragma once
 
+#include <chrono>
+#include <future>
+
 #include <opencv2/opencv.hpp>
 #include <openvino/openvino.hpp>
 
+#include "../../AwesomePortraitMatting/AwesomePortraitMatting/background.h"
+#include "../../AwesomePortraitMatting/AwesomePortraitMatting/blob_cache.h"
+#include "../../AwesomePortraitMatting/AwesomePortraitMatting/change_gate.h"
+#include "../../AwesomePortraitMatting/AwesomePortraitMatting/matting_kernels.h"
+#include "../../AwesomePortraitMatting/AwesomePortraitMatting/metrics.h"
+#include "../../AwesomePortraitMatting/AwesomePortraitMatting/recurrent_state.h"
+
 #define DECLARE_PTR(type, ptr, expr) type* ptr = (type*)(expr);
 
 EXTERN_C const GUID CLSID_VirtualCam;
@@ -78,20 +88,22 @@ private:
 
     cv::VideoCapture* real_capture = nullptr;
     ov::InferRequest infer_request;
-    std::unordered_map<std::string, std::vector<float>> init_status_handler = {
-    {"s1i", std::vector<float>(518400, 0)},
-    {"s2i", std::vector<float>(163200, 0)},
-    {"s3i", std::vector<float>(81600, 0)},
-    {"s4i", std::vector<float>(32640, 0)}
-    };
-    std::unordered_map<std::string, std::string> input_to_output = {
-        {"img", "alp"},
-        {"s1i", "s1o"},
-        {"s2i", "s2o"},
-        {"s3i", "s3o"},
-        {"s4i", "s4o"}
-    };
-    std::unordered_map<std::string, ov::Output<const ov::Node>> input_port;
+    std::unique_ptr<RecurrentState> hide_status;
+    ov::Output<const ov::Node> img_port;
+    ov::Output<const ov::Node> alp_port;
+    // 输出的背景，由环境变量 APM_VCAM_BACKGROUND 指定
+    std::unique_ptr<Background> background;
+    // 静止画面检测，阈值由环境变量 APM_VCAM_CHANGE_THRESHOLD 指定
+    std::unique_ptr<ChangeGate> change_gate;
+    // 运行指标的导出线程，输出路径由环境变量 APM_VCAM_METRICS 指定，未设置时不导出
+    std::unique_ptr<MetricsExporter> metrics_exporter;
+    // 创建输出引脚的时刻，用于统计启动耗时与第一帧的延迟
+    std::chrono::steady_clock::time_point startup_start;
+    // 模型是否已经可用、是否已输出第一帧抠图结果，只在 FillBuffer 中访问
+    bool model_loaded = false;
+    bool first_frame_written = false;
+    // 后台线程中的模型编译与预热；最后声明，析构时最先等待其结束，再释放推理请求
+    std::future<void> model_ready;
 };
 
 
@@ -3,8 +3,11 @@
 
 #include <filesystem>
 #include <cctype>
+#include <cstdlib>
+#include <map>
 
 #include "portrait_matting.h"
+#include "metrics.h"
 #include "argengine.hpp"
 
 void help_info()
@@ -16,8 +19,12 @@ void help_info()
         "\t\timage: use --format image.";
     std::string install_help =
         "\t\tIf you have never run APM on this computer, use this option to install it first.\n"\
-        "\t\tThe installation actually compiles the model and exports it as a cache blob to avoid\n"\
-        "\t\tinference time calculation errors caused by compiling model when launching the program.";
+        "\t\tThe installation compiles the model for every native size and exports them to the\n"\
+        "\t\tblob_cache directory, so later launches import them instead of compiling. Only one\n"\
+        "\t\tdownsample ratio (--downsample-ratio) and the default precision of the device are\n"\
+        "\t\tcompiled: run --install once per ratio you use. ROI crop sizes (--roi) are compiled on\n"\
+        "\t\tfirst use. Blobs are keyed by model, device, precision, shape and OpenVINO version, and\n"\
+        "\t\tare regenerated automatically when any of them changes.";
     std::string input_dir_help =
         "\t\tPath to the directory containing video or image files.\n"\
         "\t\tThe program will process all files contained in the directory. These files must be\n"\
@@ -34,7 +41,83 @@ void help_info()
     std::string mode_help =
         "\t\tMode of output. Default is alpha.\n"\
         "\t\talpah: The output is the mask (alpha).\n"\
-        "\t\tmerge: The output is an RGB image of the foreground.";
+        "\t\tmerge: The output is an RGB image of the foreground.\n"\
+        "\t\tforeground: Like merge, but uses the foreground color predicted by the model. The model\n"\
+        "\t\tmust keep the fgr output (--integrate with --keep-fgr).\n"\
+        "\t\treplace: Like merge, but on the image or video given by --background instead of black.\n"\
+        "\t\tblur: Like merge, but on the blurred background of the input itself.";
+    std::string background_help =
+        "\t\tPath to the background image or video used by --mode replace. The image is resized\n"\
+        "\t\tto the input size (keeping aspect ratio, center cropped), the video loops.";
+    std::string model_help =
+        "\t\tPath to the IR model (.xml). Default is model/awesome_portrait_matting.xml.\n"\
+        "\t\tA model exported with --batch-size N > 1 packs N videos into one inference. Such a\n"\
+        "\t\tmodel only processes videos, or images from a directory.";
+    std::string integrate_help =
+        "\t\tEmbed pre-processing (u8 BGR input, BGR->RGB, /255) into the original IR model and save\n"\
+        "\t\tthe result to --model. Nothing else is processed.";
+    std::string in_graph_help =
+        "\t\tUsed with --integrate. The model also accepts frames of any size and resizes them in\n"\
+        "\t\tgraph, and outputs alpha as u8 at the frame size, so no resize or convert runs on the\n"\
+        "\t\thost. Such a model runs on CPU with batch size 1.";
+    std::string downsample_help =
+        "\t\tResolution of the backbone relative to the input, in (0, 1]. Default is 0.4. Use 0.5\n"\
+        "\t\tfor small people in busy scenes and 0.25 for talking heads, which roughly halves the\n"\
+        "\t\tbackbone cost. Requires a model exported with --dynamic-ratio.";
+    std::string keyframe_help =
+        "\t\tRun the network at most every K frames for videos and camera. The frames in between\n"\
+        "\t\twarp the last alpha with low resolution optical flow, and the network runs earlier\n"\
+        "\t\twhen the motion can not be compensated. Default is 1 (every frame).";
+    std::string change_help =
+        "\t\tSkip inference on static frames for videos and camera: when no 32x32 block of a 160 px\n"\
+        "\t\twide thumbnail differs from the last processed frame by more than T on average (0-255),\n"\
+        "\t\tthe last alpha is reused. Try 2 for fixed cameras. Default is 0 (off).";
+    std::string roi_help =
+        "\t\tROI mode for videos and camera: infer only on a crop around the person found in the\n"\
+        "\t\tlast alpha, and paste the alpha back. The whole frame is inferred every N frames, or when\n"\
+        "\t\tthe person grows out of the crop or leaves. Default is 0 (off).";
+    std::string trace_help =
+        "\t\tRecord a per-frame timeline (capture, set_input_img, start_async, wait, generate_matting,\n"\
+        "\t\twrite, ...) with frame index and thread id, and save it as Chrome trace JSON to\n"\
+        "\t\tTRACE_PATH. Open it in chrome://tracing or ui.perfetto.dev to see stalls and jitter.";
+    std::string metrics_help =
+        "\t\tExport live metrics (frames in/out, dropped and skipped frames, inference latency\n"\
+        "\t\thistogram, queue depths, resident memory) in Prometheus text format to METRICS_PATH,\n"\
+        "\t\trefreshed every --metrics-interval seconds (default 5). Use a .prom file in the\n"\
+        "\t\tdirectory of the node_exporter textfile collector to scrape it.";
+    std::string jobs_help =
+        "\t\tNumber of files processed concurrently from a directory, each on its own infer request\n"\
+        "\t\tof one shared compiled model. Default is 0: as many as the device suggests. Images are\n"\
+        "\t\tpacked into batches when the model is exported with --batch-size N > 1.";
+    std::string recursive_help =
+        "\t\tAlso process the files in the subdirectories of INPUT_DIR. The results keep the same\n"\
+        "\t\trelative directories under OUTPUT_DIR.";
+    std::string segments_help =
+        "\t\tSplit a single input video into K time ranges processed concurrently on separate infer\n"\
+        "\t\trequests, and stitch the outputs in order. Each range starts --warmup frames early to\n"\
+        "\t\twarm up the recurrent state, and those outputs are discarded. Default is 1 (off).";
+    std::string warmup_help =
+        "\t\tWarm-up frames of each range of --segments, --start and --end. More frames give a\n"\
+        "\t\tbetter converged recurrent state at the range start, at the cost of extra inference.\n"\
+        "\t\tDefault is 30.";
+    std::string range_help =
+        "\t\tProcess only the frames [START, END) of a single input video. END defaults to the end of\n"\
+        "\t\tthe video. Can be combined with --segments.";
+    std::string checkpoint_help =
+        "\t\tFor a long single input video: write the output in chunks of N frames, and after each\n"\
+        "\t\tchunk save the next frame index and the recurrent state to <OUTPUT>.ckpt. The chunks are\n"\
+        "\t\tstitched into the output at the end. Default is 0 (off).";
+    std::string resume_help =
+        "\t\tUsed with --checkpoint. Continue an interrupted run from <OUTPUT>.ckpt: seek to the saved\n"\
+        "\t\tframe, restore the recurrent state and keep appending chunks. Starts from the first\n"\
+        "\t\tframe when there is no checkpoint for this input.";
+    std::string input_format_help =
+        "\t\tUsed with --integrate. Color format of the model input. nv12 and i420 take the decoder's\n"\
+        "\t\tsingle-plane YUV 4:2:0 frames and convert them to RGB in graph, so videos decoded as NV12\n"\
+        "\t\tskip the BGR conversion on the host. Default is bgr. Not with --in-graph-resize.";
+    std::string keep_fgr_help =
+        "\t\tUsed with --integrate. Keep the fgr (foreground) output, which is required by\n"\
+        "\t\t--mode foreground. By default it is removed, since alpha and merge never use it.";
 
     std::cout << "Awesome Portrait Matting (APM) - by 2103216" << std::endl
         << "usage: \t.\\apm.exe [options]" << std::endl
@@ -50,10 +133,50 @@ void help_info()
         << input_dir_help << std::endl
         << "--output OUTPUT_DIR, -o OUTPUT_DIR" << std::endl
         << output_dir_help << std::endl
+        << "--jobs N, -j N" << std::endl
+        << jobs_help << std::endl
+        << "--recursive, -r" << std::endl
+        << recursive_help << std::endl
+        << "--segments K" << std::endl
+        << segments_help << std::endl
+        << "--warmup W" << std::endl
+        << warmup_help << std::endl
+        << "--start START, --end END" << std::endl
+        << range_help << std::endl
+        << "--checkpoint N" << std::endl
+        << checkpoint_help << std::endl
+        << "--resume" << std::endl
+        << resume_help << std::endl
         << "--camera, -c \tUse camera as input." << std::endl
         << camera_help << std::endl
-        << "--mode [alpha, merge], -m [alpha, merge]" << std::endl
-        << mode_help << std::endl;
+        << "--mode [alpha, merge, foreground, replace, blur], -m [alpha, merge, foreground, replace, blur]" << std::endl
+        << mode_help << std::endl
+        << "--background BACKGROUND_PATH, -b BACKGROUND_PATH" << std::endl
+        << background_help << std::endl
+        << "--model MODEL_PATH" << std::endl
+        << model_help << std::endl
+        << "--integrate ORIGINAL_MODEL_PATH" << std::endl
+        << integrate_help << std::endl
+        << "--in-graph-resize" << std::endl
+        << in_graph_help << std::endl
+        << "--keep-fgr" << std::endl
+        << keep_fgr_help << std::endl
+        << "--input-format [bgr, nv12, i420]" << std::endl
+        << input_format_help << std::endl
+        << "--downsample-ratio RATIO" << std::endl
+        << downsample_help << std::endl
+        << "--keyframe-interval K" << std::endl
+        << keyframe_help << std::endl
+        << "--change-threshold T" << std::endl
+        << change_help << std::endl
+        << "--roi N" << std::endl
+        << roi_help << std::endl
+        << "--trace TRACE_PATH" << std::endl
+        << trace_help << std::endl
+        << "--metrics METRICS_PATH" << std::endl
+        << metrics_help << std::endl
+        << "--metrics-interval SECONDS" << std::endl
+        << "\t\tRefresh interval of --metrics. Default is 5." << std::endl;
 }
 
 void help_callback()
@@ -62,37 +185,52 @@ void help_callback()
     exit(0);
 }
 
-void awesome_portrait_matting(PortraitMatting& apm,
-    const std::filesystem::path& _input_path,
-    const std::filesystem::path& _output_dir,
-    const std::string& mode)
+// 图片扩展名
+const std::unordered_set<std::string> image_format = {
+    ".jpg", ".jpeg", ".jpe", ".jp2", // JPEG files
+    ".png", // Portable Network Graphics
+    ".bmp", ".dib", // Windows bitmatps
+    ".tiff", ".tif", // TIFF files
+    ".pbm", ".pgm", ".ppm", ".pxm", ".pnm", // Portable image format
+    ".hdr", ".pic" // Radiance HDR
+};
+
+bool is_image(const std::filesystem::path& path)
 {
-    // 图片扩展名
-    std::unordered_set<std::string> image_format = {
-        ".jpg", ".jpeg", ".jpe", ".jp2", // JPEG files
-        ".png", // Portable Network Graphics
-        ".bmp", ".dib", // Windows bitmatps
-        ".tiff", ".tif", // TIFF files
-        ".pbm", ".pgm", ".ppm", ".pxm", ".pnm", // Portable image format
-        ".hdr", ".pic" // Radiance HDR
-    };
-    // 完善输入输出路径
+    return image_format.find(path.extension().generic_string()) != image_format.end();
+}
+
+std::string result_path(const std::filesystem::path& _input_path,
+    const std::filesystem::path& _output_dir)
+{
+    // 完善输出路径：与输入同名，但以 _result 结尾
     std::filesystem::path output_dir = _output_dir;
-    std::string input_path = _input_path.generic_string();
     std::string output_path = output_dir
         .append(_input_path.filename().generic_string())
         .generic_string();
     while (output_path.back() != '.') output_path.pop_back();
     output_path.pop_back();
     output_path.append("_result");
+    output_path.append(is_image(_input_path) ? ".jpg" : ".mp4");
+    return output_path;
+}
+
+void awesome_portrait_matting(PortraitMatting& apm,
+    const std::filesystem::path& _input_path,
+    const std::filesystem::path& _output_dir,
+    const std::string& mode)
+{
+    // 完善输入输出路径
+    std::string input_path = _input_path.generic_string();
+    std::string output_path = result_path(_input_path, _output_dir);
     // 分辨输入是图片还是视频
-    if (image_format.find(_input_path.extension().generic_string()) != image_format.end()) {
+    if (is_image(_input_path)) {
         std::cout << "[INFO] Input is image: " << input_path << std::endl; // 输入是图片
-        apm.ImageMatting(input_path, output_path.append(".jpg"), mode);
+        apm.ImageMatting(input_path, output_path, mode);
     }
     else {
         std::cout << "[INFO] Input is video: " << input_path << std::endl; // 输入是视频
-        apm.VideoMatting(input_path, output_path.append(".mp4"), mode);
+        apm.VideoMatting(input_path, output_path, mode);
     }
 }
 
@@ -103,8 +241,24 @@ int main(int argc, char* argv[])
     //    "model/awesome_portrait_matting");
 
     std::filesystem::path input_path, output_dir;
-    bool camera = false, install = false;
+    bool camera = false, install = false, in_graph_resize = false, keep_fgr = false, recursive = false, resume = false;
     std::string mode = "alpha";
+    std::string model_path("model/awesome_portrait_matting.xml");
+    std::string integrate_path;
+    std::string input_format = "bgr";
+    std::string background_path;
+    double downsample_ratio = 0;
+    int keyframe_interval = 1;
+    double change_threshold = 0;
+    int roi_interval = 0;
+    std::string trace_path;
+    std::string metrics_path;
+    double metrics_interval = 5;
+    int jobs = 0;
+    int segments = 1;
+    int warmup_frames = PortraitMatting::default_warmup_frames;
+    int start_frame = 0, end_frame = -1;
+    int checkpoint_interval = 0;
 
     // ========  Step 0: 准备输入参数 =========
     juzzlin::Argengine ae(argc, argv, false);
@@ -119,12 +273,75 @@ int main(int argc, char* argv[])
     ae.addOption({ "-o", "--output" }, [&output_dir](std::string _output_dir) {
         output_dir = _output_dir;
         });
+    ae.addOption({ "-j", "--jobs" }, [&jobs](std::string _jobs) {
+        jobs = std::atoi(_jobs.c_str());
+        });
+    ae.addOption({ "-r", "--recursive" }, [&recursive]() {
+        recursive = true;
+        });
+    ae.addOption({ "--segments" }, [&segments](std::string _segments) {
+        segments = std::atoi(_segments.c_str());
+        });
+    ae.addOption({ "--warmup" }, [&warmup_frames](std::string _warmup) {
+        warmup_frames = std::atoi(_warmup.c_str());
+        });
+    ae.addOption({ "--start" }, [&start_frame](std::string _start) {
+        start_frame = std::atoi(_start.c_str());
+        });
+    ae.addOption({ "--end" }, [&end_frame](std::string _end) {
+        end_frame = std::atoi(_end.c_str());
+        });
+    ae.addOption({ "--checkpoint" }, [&checkpoint_interval](std::string _interval) {
+        checkpoint_interval = std::atoi(_interval.c_str());
+        });
+    ae.addOption({ "--resume" }, [&resume]() {
+        resume = true;
+        });
     ae.addOption({ "-c", "--camera" }, [&camera]() {
         camera = true;
         });
     ae.addOption({ "-m", "--mode" }, [&mode](std::string _mode) {
         mode = _mode;
         });
+    ae.addOption({ "-b", "--background" }, [&background_path](std::string _background_path) {
+        background_path = _background_path;
+        });
+    ae.addOption({ "--model" }, [&model_path](std::string _model_path) {
+        model_path = _model_path;
+        });
+    ae.addOption({ "--integrate" }, [&integrate_path](std::string _integrate_path) {
+        integrate_path = _integrate_path;
+        });
+    ae.addOption({ "--in-graph-resize" }, [&in_graph_resize]() {
+        in_graph_resize = true;
+        });
+    ae.addOption({ "--keep-fgr" }, [&keep_fgr]() {
+        keep_fgr = true;
+        });
+    ae.addOption({ "--input-format" }, [&input_format](std::string _input_format) {
+        input_format = _input_format;
+        });
+    ae.addOption({ "--downsample-ratio" }, [&downsample_ratio](std::string _ratio) {
+        downsample_ratio = std::atof(_ratio.c_str());
+        });
+    ae.addOption({ "--keyframe-interval" }, [&keyframe_interval](std::string _interval) {
+        keyframe_interval = std::atoi(_interval.c_str());
+        });
+    ae.addOption({ "--change-threshold" }, [&change_threshold](std::string _threshold) {
+        change_threshold = std::atof(_threshold.c_str());
+        });
+    ae.addOption({ "--roi" }, [&roi_interval](std::string _interval) {
+        roi_interval = std::atoi(_interval.c_str());
+        });
+    ae.addOption({ "--trace" }, [&trace_path](std::string _trace_path) {
+        trace_path = _trace_path;
+        });
+    ae.addOption({ "--metrics" }, [&metrics_path](std::string _metrics_path) {
+        metrics_path = _metrics_path;
+        });
+    ae.addOption({ "--metrics-interval" }, [&metrics_interval](std::string _interval) {
+        metrics_interval = std::atof(_interval.c_str());
+        });
     try {
         ae.parse();
     }
@@ -134,18 +351,43 @@ int main(int argc, char* argv[])
         return EXIT_FAILURE;
     }
 
-    // 编译模型并导出缓存 cache
-    // 同一台设备只需要 install 一次即可！
+    // 将前处理（以及可选的图内缩放与 u8 输出）整合到原始模型，输出到 --model 指定的路径
+    if (!integrate_path.empty()) {
+        const std::map<std::string, ModelCache::ColorFormat> input_formats = {
+            { "bgr", ModelCache::ColorFormat::BGR },
+            { "nv12", ModelCache::ColorFormat::NV12 },
+            { "i420", ModelCache::ColorFormat::I420 }
+        };
+        auto color_format = input_formats.find(input_format);
+        if (color_format == input_formats.end()) {
+            std::cerr << "[ERROR] Wrong input format, it must be bgr, nv12 or i420." << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (color_format->second != ModelCache::ColorFormat::BGR && in_graph_resize) {
+            std::cerr << "[ERROR] --input-format " << input_format << " can not be used with --in-graph-resize." << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::string integrated_model = model_path;
+        if (std::filesystem::path(integrated_model).extension() == ".xml")
+            integrated_model.resize(integrated_model.size() - 4);
+        std::cout << "[INFO] Integrating model: " << integrate_path << std::endl;
+        PortraitMatting::IntegrateModel(integrate_path, integrated_model, in_graph_resize, in_graph_resize,
+            cv::Size(), keep_fgr, color_format->second);
+        std::cout << "[INFO] Successful!" << std::endl
+            << "[INFO] Output: " << integrated_model << ".xml" << std::endl;
+        return 0;
+    }
+
+    // 编译所有原生尺寸并导出缓存 blob_cache：只编译 --downsample-ratio 指定的一个比例与设备的默认精度，
+    // 使用多个比例时每个比例 install 一次；ROI 的裁剪尺寸在第一次使用时编译
+    // 同一台设备只需要 install 一次即可！模型、设备或 OpenVINO 版本变化后缓存会自动重新生成
     if (install) {
-        std::cout << "[INFO] Compiling and loading model into device..." << std::endl
-            << "[INFO] If this is first time, it may take a while...";
-        ov::Core core;
-        core.set_property(ov::cache_dir("cl_cache"));
-        std::shared_ptr<ov::Model> model = core.read_model("model/awesome_portrait_matting.xml");
-        ov::CompiledModel compiled_model = core.compile_model(model, "AUTO:GPU,CPU",
-            ov::hint::performance_mode(ov::hint::PerformanceMode::THROUGHPUT));
-        std::cout << "done!" << std::endl;
-        std::cout << "[INFO] Successful installation!" << std::endl;
+        PortraitMatting matte(model_path, downsample_ratio);
+        std::cout << "[INFO] Compiling every native size at downsample ratio " << matte.DownsampleRatio()
+            << ", it may take a while..." << std::endl;
+        size_t compiled = matte.Precompile();
+        std::cout << "[INFO] Successful installation! " << compiled << " compiled models in: "
+            << PortraitMatting::default_blob_dir << std::endl;
         return 0;
     }
 
@@ -167,53 +409,180 @@ int main(int argc, char* argv[])
         output_dir = output_dir.parent_path();
     }
     // 错误的输出模式
-    if (mode != "alpha" && mode != "merge") {
-        std::cerr << "[ERROR] Wrong output mode, mode must be alpha or merge." << std::endl;
+    if (mode != "alpha" && mode != "merge" && mode != "foreground" && mode != "replace" && mode != "blur") {
+        std::cerr << "[ERROR] Wrong output mode, mode must be alpha, merge, foreground, replace or blur." << std::endl;
         help_info();
         return EXIT_FAILURE;
     }
+    // 错误的下采样比例
+    if (downsample_ratio < 0 || downsample_ratio > 1) {
+        std::cerr << "[ERROR] Wrong downsample ratio, it must be in (0, 1]." << std::endl;
+        return EXIT_FAILURE;
+    }
+    // 错误的关键帧间隔
+    if (keyframe_interval < 1) {
+        std::cerr << "[ERROR] Wrong keyframe interval, it must be at least 1." << std::endl;
+        return EXIT_FAILURE;
+    }
+    // 错误的静止画面阈值
+    if (change_threshold < 0 || change_threshold > 255) {
+        std::cerr << "[ERROR] Wrong change threshold, it must be in [0, 255]." << std::endl;
+        return EXIT_FAILURE;
+    }
+    // 错误的 ROI 整帧推理间隔
+    if (roi_interval < 0) {
+        std::cerr << "[ERROR] Wrong ROI interval, it must be at least 0." << std::endl;
+        return EXIT_FAILURE;
+    }
+    // 错误的并发数
+    if (jobs < 0) {
+        std::cerr << "[ERROR] Wrong number of jobs, it must be at least 0." << std::endl;
+        return EXIT_FAILURE;
+    }
+    // 错误的分段数、预热帧数与帧范围
+    if (segments < 1 || warmup_frames < 0) {
+        std::cerr << "[ERROR] Wrong segments or warm-up frames, segments must be at least 1 and warm-up at least 0." << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (start_frame < 0 || (end_frame >= 0 && end_frame <= start_frame)) {
+        std::cerr << "[ERROR] Wrong frame range, it must be 0 <= START < END." << std::endl;
+        return EXIT_FAILURE;
+    }
+    // 分段与帧范围只作用于单个视频
+    const bool segment_mode = segments > 1 || start_frame > 0 || end_frame >= 0;
+    if (segment_mode && (camera || !input_path.has_extension() || is_image(input_path))) {
+        std::cerr << "[ERROR] --segments, --start and --end require a single input video." << std::endl;
+        return EXIT_FAILURE;
+    }
+    // 断点只作用于单个视频的完整处理
+    if (checkpoint_interval < 0 || (resume && checkpoint_interval == 0)) {
+        std::cerr << "[ERROR] Wrong checkpoint interval, it must be at least 0, and --resume requires --checkpoint N." << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (checkpoint_interval > 0 && (segment_mode || camera || !input_path.has_extension() || is_image(input_path))) {
+        std::cerr << "[ERROR] --checkpoint requires a single input video without --segments, --start or --end." << std::endl;
+        return EXIT_FAILURE;
+    }
+    // 错误的指标刷新间隔
+    if (metrics_interval <= 0) {
+        std::cerr << "[ERROR] Wrong metrics interval, it must be positive." << std::endl;
+        return EXIT_FAILURE;
+    }
+    // replace 模式必须指定背景
+    if (mode == "replace" && background_path.empty()) {
+        std::cerr << "[ERROR] Replace mode requires a background image or video: use --background.\n" << std::endl;
+        help_info();
+        return EXIT_FAILURE;
+    }
+
+    // 错误的摄像头编号，输入为空时默认从 0 号相机读取输入
+    std::string camera_id = camera ? input_path.generic_string() : std::string();
+    if (camera && camera_id.empty()) {
+        camera_id = "0";
+    }
+    else if (camera && (camera_id.size() > 1 || !isdigit(camera_id.at(0)))) {
+        std::cerr << "[ERROR] Wrong camera id." << std::endl;
+        return EXIT_FAILURE;
+    }
 
     // ========  Step 2: 创建 matting 类 =========
-    std::string model_path("model/awesome_portrait_matting.xml");
-    PortraitMatting matte(model_path);
+    // 编译（或读取缓存）与预热推理在后台线程进行，同时在当前线程打开摄像头
+    std::future<std::unique_ptr<PortraitMatting>> matte_future = PortraitMatting::CreateAsync(model_path, downsample_ratio);
+    cv::VideoCapture camera_capture;
+    if (camera) {
+        camera_capture = PortraitMatting::OpenCamera(stoi(camera_id));
+        if (!camera_capture.isOpened()) return EXIT_FAILURE;
+    }
+    std::unique_ptr<PortraitMatting> matte_ptr = matte_future.get();
+    PortraitMatting& matte = *matte_ptr;
+    // 后台预热使用模型自身的尺寸；摄像头的尺寸选中其他原生尺寸时在第一帧之前预热该模型，相同时不做任何事
+    if (camera) {
+        matte.Warmup(cv::Size(static_cast<int>(camera_capture.get(cv::CAP_PROP_FRAME_WIDTH)),
+            static_cast<int>(camera_capture.get(cv::CAP_PROP_FRAME_HEIGHT))));
+    }
+    matte.SetBackground(background_path);
+    matte.SetKeyframeInterval(keyframe_interval);
+    matte.SetChangeThreshold(change_threshold);
+    matte.SetRoiInterval(roi_interval);
+    matte.SetCheckpoint(checkpoint_interval, resume);
+    if (!trace_path.empty())
+        matte.StartTrace(trace_path);
+    // 定期导出运行指标，析构时写入最后一次
+    std::unique_ptr<MetricsExporter> metrics_exporter;
+    if (!metrics_path.empty()) {
+        metrics_exporter = std::make_unique<MetricsExporter>(metrics_path, static_cast<int>(metrics_interval * 1000));
+        std::cout << "[INFO] Metrics: " << metrics_path << std::endl;
+    }
 
     // ========  Step 3: 处理输入 =========
     // 指定了 -camera 选项，则从相机读取输入
     if (camera) {
-        std::string camera_id = input_path.generic_string();
         std::string output_name = output_dir.empty() ? "CameraMatting" : output_dir.generic_string();
-        // 输入为空，默认从 0 号相机读取输入
-        if (camera_id.empty()) {
-            camera_id = "0";
-        }
-        else if (camera_id.size() > 1 || !isdigit(camera_id.at(0))) {
-            std::cerr << "[ERROR] Wrong camera id." << std::endl;
-            return EXIT_FAILURE;
-        }
-        matte.CameraMatting(stoi(camera_id), output_name, mode);
+        matte.CameraMatting(camera_capture, output_name, mode);
     }
     // 输入没有扩展名，即为目录，处理目录中所有文件
     if (!camera && !input_path.has_extension()) {
         std::cout << "[INFO] Input is directory, which will process all files in the directory." << std::endl;
-        // 遍历目录中的文件
-        std::filesystem::directory_iterator input_it(input_path), end;
-        // 递归遍历目录及其子目录
-        //std::filesystem::recursive_directory_iterator input_it(input_path), end; 
-        if (input_it == end) {
+        // 遍历目录中的文件；指定 --recursive 时递归遍历目录及其子目录
+        std::vector<std::filesystem::path> files;
+        if (recursive) {
+            for (const auto& entry : std::filesystem::recursive_directory_iterator(input_path))
+                files.push_back(entry.path());
+        }
+        else {
+            for (const auto& entry : std::filesystem::directory_iterator(input_path))
+                files.push_back(entry.path());
+        }
+        if (files.empty()) {
             std::cout << "[INFO] Directory is empty, exit." << std::endl;
         }
 
-        for (int i = 0; input_it != end; ++input_it) {
-            if (!input_it->path().has_extension()) continue; // 跳过子目录
-            std::cout << "\n=====> The " << ++i << "-th file in directory: " << input_path << std::endl;
-            awesome_portrait_matting(matte, input_it->path(), output_dir, mode);
-            std::cout << std::endl;
+        // 图片与视频分别收集起来，在共享的编译模型上并发处理
+        std::vector<std::string> image_paths, image_outputs, video_paths, video_outputs;
+        for (const auto& file : files) {
+            if (!file.has_extension()) continue; // 跳过子目录
+            // 子目录中的文件输出到输出目录下相同的相对目录
+            std::filesystem::path file_output_dir = output_dir / file.parent_path().lexically_relative(input_path);
+            std::error_code ec;
+            std::filesystem::create_directories(file_output_dir, ec);
+            if (is_image(file)) {
+                image_paths.push_back(file.generic_string());
+                image_outputs.push_back(result_path(file, file_output_dir));
+            }
+            else {
+                video_paths.push_back(file.generic_string());
+                video_outputs.push_back(result_path(file, file_output_dir));
+            }
+        }
+        // 单个文件不需要并发；batch > 1 的模型只能经由 MultiImageMatting 处理图片
+        if (image_paths.size() == 1 && matte.BatchSize() == 1) {
+            awesome_portrait_matting(matte, image_paths.front(), std::filesystem::path(image_outputs.front()).parent_path(), mode);
+        }
+        else if (!image_paths.empty()) {
+            std::cout << "\n=====> " << image_paths.size() << " images in directory: " << input_path << std::endl;
+            matte.MultiImageMatting(image_paths, image_outputs, mode, jobs);
+        }
+        if (video_paths.size() == 1) {
+            awesome_portrait_matting(matte, video_paths.front(), std::filesystem::path(video_outputs.front()).parent_path(), mode);
+        }
+        else if (video_paths.size() > 1) {
+            std::cout << "\n=====> " << video_paths.size() << " videos in directory: " << input_path << std::endl;
+            matte.MultiVideoMatting(video_paths, video_outputs, mode, jobs);
         }
     }
+    // 输入为视频，并指定了分段或帧范围
+    else if (segment_mode) {
+        std::cout << "[INFO] Input is video: " << input_path.generic_string() << std::endl;
+        matte.SegmentVideoMatting(input_path.generic_string(), result_path(input_path, output_dir), mode,
+            segments, warmup_frames, start_frame, end_frame);
+    }
     // 输入有扩展名，即为文件，单独处理指定文件
     else if (!camera && input_path.has_extension()) {
         awesome_portrait_matting(matte, input_path, output_dir, mode);
     }
 
+    // 写入时间线
+    if (!matte.StopTrace())
+        return EXIT_FAILURE;
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,79 @@
+﻿#include <algorithm>
+
+#include "alpha_propagator.h"
+
+namespace {
+    /**
+     * @brief 将光流（位移）转换为 remap 使用的绝对坐标：map(x, y) = (x, y) + flow(x, y) * scale。
+     */
+    void flow_to_map(const cv::Mat& flow, cv::Mat& map, float scale_x, float scale_y)
+    {
+        map.create(flow.size(), CV_32FC2);
+        for (int y = 0; y < flow.rows; ++y) {
+            const float* f = flow.ptr<float>(y);
+            float* m = map.ptr<float>(y);
+            for (int x = 0; x < flow.cols; ++x) {
+                m[2 * x] = x + f[2 * x] * scale_x;
+                m[2 * x + 1] = y + f[2 * x + 1] * scale_y;
+            }
+        }
+    }
+}
+
+AlphaPropagator::AlphaPropagator(int interval, double residual_threshold)
+    : interval(std::max(1, interval)), residual_threshold(residual_threshold)
+{
+    if (this->Enabled())
+        flow = cv::DISOpticalFlow::create(cv::DISOpticalFlow::PRESET_ULTRAFAST);
+}
+
+bool AlphaPropagator::Propagate(const cv::Mat& frame, cv::Mat& alpha)
+{
+    // ========  Step 1: 没有关键帧或达到最大间隔时推理 =========
+    if (!this->Enabled() || key_alpha.empty() || since_key + 1 >= interval) return false;
+
+    // ========  Step 2: 低分辨率下估计当前帧到关键帧的光流 =========
+    this->to_gray(frame, gray);
+    if (gray.size() != key_gray.size()) return false;
+    flow->calc(gray, key_gray, flow_small);
+
+    // ========  Step 3: 用光流把关键帧映射到当前帧，误差过大说明运动补偿不可靠 =========
+    flow_to_map(flow_small, map_small, 1.0f, 1.0f);
+    cv::remap(key_gray, warped_gray, map_small, cv::Mat(), cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+    cv::absdiff(warped_gray, gray, diff);
+    if (cv::mean(diff)[0] > residual_threshold) return false;
+
+    // ========  Step 4: 将光流放大到 alpha 的尺寸，反向映射关键帧的 alpha =========
+    cv::resize(flow_small, flow_up, key_alpha.size(), 0, 0, cv::INTER_LINEAR);
+    flow_to_map(flow_up, flow_up,
+        static_cast<float>(key_alpha.cols) / flow_small.cols,
+        static_cast<float>(key_alpha.rows) / flow_small.rows);
+    cv::remap(key_alpha, alpha, flow_up, cv::Mat(), cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+    ++since_key;
+    ++propagated;
+    return true;
+}
+
+void AlphaPropagator::SetKeyframe(const cv::Mat& frame, const cv::Mat& alpha)
+{
+    if (!this->Enabled()) return;
+    this->to_gray(frame, key_gray);
+    alpha.copyTo(key_alpha);
+    since_key = 0;
+    ++keyframes;
+}
+
+void AlphaPropagator::Reset()
+{
+    key_gray.release();
+    key_alpha.release();
+    since_key = 0;
+}
+
+void AlphaPropagator::to_gray(const cv::Mat& frame, cv::Mat& gray)
+{
+    const int width = std::min(flow_width, frame.cols);
+    const int height = std::max(1, frame.rows * width / frame.cols);
+    cv::resize(frame, small, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+    cv::cvtColor(small, gray, cv::COLOR_BGR2GRAY);
+}
\ No newline at end of file
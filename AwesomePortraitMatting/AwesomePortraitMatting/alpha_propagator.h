@@ -0,0 +1,84 @@
+﻿#pragma once
+
+#ifndef ALPHA_PROPAGATOR_H
+#define ALPHA_PROPAGATOR_H
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * @brief 关键帧模式：每隔若干帧（或在运动补偿不可靠时）才运行一次网络，其余帧将上一关键帧的 alpha
+ * 按运动补偿传播过来。
+ *  * 运动估计在约 320 像素宽的灰度图上进行（DIS 光流，ULTRAFAST 预设），每帧只需 1~2 ms；
+ *  * 光流从当前帧指向关键帧，alpha 总是从关键帧直接反向映射（remap），误差不会逐帧累积；
+ *  * 用光流把关键帧的灰度图映射到当前帧，平均绝对误差超过阈值（遮挡、快速运动、切换镜头）时立即推理。
+ * 跳过的帧不经过网络，隐藏状态保持为上一关键帧的输出，下一关键帧仍按顺序衔接，相当于以较低帧率推理。
+ */
+class AlphaPropagator
+{
+public:
+    /**
+     * @param interval 关键帧的最大间隔，1 表示每帧都推理（不传播）。
+     * @param residual_threshold 运动补偿后灰度图的平均绝对误差阈值（0~255），超过时需要推理。
+     */
+    explicit AlphaPropagator(int interval, double residual_threshold = 8.0);
+
+    //! 是否开启关键帧模式
+    bool Enabled() const { return interval > 1; }
+
+    /**
+     * @brief 尝试将上一关键帧的 alpha 传播到当前帧。
+     * @param frame 当前帧（CV_8UC3），与关键帧的尺寸相同。
+     * @param alpha 输出，与关键帧 alpha 的类型、尺寸相同；为空时重新分配。
+     * @return 传播成功时返回 true；没有关键帧、达到最大间隔或运动补偿不可靠时返回 false，此时需要推理并调用 SetKeyframe。
+     */
+    bool Propagate(const cv::Mat& frame, cv::Mat& alpha);
+
+    /**
+     * @brief 记录推理得到的关键帧。
+     * @param frame 关键帧（CV_8UC3）。
+     * @param alpha 网络输出的 alpha，CV_32FC1（模型尺寸）或 CV_8UC1，在此深拷贝。
+     */
+    void SetKeyframe(const cv::Mat& frame, const cv::Mat& alpha);
+
+    /**
+     * @brief 丢弃关键帧，下一帧必须推理。
+     */
+    void Reset();
+
+    //! 关键帧（推理）的帧数
+    int KeyframeCount() const { return keyframes; }
+    //! 传播（跳过推理）的帧数
+    int PropagatedCount() const { return propagated; }
+
+protected:
+    AlphaPropagator(const AlphaPropagator&) = delete;
+    AlphaPropagator& operator=(const AlphaPropagator&) = delete;
+
+private:
+    /**
+     * @brief 将帧缩小到运动估计的分辨率并转换为灰度图。
+     */
+    void to_gray(const cv::Mat& frame, cv::Mat& gray);
+
+    int interval;
+    double residual_threshold;
+    cv::Ptr<cv::DISOpticalFlow> flow;
+
+    //! 关键帧的低分辨率灰度图
+    cv::Mat key_gray;
+    //! 关键帧的 alpha
+    cv::Mat key_alpha;
+    //! 距离关键帧的帧数
+    int since_key = 0;
+
+    //! 复用的缓冲区
+    cv::Mat gray, small, flow_small, map_small, warped_gray, diff, flow_up;
+
+    int keyframes = 0;
+    int propagated = 0;
+
+    //! 运动估计的图像宽度
+    static constexpr int flow_width = 320;
+};
+
+#endif // ALPHA_PROPAGATOR_H
\ No newline at end of file
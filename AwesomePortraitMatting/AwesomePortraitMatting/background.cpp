@@ -0,0 +1,165 @@
+﻿#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "background.h"
+#include "matting_kernels.h"
+
+namespace {
+    /**
+     * @brief 保持比例缩放图像使其覆盖目标尺寸，并居中裁剪。
+     */
+    void resize_cover(const cv::Mat& src, cv::Mat& dst, const cv::Size& size)
+    {
+        const double scale = std::max(static_cast<double>(size.width) / src.cols,
+            static_cast<double>(size.height) / src.rows);
+        const cv::Size scaled(std::max(size.width, static_cast<int>(std::lround(src.cols * scale))),
+            std::max(size.height, static_cast<int>(std::lround(src.rows * scale))));
+        // 缩放的中间结果在同一线程中复用，预取线程逐帧调用时不再分配
+        thread_local cv::Mat resized;
+        cv::resize(src, resized, scaled, 0, 0, scale < 1 ? cv::INTER_AREA : cv::INTER_LINEAR);
+        const cv::Rect roi((scaled.width - size.width) / 2, (scaled.height - size.height) / 2,
+            size.width, size.height);
+        resized(roi).copyTo(dst);
+    }
+
+    /**
+     * @brief 缓冲区是否仍被其他 cv::Mat 引用（原子地读取引用计数，其他线程可能同时释放）。
+     */
+    bool shared(const cv::Mat& mat)
+    {
+        return mat.u != nullptr && CV_XADD(&mat.u->refcount, 0) > 1;
+    }
+}
+
+Background::Background(const std::string& mode, const std::string& path)
+{
+    if (mode == "blur") {
+        kind = Kind::Blur;
+        return;
+    }
+    if (mode != "replace") return;
+
+    // ========  replace 模式：先按图片读取，失败时按视频打开 =========
+    if (path.empty()) {
+        std::cerr << "[ERROR] Replace mode requires a background image or video: use --background." << std::endl;
+        opened = false;
+        return;
+    }
+    source = cv::imread(path);
+    if (!source.empty()) {
+        kind = Kind::Image;
+        return;
+    }
+    if (capture.open(path) && capture.isOpened()) {
+        kind = Kind::Video;
+        return;
+    }
+    std::cerr << "[ERROR] Can not open background from: " << path << std::endl;
+    opened = false;
+}
+
+Background::~Background()
+{
+    this->stop_prefetch();
+}
+
+void Background::Composite(const cv::Mat& alpha, const cv::Mat& frame, cv::Mat& dst)
+{
+    switch (kind) {
+    case Kind::Image:
+        matting::CompositeOnBackground(alpha, frame, this->image_background(frame.size()), dst);
+        return;
+    case Kind::Video: {
+        const cv::Mat& background = this->video_background(frame.size());
+        // 背景视频无法解码时退化为黑色背景
+        if (background.empty())
+            matting::CompositeOnBlack(alpha, frame, dst);
+        else
+            matting::CompositeOnBackground(alpha, frame, background, dst);
+        return;
+    }
+    case Kind::Blur:
+        // 虚化背景在合成前计算完成，dst 可以是 frame 自身
+        matting::CompositeOnBackground(alpha, frame, this->blur_background(frame), dst);
+        return;
+    default:
+        matting::CompositeOnBlack(alpha, frame, dst);
+        return;
+    }
+}
+
+const cv::Mat& Background::image_background(const cv::Size& size)
+{
+    if (current.size() != size)
+        resize_cover(source, current, size);
+    return current;
+}
+
+const cv::Mat& Background::video_background(const cv::Size& size)
+{
+    if (prefetch_size != size) {
+        this->stop_prefetch();
+        this->start_prefetch(size);
+        current.release();
+    }
+    // 预取队列为空时阻塞等待；队列关闭（视频无法解码）时保留上一帧
+    cv::Mat next;
+    if (prefetched->pop(next))
+        current = next;
+    return current;
+}
+
+const cv::Mat& Background::blur_background(const cv::Mat& frame)
+{
+    const cv::Size small_size(std::max(1, static_cast<int>(frame.cols * blur_scale)),
+        std::max(1, static_cast<int>(frame.rows * blur_scale)));
+    cv::resize(frame, small, small_size, 0, 0, cv::INTER_AREA);
+    cv::GaussianBlur(small, small, cv::Size(), blur_sigma);
+    cv::resize(small, current, frame.size(), 0, 0, cv::INTER_LINEAR);
+    return current;
+}
+
+void Background::start_prefetch(const cv::Size& size)
+{
+    prefetch_size = size;
+    prefetched = std::make_unique<BoundedQueue<cv::Mat>>(prefetch_depth);
+    prefetcher = std::thread([this, size]() {
+        // 背景视频损坏时解码、缩放可能抛出 cv::Exception，不能逃出线程：输出错误信息并关闭队列，
+        // 合成线程保留上一帧（没有时退化为黑色背景）
+        try {
+            cv::Mat frame;
+            // 缩放后的帧循环复用：队列中的帧、合成线程正在使用的一帧，加上正在写入的一帧
+            std::vector<cv::Mat> ring(prefetch_depth + 2);
+            size_t next = 0;
+            bool rewound = false;
+            while (true) {
+                if (!capture.read(frame) || frame.empty()) {
+                    // 播放结束，从头循环；刚从头开始仍然读不到帧时停止
+                    if (rewound) break;
+                    capture.set(cv::CAP_PROP_POS_FRAMES, 0);
+                    rewound = true;
+                    continue;
+                }
+                rewound = false;
+                cv::Mat& resized = ring[next];
+                next = (next + 1) % ring.size();
+                // 仍被合成线程引用时不能覆盖，改为分配新的缓冲区
+                if (shared(resized)) resized.release();
+                resize_cover(frame, resized, size);
+                if (!prefetched->push(resized)) break;
+            }
+        }
+        catch (const std::exception& ex) {
+            std::cerr << "[ERROR] Can not decode the background video: " << ex.what() << std::endl;
+        }
+        prefetched->close();
+        });
+}
+
+void Background::stop_prefetch()
+{
+    if (prefetched) prefetched->close();
+    if (prefetcher.joinable()) prefetcher.join();
+}
\ No newline at end of file
@@ -0,0 +1,118 @@
+﻿#pragma once
+
+#ifndef BACKGROUND_H
+#define BACKGROUND_H
+
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <opencv2/opencv.hpp>
+
+#include "bounded_queue.h"
+
+/**
+ * @brief 抠图结果的背景，按模式将原图合成到不同的背景上。
+ *  * merge / foreground：黑色背景；
+ *  * replace：替换为指定的图片或视频。图片按帧尺寸缩放（保持比例，居中裁剪）一次后缓存；
+ *    视频在独立的预取线程中解码并缩放，循环播放，合成时只取出一帧；
+ *  * blur：虚化原图的背景。在 1/4 分辨率下高斯模糊后放大，代价远小于全分辨率模糊。
+ * 合成由 matting::CompositeOnBlack / CompositeOnBackground 一次遍历完成。
+ */
+class Background
+{
+public:
+    /**
+     * @brief 背景的类型。
+     */
+    enum class Kind
+    {
+        Black,
+        Image,
+        Video,
+        Blur
+    };
+
+    /**
+     * @brief 按抠图模式构造背景。
+     * @param mode 抠图模式，replace 与 blur 之外的模式都使用黑色背景。
+     * @param path replace 模式下背景图片或视频的路径。
+     *
+     * @note 打开背景失败时输出错误信息，IsOpened() 返回 false。
+     * @note 路径中最好不要有非 ASCII 字符。
+     */
+    Background(const std::string& mode, const std::string& path = std::string());
+    ~Background();
+
+    /**
+     * @brief 是否为需要背景的模式（replace、blur）。
+     */
+    static bool IsBackgroundMode(const std::string& mode) { return mode == "replace" || mode == "blur"; }
+
+    //! 背景是否可用
+    bool IsOpened() const { return opened; }
+
+    //! 背景的类型
+    Kind GetKind() const { return kind; }
+
+    /**
+     * @brief 将原图合成到背景上，视频背景每次调用前进一帧。
+     * @param alpha 同 matting::CompositeOnBlack。
+     * @param frame CV_8UC3 的原图。
+     * @param dst 输出，尺寸与 frame 相同；可以是 frame 自身。
+     *
+     * @note 非线程安全。每路视频使用各自的 Background。
+     */
+    void Composite(const cv::Mat& alpha, const cv::Mat& frame, cv::Mat& dst);
+
+protected:
+    Background(const Background&) = delete;
+    Background& operator=(const Background&) = delete;
+
+private:
+    /**
+     * @brief 按帧尺寸缩放（保持比例，居中裁剪）背景图片，尺寸不变时直接返回缓存。
+     */
+    const cv::Mat& image_background(const cv::Size& size);
+
+    /**
+     * @brief 取出预取线程解码的下一帧背景，帧尺寸变化时重新启动预取线程。
+     */
+    const cv::Mat& video_background(const cv::Size& size);
+
+    /**
+     * @brief 在低分辨率下模糊原图，再放大到原图尺寸。
+     */
+    const cv::Mat& blur_background(const cv::Mat& frame);
+
+    //! 启动按 size 缩放的预取线程
+    void start_prefetch(const cv::Size& size);
+    //! 停止预取线程
+    void stop_prefetch();
+
+    Kind kind = Kind::Black;
+    bool opened = true;
+    //! 原始背景图片
+    cv::Mat source;
+    //! 当前帧使用的背景，尺寸与帧相同
+    cv::Mat current;
+    //! 虚化时的低分辨率帧
+    cv::Mat small;
+
+    //! 背景视频
+    cv::VideoCapture capture;
+    //! 预取线程缩放的目标尺寸
+    cv::Size prefetch_size;
+    //! 预取的背景帧，已缩放到 prefetch_size
+    std::unique_ptr<BoundedQueue<cv::Mat>> prefetched;
+    std::thread prefetcher;
+
+    //! 最多预取的背景帧数
+    static constexpr size_t prefetch_depth = 4;
+    //! 虚化时的缩小比例
+    static constexpr double blur_scale = 0.25;
+    //! 虚化时（低分辨率下）高斯核的标准差
+    static constexpr double blur_sigma = 4.0;
+};
+
+#endif // BACKGROUND_H
\ No newline at end of file
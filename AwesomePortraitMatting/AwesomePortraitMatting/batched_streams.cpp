@@ -0,0 +1,86 @@
+﻿#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include "batched_streams.h"
+
+
+BatchedStreams::BatchedStreams(ov::CompiledModel& compiled_model)
+    : state(compiled_model)
+{
+    // ========  Step 1: 从 img 输入获取 batch 大小与帧尺寸（NHWC） =========
+    const ov::Output<const ov::Node> img_port = compiled_model.input("img");
+    const ov::Shape img_shape = img_port.get_shape();
+    // 槽位按 CV_8UC3 切分，只支持 u8 的 BGR 输入（YUV 输入的模型不支持 batch）
+    if (img_port.get_element_type() != ov::element::u8 || img_shape.size() != 4 || img_shape.at(3) != 3)
+        throw std::invalid_argument("BatchedStreams expects a u8 NHWC img input with 3 channels.");
+    active.assign(img_shape.at(0), false);
+    frame_size = cv::Size(static_cast<int>(img_shape.at(2)), static_cast<int>(img_shape.at(1)));
+
+    // ========  Step 2: 分配 batch 输入张量，并一次性绑定到推理请求 =========
+    request = compiled_model.create_infer_request();
+    img_tensor = ov::Tensor(img_port.get_element_type(), img_shape);
+    std::memset(img_tensor.data(), 0, img_tensor.get_byte_size());
+    request.set_tensor(img_port, img_tensor);
+    alp_port = compiled_model.output("alp");
+}
+
+void BatchedStreams::Join(size_t slot)
+{
+    // 和训练时保持一致，新加入的流从全 0 隐藏状态开始
+    state.ResetSlot(slot, active.size());
+    active.at(slot) = true;
+}
+
+void BatchedStreams::Leave(size_t slot)
+{
+    active.at(slot) = false;
+}
+
+size_t BatchedStreams::ActiveCount() const
+{
+    return std::count(active.begin(), active.end(), true);
+}
+
+cv::Mat BatchedStreams::InputFrame(size_t slot)
+{
+    uint8_t* base = img_tensor.data<uint8_t>();
+    size_t slot_bytes = img_tensor.get_byte_size() / active.size();
+    return cv::Mat(frame_size, CV_8UC3, base + slot * slot_bytes);
+}
+
+bool BatchedStreams::SetInput(size_t slot, const cv::Mat& frame)
+{
+    if (frame.empty() || frame.type() != CV_8UC3) {
+        std::cerr << "[ERROR] Batch input expects a CV_8UC3 (BGR) frame, got type " << frame.type() << "." << std::endl;
+        return false;
+    }
+    cv::Mat input = this->InputFrame(slot);
+    if (frame.size() == input.size())
+        frame.copyTo(input);
+    else
+        cv::resize(frame, input, input.size());
+    return true;
+}
+
+void BatchedStreams::Infer()
+{
+    // 空闲槽位的状态随之交替但不会被使用，在下一次 Join 时清零
+    state.Bind(request);
+    request.start_async();
+    request.wait();
+    state.Advance();
+}
+
+cv::Mat BatchedStreams::Alpha(size_t slot)
+{
+    ov::Tensor alp_tensor = request.get_tensor(alp_port);
+    const ov::Shape alp_shape = alp_tensor.get_shape(); // [N, 1, H, W]
+    int rows = static_cast<int>(alp_shape.at(2)), cols = static_cast<int>(alp_shape.at(3));
+    // alp 为 f32，或由 IntegrateModel 在图内量化的 u8
+    const int type = alp_tensor.get_element_type() == ov::element::u8 ? CV_8UC1 : CV_32FC1;
+    uint8_t* base = static_cast<uint8_t*>(alp_tensor.data());
+    size_t slot_bytes = alp_tensor.get_byte_size() / active.size();
+    return cv::Mat(rows, cols, type, base + slot * slot_bytes);
+}
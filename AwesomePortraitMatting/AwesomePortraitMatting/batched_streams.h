@@ -0,0 +1,90 @@
+﻿#pragma once
+
+#ifndef BATCHED_STREAMS_H
+#define BATCHED_STREAMS_H
+
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include <openvino/openvino.hpp>
+
+#include "recurrent_state.h"
+
+/**
+ * @brief 将多路相互独立的视频流打包进一次 batch 推理。
+ * 模型以 batch N 导出（export_onnx_static.py --batch-size N），每个 batch 槽位对应一路流：
+ *  * img 输入的第 i 个切片存放第 i 路流的当前帧；
+ *  * s1i~s4i 隐藏状态的第 i 个切片只属于第 i 路流，由 RecurrentState 在两组张量之间交替传递；
+ *  * 流可以在任意帧加入（Join，槽位状态清零）或离开（Leave），空闲槽位的输出被忽略。
+ */
+class BatchedStreams
+{
+public:
+    /**
+     * @brief 在编译模型上创建一个推理请求，并分配 batch 输入与隐藏状态张量。
+     * @param compiled_model 以 batch N 编译的模型，N 取自 img 输入的第 0 维。
+     */
+    explicit BatchedStreams(ov::CompiledModel& compiled_model);
+
+    //! batch 大小，即槽位数
+    size_t BatchSize() const { return active.size(); }
+
+    //! 每个槽位输入帧的尺寸
+    cv::Size FrameSize() const { return frame_size; }
+
+    /**
+     * @brief 让一路新的流占用指定槽位，该槽位的隐藏状态被清零。
+     */
+    void Join(size_t slot);
+
+    /**
+     * @brief 释放指定槽位。
+     */
+    void Leave(size_t slot);
+
+    //! 指定槽位是否被占用
+    bool Active(size_t slot) const { return active.at(slot); }
+
+    //! 被占用的槽位数量
+    size_t ActiveCount() const;
+
+    /**
+     * @brief 获取指定槽位的输入帧。
+     * @return 直接指向 img 输入张量切片的 CV_8UC3 图像头，尺寸为 FrameSize()，写入即完成输入设置。
+     */
+    cv::Mat InputFrame(size_t slot);
+
+    /**
+     * @brief 将一帧写入指定槽位的输入，尺寸与 FrameSize() 不同时缩放。
+     * @param frame BGR 帧，必须为 CV_8UC3，否则按错误的字节布局写入槽位。
+     * @return 帧为空或类型不是 CV_8UC3 时输出错误信息并返回 false，槽位的输入不变。
+     */
+    bool SetInput(size_t slot, const cv::Mat& frame);
+
+    /**
+     * @brief 对所有槽位执行一次推理，输出的隐藏状态成为下一帧的输入。
+     */
+    void Infer();
+
+    /**
+     * @brief 获取指定槽位最近一次推理的 alpha。
+     * @return 直接指向 alp 输出张量切片的 CV_32FC1（图内量化的模型为 CV_8UC1）图像头，下一次 Infer 之前有效。
+     */
+    cv::Mat Alpha(size_t slot);
+
+protected:
+    BatchedStreams(const BatchedStreams&) = delete;
+    BatchedStreams& operator=(const BatchedStreams&) = delete;
+
+private:
+    ov::InferRequest request;
+    ov::Tensor img_tensor;
+    ov::Output<const ov::Node> alp_port;
+    //! batch 隐藏状态，每个槽位占第 0 维的一个切片
+    RecurrentState state;
+    std::vector<bool> active;
+    cv::Size frame_size;
+};
+
+#endif // BATCHED_STREAMS_H
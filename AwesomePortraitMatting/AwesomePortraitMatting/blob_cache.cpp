@@ -0,0 +1,142 @@
+﻿#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "blob_cache.h"
+
+namespace {
+    //! 缓存文件头的标记，其后为完整的缓存键
+    const char* const blob_magic = "APM_BLOB ";
+
+    //! 64 位 FNV-1a 哈希
+    struct Fnv1a
+    {
+        uint64_t value = 14695981039346656037ull;
+
+        void Update(const char* data, size_t size)
+        {
+            for (size_t i = 0; i < size; ++i) {
+                value ^= static_cast<unsigned char>(data[i]);
+                value *= 1099511628211ull;
+            }
+        }
+
+        std::string Hex() const
+        {
+            std::ostringstream out;
+            out << std::hex << std::setw(16) << std::setfill('0') << value;
+            return out.str();
+        }
+    };
+
+    /**
+     * @brief 将文件内容加入哈希，文件不存在时只加入其路径。
+     */
+    void hash_file(Fnv1a& hash, const std::filesystem::path& path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            const std::string name = path.generic_string();
+            hash.Update(name.data(), name.size());
+            return;
+        }
+        std::vector<char> buffer(1 << 20);
+        while (in) {
+            in.read(buffer.data(), buffer.size());
+            hash.Update(buffer.data(), static_cast<size_t>(in.gcount()));
+        }
+    }
+}
+
+BlobCache::BlobCache(ov::Core& core, const std::string& blob_dir, const std::filesystem::path& model_path)
+    : core(core), dir(blob_dir), model_name(std::filesystem::absolute(model_path).generic_string())
+{
+    // 权重在 .bin 中，只改权重的模型 .xml 相同
+    Fnv1a hash;
+    hash_file(hash, model_path);
+    std::filesystem::path weights_path = model_path;
+    hash_file(hash, weights_path.replace_extension(".bin"));
+    model_digest = hash.Hex();
+}
+
+ov::CompiledModel BlobCache::Load(const std::shared_ptr<ov::Model>& model,
+    const std::string& device,
+    const ov::AnyMap& config,
+    const std::string& variant)
+{
+    // ========  Step 1: 由模型、设备、编译参数、尺寸与 OpenVINO 版本生成缓存键；文件名只取其中稳定的部分 =========
+    const std::string target = this->resolve_device(device);
+    std::ostringstream key_stream;
+    key_stream << "model=" << model_digest << ";device=" << target << ";variant=" << variant
+        << ";openvino=" << ov::get_openvino_version().buildNumber << ";config=";
+    for (const auto& item : config) {
+        key_stream << item.first << ':' << item.second.as<std::string>() << ',';
+    }
+    const std::string key = key_stream.str();
+    // 模型或 OpenVINO 更新后仍是同一个文件，过期的缓存被覆盖而不是留在目录中
+    const std::string name = model_name + ";" + target + ";" + variant;
+    Fnv1a name_hash;
+    name_hash.Update(name.data(), name.size());
+    const std::filesystem::path blob_path = std::filesystem::path(dir) / ("apm_" + name_hash.Hex() + ".blob");
+
+    // ========  Step 2: 读取缓存，文件头的缓存键必须完全一致 =========
+    std::ifstream in(blob_path, std::ios::binary);
+    if (in) {
+        std::string header;
+        std::getline(in, header);
+        if (header == blob_magic + key) {
+            try {
+                return core.import_model(in, target, config);
+            }
+            catch (const std::exception& ex) {
+                std::cerr << std::endl << "[WARNING] Can not import compiled model from: " << blob_path.generic_string()
+                    << ": " << ex.what() << std::endl << "[WARNING] Recompiling...";
+            }
+        }
+        else {
+            std::cerr << std::endl << "[WARNING] Stale compiled model: " << blob_path.generic_string()
+                << ", recompiling...";
+        }
+    }
+    in.close();
+
+    // ========  Step 3: 编译并导出，先写入临时文件，完整写入后再替换 =========
+    ov::CompiledModel compiled_model = core.compile_model(model, target, config);
+    const std::filesystem::path temp_path = blob_path.generic_string() + ".tmp";
+    try {
+        std::filesystem::create_directories(dir);
+        {
+            std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+            out << blob_magic << key << '\n';
+            compiled_model.export_model(out);
+            if (!out) throw std::runtime_error("write failed");
+        }
+        std::filesystem::rename(temp_path, blob_path);
+    }
+    catch (const std::exception& ex) {
+        std::cerr << std::endl << "[WARNING] Can not export compiled model to: " << blob_path.generic_string()
+            << ": " << ex.what() << std::endl;
+        std::error_code ec;
+        std::filesystem::remove(temp_path, ec);
+    }
+    return compiled_model;
+}
+
+std::string BlobCache::resolve_device(const std::string& device) const
+{
+    if (device.compare(0, 4, "AUTO") != 0) return device;
+    const std::vector<std::string> available = core.get_available_devices();
+    // 可用设备可能带有序号，例如 GPU.0
+    std::istringstream candidates(device.size() > 5 ? device.substr(5) : "GPU,CPU");
+    std::string candidate;
+    while (std::getline(candidates, candidate, ',')) {
+        for (const auto& name : available) {
+            if (name == candidate || name.compare(0, candidate.size() + 1, candidate + ".") == 0)
+                return candidate;
+        }
+    }
+    return "CPU";
+}
\ No newline at end of file
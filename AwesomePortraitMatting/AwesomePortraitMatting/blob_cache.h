@@ -0,0 +1,68 @@
+﻿#pragma once
+
+#ifndef BLOB_CACHE_H
+#define BLOB_CACHE_H
+
+#include <filesystem>
+#include <memory>
+#include <string>
+
+#include <openvino/openvino.hpp>
+
+/**
+ * @brief 编译模型的导出缓存。
+ * ov::cache_dir 只缓存设备内核，启动时仍然要读取模型并完整编译一遍。BlobCache 将编译结果以
+ * CompiledModel::export_model 保存为文件，之后的启动以 Core::import_model 直接读取，不再编译。
+ *  * 缓存键由 模型文件（.xml 与 .bin）的哈希、设备、编译参数、输入尺寸与下采样比例、OpenVINO 版本 组成；
+ *  * 文件名只由其中稳定的部分（模型路径、设备、variant）的哈希决定，每个模型的每种 reshape 在每个设备上
+ *    只有一个文件。模型、编译参数或 OpenVINO 更新后文件名不变，旧的缓存被新的编译结果覆盖，不会在目录中堆积；
+ *  * 文件头保存完整的缓存键，读取时逐字比较，不一致（过期）时不读取，重新编译并覆盖；读取失败（文件损坏、
+ *    插件不兼容）时同样重新编译并覆盖；
+ *  * AUTO 设备的编译模型不能导出，按其优先级列表选择第一个可用的设备编译。
+ */
+class BlobCache
+{
+public:
+    /**
+     * @param core 用于编译与读取的 OpenVINO Runtime Core，生命周期需长于缓存。
+     * @param blob_dir 缓存目录，不存在时在第一次导出时创建。
+     * @param model_path IR 模型（.xml）的路径，与同名的 .bin 一起计算哈希。
+     */
+    BlobCache(ov::Core& core, const std::string& blob_dir, const std::filesystem::path& model_path);
+
+    /**
+     * @brief 读取缓存的编译模型，没有可用的缓存时编译并导出。
+     * @param model 需要编译的模型（已 reshape）。
+     * @param device 编译的目标设备，AUTO 按优先级列表选择第一个可用的设备。
+     * @param config 编译参数。
+     * @param variant 同一模型文件不同 reshape 的描述，例如 "1920x1080@0.4"。
+     *
+     * @note 导出失败时输出警告，仍然返回编译模型。
+     */
+    ov::CompiledModel Load(const std::shared_ptr<ov::Model>& model,
+        const std::string& device,
+        const ov::AnyMap& config,
+        const std::string& variant);
+
+    //! 缓存目录
+    const std::string& Dir() const { return dir; }
+
+protected:
+    BlobCache(const BlobCache&) = delete;
+    BlobCache& operator=(const BlobCache&) = delete;
+
+private:
+    /**
+     * @brief AUTO 设备替换为优先级列表中第一个可用的设备，其他设备原样返回。
+     */
+    std::string resolve_device(const std::string& device) const;
+
+    ov::Core& core;
+    std::string dir;
+    //! 模型文件的绝对路径，决定缓存的文件名
+    std::string model_name;
+    //! 模型文件的哈希（十六进制）
+    std::string model_digest;
+};
+
+#endif // BLOB_CACHE_H
\ No newline at end of file
@@ -0,0 +1,92 @@
+﻿#pragma once
+
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief 有界阻塞队列，用于连接流水线中相邻的两个阶段。
+ * 队列满时 push 阻塞，队列空时 pop 阻塞；close 之后所有等待者都会被唤醒：
+ *  * push 直接返回 false，元素被丢弃；
+ *  * pop 先取完剩余元素，取空后返回 false。
+ * 元素保存在构造时分配的环形缓冲区中，push/pop 不分配内存；取出后留在槽位中的是被移走的元素。
+ */
+template <typename T>
+class BoundedQueue
+{
+public:
+    /**
+     * @param capacity 队列容量，即两个阶段之间最多缓存的元素个数。
+     */
+    explicit BoundedQueue(std::size_t capacity) : capacity(capacity == 0 ? 1 : capacity), items(this->capacity) {}
+
+    /**
+     * @brief 放入一个元素，队列满时阻塞。
+     * @return 队列已关闭时返回 false。
+     */
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this] { return closed || count < capacity; });
+        if (closed) return false;
+        items[(head + count) % capacity] = std::move(item);
+        ++count;
+        not_empty.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief 取出一个元素，队列空时阻塞。
+     * @return 队列已关闭并且已经取空时返回 false。
+     */
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this] { return closed || count > 0; });
+        if (count == 0) return false;
+        item = std::move(items[head]);
+        head = (head + 1) % capacity;
+        --count;
+        not_full.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief 关闭队列，唤醒所有阻塞在 push/pop 上的线程。
+     */
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+
+    //! 当前缓存的元素个数
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return count;
+    }
+
+protected:
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+private:
+    const std::size_t capacity;
+    bool closed = false;
+    std::vector<T> items;
+    //! 队首的槽位与当前的元素个数
+    std::size_t head = 0, count = 0;
+    mutable std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+};
+
+#endif // BOUNDED_QUEUE_H
@@ -0,0 +1,62 @@
+﻿#include <algorithm>
+
+#include "change_gate.h"
+#include "matting_kernels.h"
+
+ChangeGate::ChangeGate(double threshold, int max_skip)
+    : threshold(std::max(0.0, threshold)), max_skip(std::max(1, max_skip))
+{
+}
+
+bool ChangeGate::Unchanged(const cv::Mat& frame)
+{
+    if (!this->Enabled()) return false;
+
+    // ========  Step 1: 缩略图与参考帧逐分块比较，达到最大跳过帧数时不再比较，强制刷新 =========
+    this->to_thumbnail(frame, thumbnail);
+    const bool comparable = !reference.empty() && reference.size() == thumbnail.size();
+    forced = comparable && since_reference >= max_skip;
+    if (comparable && !forced && this->max_block_diff() <= threshold) {
+        ++since_reference;
+        ++skipped;
+        return true;
+    }
+
+    // ========  Step 2: 画面变化，当前帧成为新的参考帧 =========
+    std::swap(reference, thumbnail);
+    since_reference = 0;
+    ++processed;
+    return false;
+}
+
+void ChangeGate::Reset()
+{
+    reference.release();
+    since_reference = 0;
+    forced = false;
+}
+
+double ChangeGate::SkipRatio() const
+{
+    const int total = processed + skipped;
+    return total > 0 ? static_cast<double>(skipped) / total : 0.0;
+}
+
+void ChangeGate::to_thumbnail(const cv::Mat& frame, cv::Mat& thumbnail) const
+{
+    const int width = std::min(thumbnail_width, frame.cols);
+    const int height = std::max(1, frame.rows * width / frame.cols);
+    cv::resize(frame, thumbnail, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+}
+
+double ChangeGate::max_block_diff() const
+{
+    double max_diff = 0;
+    for (int y = 0; y < reference.rows; y += block_size) {
+        for (int x = 0; x < reference.cols; x += block_size) {
+            const cv::Rect block(x, y, std::min(block_size, reference.cols - x), std::min(block_size, reference.rows - y));
+            max_diff = std::max(max_diff, matting::MeanAbsDiff(reference(block), thumbnail(block)));
+        }
+    }
+    return max_diff;
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+﻿#pragma once
+
+#ifndef CHANGE_GATE_H
+#define CHANGE_GATE_H
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * @brief 静止画面检测：画面与上一次生成 alpha 的帧几乎相同时跳过推理，直接复用上一帧的 alpha。
+ * 视频会议、摄像头以及长时间的固定机位录像中，大部分帧与前一帧几乎相同，但每帧仍要完整推理一次。
+ *  * 帧缩小到约 160 像素宽的缩略图（INTER_AREA，同时压低传感器噪声），与参考帧的缩略图比较；
+ *  * 缩略图按 32x32 分块，任一分块的平均绝对差（matting::MeanAbsDiff，SIMD 的 SAD 内核）超过阈值即视为变化，
+ *    局部的小幅运动（手势、转头）不会被整帧的平均值淹没；
+ *  * 参考帧是上一次生成 alpha 的帧，而不是上一帧，缓慢的变化会逐渐累积并最终触发推理；
+ *  * 连续跳过的帧数达到上限时强制刷新一次（ForcedRefresh），调用方绕过关键帧传播与 ROI 直接整帧推理，
+ *    使隐藏状态继续收敛。
+ * 跳过的帧不经过网络，隐藏状态保持不变。
+ */
+class ChangeGate
+{
+public:
+    /**
+     * @param threshold 分块平均绝对差的阈值（0~255），不超过时视为静止；0 表示关闭。
+     * @param max_skip 连续跳过的最大帧数。
+     */
+    explicit ChangeGate(double threshold, int max_skip = 30);
+
+    //! 是否开启静止画面检测
+    bool Enabled() const { return threshold > 0; }
+
+    /**
+     * @brief 判断当前帧相对参考帧是否静止。
+     * @param frame 当前帧（CV_8UC3）。
+     * @return 静止时返回 true，调用方复用上一帧的 alpha，不推理也不改变隐藏状态；
+     *         否则当前帧成为新的参考帧，调用方需要重新生成 alpha（推理或关键帧传播）。
+     */
+    bool Unchanged(const cv::Mat& frame);
+
+    /**
+     * @brief 上一次 Unchanged 返回 false 是否因为连续跳过的帧数达到上限。
+     * 此时调用方应直接整帧推理，不经过关键帧传播或 ROI，否则隐藏状态可能一直得不到刷新。
+     */
+    bool ForcedRefresh() const { return forced; }
+
+    /**
+     * @brief 丢弃参考帧，下一帧必须重新生成 alpha。
+     */
+    void Reset();
+
+    //! 重新生成 alpha 的帧数
+    int ProcessedCount() const { return processed; }
+    //! 跳过（复用 alpha）的帧数
+    int SkippedCount() const { return skipped; }
+    //! 跳过的帧数占总帧数的比例
+    double SkipRatio() const;
+
+protected:
+    ChangeGate(const ChangeGate&) = delete;
+    ChangeGate& operator=(const ChangeGate&) = delete;
+
+private:
+    /**
+     * @brief 将帧缩小到缩略图的分辨率。
+     */
+    void to_thumbnail(const cv::Mat& frame, cv::Mat& thumbnail) const;
+
+    /**
+     * @brief 缩略图与参考帧缩略图逐分块的平均绝对差中的最大值。
+     */
+    double max_block_diff() const;
+
+    double threshold;
+    int max_skip;
+
+    //! 参考帧（上一次生成 alpha 的帧）的缩略图
+    cv::Mat reference;
+    //! 当前帧的缩略图，不静止时与 reference 交换
+    cv::Mat thumbnail;
+    //! 自参考帧以来连续跳过的帧数
+    int since_reference = 0;
+    //! 上一次 Unchanged 是否为强制刷新
+    bool forced = false;
+
+    int processed = 0;
+    int skipped = 0;
+
+    //! 缩略图的宽度
+    static constexpr int thumbnail_width = 160;
+    //! 分块的边长（缩略图像素）
+    static constexpr int block_size = 32;
+};
+
+#endif // CHANGE_GATE_H
\ No newline at end of file
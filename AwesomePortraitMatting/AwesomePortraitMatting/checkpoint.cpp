@@ -0,0 +1,98 @@
+﻿#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "checkpoint.h"
+
+namespace {
+    //! 断点文件的标记与格式版本
+    const char checkpoint_magic[8] = { 'A', 'P', 'M', 'C', 'K', 'P', 'T', '1' };
+
+    //! 单个状态的维数与元素数的上限，超过时认为文件已损坏，避免按错误的长度分配内存
+    constexpr uint64_t max_rank = 8;
+    constexpr uint64_t max_elements = uint64_t(1) << 30;
+
+    template <typename T>
+    void write_value(std::ostream& out, T value)
+    {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    bool read_value(std::istream& in, T& value)
+    {
+        return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+    }
+}
+
+bool Checkpoint::Write(const std::string& path) const
+{
+    const std::string temp_path = path + ".tmp";
+    try {
+        {
+            std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+            out.write(checkpoint_magic, sizeof(checkpoint_magic));
+            write_value<uint64_t>(out, video_path.size());
+            out.write(video_path.data(), video_path.size());
+            write_value<int32_t>(out, frame_size.width);
+            write_value<int32_t>(out, frame_size.height);
+            write_value<int64_t>(out, next_frame);
+            write_value<int32_t>(out, chunks);
+            write_value<uint64_t>(out, state.shapes.size());
+            for (size_t i = 0; i < state.shapes.size(); ++i) {
+                write_value<uint64_t>(out, state.shapes[i].size());
+                for (size_t dim : state.shapes[i]) write_value<uint64_t>(out, dim);
+                write_value<uint64_t>(out, state.data[i].size());
+                out.write(reinterpret_cast<const char*>(state.data[i].data()), state.data[i].size() * sizeof(float));
+            }
+            if (!out) throw std::runtime_error("write failed");
+        }
+        std::filesystem::rename(temp_path, path);
+    }
+    catch (const std::exception& ex) {
+        std::cerr << std::endl << "[WARNING] Can not save checkpoint to: " << path << ": " << ex.what() << std::endl;
+        std::error_code ec;
+        std::filesystem::remove(temp_path, ec);
+        return false;
+    }
+    return true;
+}
+
+bool Checkpoint::Read(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    char magic[sizeof(checkpoint_magic)];
+    if (!in.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), checkpoint_magic)) return false;
+
+    uint64_t length = 0;
+    if (!read_value(in, length) || length > 4096) return false;
+    video_path.assign(static_cast<size_t>(length), '\0');
+    if (!in.read(&video_path[0], length)) return false;
+    int32_t width = 0, height = 0, chunk_count = 0;
+    if (!read_value(in, width) || !read_value(in, height) || !read_value(in, next_frame) || !read_value(in, chunk_count))
+        return false;
+    frame_size = cv::Size(width, height);
+    chunks = chunk_count;
+
+    uint64_t count = 0;
+    if (!read_value(in, count) || count > 64) return false;
+    state.shapes.assign(static_cast<size_t>(count), ov::Shape());
+    state.data.assign(static_cast<size_t>(count), std::vector<float>());
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t rank = 0, elements = 0;
+        if (!read_value(in, rank) || rank > max_rank) return false;
+        for (uint64_t d = 0; d < rank; ++d) {
+            uint64_t dim = 0;
+            if (!read_value(in, dim)) return false;
+            state.shapes[i].push_back(static_cast<size_t>(dim));
+        }
+        if (!read_value(in, elements) || elements > max_elements || elements != ov::shape_size(state.shapes[i]))
+            return false;
+        state.data[i].resize(static_cast<size_t>(elements));
+        if (!in.read(reinterpret_cast<char*>(state.data[i].data()), elements * sizeof(float))) return false;
+    }
+    return true;
+}
\ No newline at end of file
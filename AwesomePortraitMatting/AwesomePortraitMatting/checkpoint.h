@@ -0,0 +1,58 @@
+﻿#pragma once
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <string>
+
+#include <opencv2/opencv.hpp>
+
+#include "recurrent_state.h"
+
+/**
+ * @brief 长视频抠图的断点，用于中断后从最近的断点继续处理。
+ * 循环网络的隐藏状态携带了之前所有帧的信息，只从中断的帧开始推理会丢失时间一致性；
+ * 断点保存下一帧的帧序号、已完成的输出分块数，以及该帧之前的隐藏状态（s1o~s4o）。
+ * 文件为紧凑的二进制格式（小端）：
+ *  * 标记 "APMCKPT" 与格式版本；
+ *  * 输入视频的路径与帧尺寸，恢复时用于确认是同一个输入；
+ *  * 下一帧的帧序号、已完成的输出分块数；
+ *  * 隐藏状态的个数，每个状态的形状与 f32 数据。
+ * 写入时先写临时文件再替换，进程在写入中途退出时保留上一个断点。
+ */
+struct Checkpoint
+{
+    //! 输入视频的路径
+    std::string video_path;
+    //! 输入视频的帧尺寸
+    cv::Size frame_size;
+    //! 下一个需要处理的帧序号，之前的帧都已写入输出
+    int64_t next_frame = 0;
+    //! 已完成的输出分块数
+    int chunks = 0;
+    //! 处理 next_frame 之前的隐藏状态
+    RecurrentState::Snapshot state;
+
+    /**
+     * @brief 将断点写入文件。
+     * @return 写入失败时输出警告并返回 false，原有的断点保持不变。
+     */
+    bool Write(const std::string& path) const;
+
+    /**
+     * @brief 从文件读取断点。
+     * @return 文件不存在、格式或版本不符、内容不完整时返回 false，此时断点的内容不确定。
+     */
+    bool Read(const std::string& path);
+
+    /**
+     * @brief 断点是否属于该输入：路径与帧尺寸都一致。
+     */
+    bool Matches(const std::string& path, const cv::Size& size) const
+    {
+        return video_path == path && frame_size == size;
+    }
+};
+
+#endif // CHECKPOINT_H
\ No newline at end of file
@@ -0,0 +1,113 @@
+﻿#include <algorithm>
+#include <atomic>
+
+#include "frame_pool.h"
+
+namespace {
+    /**
+     * @brief 原子地读取缓冲区的引用计数。其他线程以 CV_XADD 增减引用计数，直接读取该字段是数据竞争，
+     *        可能读到过期的值，把另一个线程仍在读取的缓冲区当作空闲；CV_XADD 加 0 同时带有完整的内存屏障。
+     */
+    int ref_count(const cv::Mat& mat)
+    {
+        return CV_XADD(&mat.u->refcount, 0);
+    }
+}
+
+FramePool::FramePool(const ov::element::Type& element, const ov::Shape& shape, int channels)
+    : element(element), shape(shape)
+{
+    const size_t column_dim = channels > 0 ? 2 : 1;
+    channels = std::max(channels, 1);
+    cols = shape.size() < column_dim ? 1 : static_cast<int>(shape[shape.size() - column_dim]);
+    rows = cols > 0 ? static_cast<int>(ov::shape_size(shape) / (static_cast<size_t>(cols) * channels)) : 0;
+    type = CV_MAKETYPE(element == ov::element::u8 ? CV_8U : CV_32F, channels);
+}
+
+cv::Mat FramePool::Acquire(ov::Tensor* tensor)
+{
+    // ========  Step 1: 从上一次的位置开始查找只被池持有的缓冲区 =========
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        Buffer& buffer = buffers[(next + i) % buffers.size()];
+        if (buffer.mat.u != nullptr && ref_count(buffer.mat) == 1) {
+            next = (next + i + 1) % buffers.size();
+            if (tensor != nullptr) *tensor = buffer.tensor;
+            return buffer.mat;
+        }
+    }
+    // ========  Step 2: 全部被占用时分配新的缓冲区 =========
+    Buffer buffer;
+    buffer.mat.create(rows, cols, type);
+    buffer.tensor = ov::Tensor(element, shape, buffer.mat.data);
+    buffers.push_back(buffer);
+    next = 0;
+    if (tensor != nullptr) *tensor = buffer.tensor;
+    return buffer.mat;
+}
+
+void DetachShared(cv::Mat& mat)
+{
+    if (mat.u != nullptr ? ref_count(mat) > 1 : mat.data != nullptr) mat.release();
+}
+
+#ifdef _DEBUG
+namespace {
+    std::atomic<uint64_t> allocation_count(0);
+
+    /**
+     * @brief 只计数、分配交给标准分配器的 cv::Mat 分配器。
+     * 标准分配器创建的 UMatData 记录的是标准分配器自身，释放时直接交给它。
+     */
+    class CountingAllocator : public cv::MatAllocator
+    {
+    public:
+        cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+            cv::AccessFlag flags, cv::UMatUsageFlags usage_flags) const override
+        {
+            // data 不为空时是指向外部内存的图像头，不分配缓冲区
+            if (data == nullptr) allocation_count.fetch_add(1, std::memory_order_relaxed);
+            return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usage_flags);
+        }
+
+        bool allocate(cv::UMatData* data, cv::AccessFlag flags, cv::UMatUsageFlags usage_flags) const override
+        {
+            return cv::Mat::getStdAllocator()->allocate(data, flags, usage_flags);
+        }
+
+        void deallocate(cv::UMatData* data) const override
+        {
+            cv::Mat::getStdAllocator()->deallocate(data);
+        }
+    };
+}
+
+void AllocationCounter::Install()
+{
+    static CountingAllocator allocator;
+    cv::Mat::setDefaultAllocator(&allocator);
+}
+
+uint64_t AllocationCounter::Count()
+{
+    return allocation_count.load(std::memory_order_relaxed);
+}
+
+bool AllocationCounter::Enabled()
+{
+    return true;
+}
+#else
+void AllocationCounter::Install()
+{
+}
+
+uint64_t AllocationCounter::Count()
+{
+    return 0;
+}
+
+bool AllocationCounter::Enabled()
+{
+    return false;
+}
+#endif
\ No newline at end of file
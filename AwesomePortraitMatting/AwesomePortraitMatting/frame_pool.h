@@ -0,0 +1,90 @@
+﻿#pragma once
+
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include <openvino/openvino.hpp>
+
+/**
+ * @brief 回收复用的帧缓冲池，用于推理输入、输出等逐帧分配、又可能被之后的帧共享的缓冲区。
+ * 缓冲区以 cv::Mat 分配（cv::fastMalloc，64 字节对齐），同时创建指向同一块内存的 ov::Tensor，
+ * 可以直接绑定为推理请求的输出；两者都只在缓冲区第一次分配时创建。
+ *  * 池持有每个缓冲区的一份 cv::Mat，Acquire 只返回引用计数为 1（只被池持有）的缓冲区；
+ *  * 调用方以返回的 cv::Mat 表示占用，它和它的所有拷贝释放后缓冲区自动回到空闲状态，不需要显式归还；
+ *  * 没有空闲缓冲区时分配新的缓冲区，池的大小在流水线填满后稳定，之后 Acquire 不再分配内存。
+ */
+class FramePool
+{
+public:
+    /**
+     * @param element 张量的元素类型，u8 或 f32。
+     * @param shape 张量的形状。
+     * @param channels cv::Mat 的通道数。为 0 时按单通道，最后一维作为列数，其余各维之积作为行数；
+     *        大于 0 时最后一维是通道（NHWC 图像，包括单平面 YUV 的 C = 1），倒数第二维作为列数。
+     */
+    FramePool(const ov::element::Type& element, const ov::Shape& shape, int channels = 0);
+
+    /**
+     * @brief 获取一个空闲的缓冲区，没有时分配新的缓冲区。
+     * @param tensor [可选] 输出指向该缓冲区的张量。
+     * @return 缓冲区，持有期间不会再被 Acquire 返回。
+     *
+     * @note 非线程安全，需在同一个线程中调用；返回的 cv::Mat 可以在任意线程中释放。
+     */
+    cv::Mat Acquire(ov::Tensor* tensor = nullptr);
+
+    //! 已分配的缓冲区个数
+    size_t Size() const { return buffers.size(); }
+
+    //! 张量的形状
+    const ov::Shape& Shape() const { return shape; }
+
+protected:
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+private:
+    struct Buffer
+    {
+        cv::Mat mat;
+        ov::Tensor tensor;
+    };
+
+    ov::element::Type element;
+    ov::Shape shape;
+    int rows = 0, cols = 0, type = 0;
+    std::vector<Buffer> buffers;
+    //! 下一次开始查找的位置，按分配顺序轮转
+    size_t next = 0;
+};
+
+/**
+ * @brief 在 mat 的缓冲区被其他 cv::Mat 共享（或 mat 只是指向外部内存的图像头）时断开，之后的 create
+ *        分配新的缓冲区而不会写入别人的数据；只被 mat 持有时保留缓冲区，尺寸与类型一致时直接复用。
+ */
+void DetachShared(cv::Mat& mat);
+
+/**
+ * @brief Debug 构建中统计 cv::Mat 数据缓冲区的分配次数，用于确认稳态的逐帧路径不再分配帧缓冲。
+ * Install 将 OpenCV 的默认分配器替换为计数的分配器，分配仍然交给标准分配器完成。
+ * FramePool 的缓冲区同样由 cv::Mat 分配，一并计入；元数据等小对象的分配不计入。
+ * Release 构建中 Install 不做任何事，Count 总是返回 0。
+ */
+class AllocationCounter
+{
+public:
+    //! 安装计数的分配器，可重复调用
+    static void Install();
+
+    //! 安装以来 cv::Mat 数据缓冲区的分配次数
+    static uint64_t Count();
+
+    //! 当前构建是否统计分配次数
+    static bool Enabled();
+};
+
+#endif // FRAME_POOL_H
\ No newline at end of file
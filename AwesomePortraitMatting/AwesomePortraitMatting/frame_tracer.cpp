@@ -0,0 +1,102 @@
+﻿#include <fstream>
+#include <iomanip>
+
+#include "frame_tracer.h"
+
+FrameTracer& FrameTracer::Instance()
+{
+    static FrameTracer tracer;
+    return tracer;
+}
+
+void FrameTracer::Start()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    rings.clear();
+    origin = Clock::now();
+    ++generation;
+    enabled.store(true, std::memory_order_relaxed);
+}
+
+void FrameTracer::Stop()
+{
+    enabled.store(false, std::memory_order_relaxed);
+}
+
+FrameTracer::Ring* FrameTracer::ring()
+{
+    static thread_local Ring* local_ring = nullptr;
+    static thread_local unsigned local_generation = 0;
+    const unsigned current = generation.load(std::memory_order_acquire);
+    if (local_ring == nullptr || local_generation != current) {
+        std::lock_guard<std::mutex> lock(mutex);
+        rings.push_back(std::make_unique<Ring>());
+        local_ring = rings.back().get();
+        // 一次性预留整个环，记录时的 push_back 不会重新分配
+        local_ring->events.reserve(ring_capacity);
+        local_ring->tid = static_cast<int>(rings.size());
+        local_generation = current;
+    }
+    return local_ring;
+}
+
+void FrameTracer::Record(const char* name, int frame, Clock::time_point begin, Clock::time_point end)
+{
+    Ring* r = ring();
+    Event event = { name, frame,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(begin - origin).count(),
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count() };
+    // 写满之前追加到预留的容量中，之后覆盖最旧的区间
+    if (r->events.size() < ring_capacity) {
+        r->events.push_back(event);
+    }
+    else {
+        r->events[r->next] = event;
+        ++r->dropped;
+    }
+    r->next = (r->next + 1) % ring_capacity;
+}
+
+void FrameTracer::NameThread(const char* name)
+{
+    if (!Enabled()) return;
+    ring()->name = name;
+}
+
+size_t FrameTracer::DroppedCount()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t dropped = 0;
+    for (const auto& r : rings) dropped += r->dropped;
+    return dropped;
+}
+
+bool FrameTracer::Write(const std::string& path)
+{
+    std::ofstream out(path);
+    if (!out.is_open()) return false;
+    std::lock_guard<std::mutex> lock(mutex);
+    // ts 与 dur 的单位为 us
+    out << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (const auto& r : rings) {
+        if (!r->name.empty()) {
+            out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << r->tid
+                << ",\"args\":{\"name\":\"" << r->name << "\"}}";
+            first = false;
+        }
+        // 缓冲区写满后 next 指向最旧的区间
+        const size_t count = r->events.size();
+        const size_t oldest = count < ring_capacity ? 0 : r->next;
+        for (size_t i = 0; i < count; ++i) {
+            const Event& event = r->events[(oldest + i) % count];
+            out << (first ? "\n" : ",\n") << "{\"name\":\"" << event.name << "\",\"cat\":\"apm\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                << r->tid << ",\"ts\":" << event.begin / 1000.0 << ",\"dur\":" << event.duration / 1000.0;
+            if (event.frame >= 0) out << ",\"args\":{\"frame\":" << event.frame << "}";
+            out << "}";
+            first = false;
+        }
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+}
\ No newline at end of file
@@ -0,0 +1,162 @@
+﻿#pragma once
+
+#ifndef FRAME_TRACER_H
+#define FRAME_TRACER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief 逐帧的时间线记录，输出 Chrome trace 格式（trace event JSON），可在 chrome://tracing 或 Perfetto 中查看。
+ * 累计耗时看不出流水线中的停顿、队列空泡与抖动，时间线上每一帧在各线程上的区间则一目了然。
+ *  * 每个线程第一次记录时注册一个环形缓冲区，注册时一次性预留 ring_capacity 个区间，之后只写入自己的缓冲区，记录时不加锁、不分配；
+ *  * 缓冲区写满后覆盖最旧的区间，只保留最近 ring_capacity 个；
+ *  * 关闭时每个区间只有一次 relaxed 原子读的开销。
+ * 进程内只有一个记录器，见 Instance。
+ *
+ * @note Start、Stop、Write 需在没有其他线程记录时调用（例如所有抠图接口返回之后）。
+ */
+class FrameTracer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief 计时辅助：析构时将自构造起的区间记入当前线程的缓冲区，未开启记录时不做任何事。
+     */
+    class Span
+    {
+    public:
+        /**
+         * @param name 区间名称，必须是字符串常量（只保存指针）。
+         * @param frame 帧序号，-1 表示不属于某一帧。
+         */
+        explicit Span(const char* name, int frame = -1)
+            : name(name), frame(frame), active(Instance().Enabled())
+        {
+            if (active) begin = Clock::now();
+        }
+        ~Span() { End(); }
+
+        /**
+         * @brief 结束当前区间，并紧接着开始下一个区间，用于连续的多个步骤。
+         * @param next 下一个区间的名称，必须是字符串常量。
+         */
+        void Next(const char* next)
+        {
+            if (active) {
+                Clock::time_point now = Clock::now();
+                Instance().Record(name, frame, begin, now);
+                begin = now;
+            }
+            name = next;
+        }
+
+        //! 提前结束区间，之后不再记录
+        void End()
+        {
+            if (active) Instance().Record(name, frame, begin, Clock::now());
+            active = false;
+        }
+
+    protected:
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+    private:
+        const char* name;
+        int frame;
+        bool active;
+        Clock::time_point begin;
+    };
+
+    //! 进程内唯一的记录器
+    static FrameTracer& Instance();
+
+    /**
+     * @brief 丢弃之前的记录并开始记录，时间线以此刻为 0 点。
+     */
+    void Start();
+
+    //! 停止记录，已记录的区间保留到下一次 Start
+    void Stop();
+
+    //! 是否正在记录
+    bool Enabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 记录一个区间。
+     * @param name 区间名称，必须是字符串常量。
+     * @param frame 帧序号，-1 表示不属于某一帧。
+     */
+    void Record(const char* name, int frame, Clock::time_point begin, Clock::time_point end);
+
+    /**
+     * @brief 为当前线程命名，显示在时间线的线程标题上。未开启记录时不做任何事。
+     */
+    void NameThread(const char* name);
+
+    /**
+     * @brief 以 Chrome trace 格式写入所有线程的记录。
+     * @return 无法写入时返回 false。
+     */
+    bool Write(const std::string& path);
+
+    //! 因缓冲区写满被覆盖的区间数
+    size_t DroppedCount();
+
+    //! 每个线程最多保留的区间数
+    static constexpr size_t ring_capacity = 1 << 16;
+
+protected:
+    FrameTracer() = default;
+    FrameTracer(const FrameTracer&) = delete;
+    FrameTracer& operator=(const FrameTracer&) = delete;
+
+private:
+    /**
+     * @brief 一个区间，时间相对于 Start 的时刻（ns）。
+     */
+    struct Event
+    {
+        const char* name;
+        int frame;
+        int64_t begin;
+        int64_t duration;
+    };
+
+    /**
+     * @brief 一个线程的环形缓冲区，只由所属线程写入。
+     */
+    struct Ring
+    {
+        //! 时间线上的线程 ID，按注册顺序从 1 开始
+        int tid = 0;
+        std::string name;
+        std::vector<Event> events;
+        //! 下一个写入的位置
+        size_t next = 0;
+        size_t dropped = 0;
+    };
+
+    /**
+     * @brief 当前线程的缓冲区，本次记录中第一次调用时注册。
+     */
+    Ring* ring();
+
+    std::atomic<bool> enabled{ false };
+    //! 每次 Start 加 1，线程据此判断自己的缓冲区是否属于本次记录
+    std::atomic<unsigned> generation{ 0 };
+    Clock::time_point origin;
+    //! 只在注册线程与导出时使用
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Ring>> rings;
+};
+
+#endif // FRAME_TRACER_H
\ No newline at end of file
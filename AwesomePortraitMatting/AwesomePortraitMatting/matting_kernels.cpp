@@ -0,0 +1,608 @@
+﻿#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define APM_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#include "matting_kernels.h"
+
+// MSVC 允许在任意函数中使用 AVX 内建函数；GCC/Clang 需要为单个函数开启目标指令集
+#if defined(APM_X86) && !defined(_MSC_VER)
+#define APM_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define APM_TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx2,fma")))
+#else
+#define APM_TARGET_AVX2
+#define APM_TARGET_AVX512
+#endif
+
+namespace {
+    //! 按目标列取相邻两列做水平插值：dst[x] = src[x0[x]] * (1 - fx[x]) + src[x1[x]] * fx[x]
+    using HResizeRow = void(*)(const float* src, const int* x0, const int* x1, const float* fx,
+        float* dst, int width);
+    //! 垂直插值两行、截断到 [0, 1] 并量化为 u8
+    using QuantizeRow = void(*)(const float* r0, const float* r1, float wy, uint8_t* dst, int width);
+    //! 将 BGR 像素乘以 u8 alpha（/255），合成到黑色背景
+    using CompositeRow = void(*)(const uint8_t* frame, const uint8_t* alpha, uint8_t* dst, int width);
+    //! 按 u8 alpha 混合 BGR 原图与背景：(frame * a + background * (255 - a)) / 255
+    using BlendRow = void(*)(const uint8_t* frame, const uint8_t* background, const uint8_t* alpha,
+        uint8_t* dst, int width);
+    //! 两段 u8 数据的绝对差之和
+    using SadRow = uint64_t(*)(const uint8_t* a, const uint8_t* b, int n);
+
+    struct RowKernels
+    {
+        HResizeRow hresize;
+        QuantizeRow quantize;
+        CompositeRow composite;
+        BlendRow blend;
+        SadRow sad;
+    };
+
+    // ========  标量实现 =========
+    void hresize_scalar(const float* src, const int* x0, const int* x1, const float* fx,
+        float* dst, int width)
+    {
+        for (int x = 0; x < width; ++x) {
+            float a = src[x0[x]], b = src[x1[x]];
+            dst[x] = a + (b - a) * fx[x];
+        }
+    }
+
+    void quantize_scalar(const float* r0, const float* r1, float wy, uint8_t* dst, int width)
+    {
+        for (int x = 0; x < width; ++x) {
+            float v = r0[x] + (r1[x] - r0[x]) * wy;
+            v = std::min(std::max(v, 0.0f), 1.0f);
+            dst[x] = static_cast<uint8_t>(std::lrint(v * 255.0f));
+        }
+    }
+
+    //! round(v / 255)，对 v ∈ [0, 65025] 精确
+    inline uint8_t div255(uint32_t v)
+    {
+        v += 128;
+        return static_cast<uint8_t>((v + (v >> 8)) >> 8);
+    }
+
+    //! round(p * a / 255)
+    inline uint8_t mul_div255(uint32_t p, uint32_t a)
+    {
+        return div255(p * a);
+    }
+
+    void composite_scalar(const uint8_t* frame, const uint8_t* alpha, uint8_t* dst, int width)
+    {
+        for (int x = 0; x < width; ++x) {
+            uint32_t a = alpha[x];
+            dst[3 * x + 0] = mul_div255(frame[3 * x + 0], a);
+            dst[3 * x + 1] = mul_div255(frame[3 * x + 1], a);
+            dst[3 * x + 2] = mul_div255(frame[3 * x + 2], a);
+        }
+    }
+
+    void blend_scalar(const uint8_t* frame, const uint8_t* background, const uint8_t* alpha,
+        uint8_t* dst, int width)
+    {
+        for (int x = 0; x < width; ++x) {
+            uint32_t a = alpha[x], b = 255 - a;
+            dst[3 * x + 0] = div255(frame[3 * x + 0] * a + background[3 * x + 0] * b);
+            dst[3 * x + 1] = div255(frame[3 * x + 1] * a + background[3 * x + 1] * b);
+            dst[3 * x + 2] = div255(frame[3 * x + 2] * a + background[3 * x + 2] * b);
+        }
+    }
+
+    uint64_t sad_scalar(const uint8_t* a, const uint8_t* b, int n)
+    {
+        uint64_t sum = 0;
+        for (int x = 0; x < n; ++x)
+            sum += static_cast<uint64_t>(std::abs(static_cast<int>(a[x]) - static_cast<int>(b[x])));
+        return sum;
+    }
+
+#ifdef APM_X86
+    // ========  AVX2 实现 =========
+    APM_TARGET_AVX2
+    void hresize_avx2(const float* src, const int* x0, const int* x1, const float* fx,
+        float* dst, int width)
+    {
+        int x = 0;
+        for (; x + 8 <= width; x += 8) {
+            __m256i i0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x0 + x));
+            __m256i i1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x1 + x));
+            __m256 a = _mm256_i32gather_ps(src, i0, 4);
+            __m256 b = _mm256_i32gather_ps(src, i1, 4);
+            __m256 w = _mm256_loadu_ps(fx + x);
+            _mm256_storeu_ps(dst + x, _mm256_fmadd_ps(_mm256_sub_ps(b, a), w, a));
+        }
+        hresize_scalar(src, x0 + x, x1 + x, fx + x, dst + x, width - x);
+    }
+
+    APM_TARGET_AVX2
+    inline __m256i quantize8_avx2(const float* r0, const float* r1, __m256 w)
+    {
+        const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), scale = _mm256_set1_ps(255.0f);
+        __m256 a = _mm256_loadu_ps(r0), b = _mm256_loadu_ps(r1);
+        __m256 v = _mm256_fmadd_ps(_mm256_sub_ps(b, a), w, a);
+        v = _mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(v, zero), one), scale);
+        return _mm256_cvtps_epi32(v);
+    }
+
+    APM_TARGET_AVX2
+    void quantize_avx2(const float* r0, const float* r1, float wy, uint8_t* dst, int width)
+    {
+        const __m256 w = _mm256_set1_ps(wy);
+        int x = 0;
+        for (; x + 16 <= width; x += 16) {
+            __m256i lo = quantize8_avx2(r0 + x, r1 + x, w);
+            __m256i hi = quantize8_avx2(r0 + x + 8, r1 + x + 8, w);
+            // packus 按 128 位通道交错，重新排列为 lo[0..7]、hi[0..7]
+            __m256i p16 = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+            __m128i p8 = _mm_packus_epi16(_mm256_castsi256_si128(p16), _mm256_extracti128_si256(p16, 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), p8);
+        }
+        quantize_scalar(r0 + x, r1 + x, wy, dst + x, width - x);
+    }
+
+    //! 16 个 u16（不超过 65025）除以 255（四舍五入）并压缩为 u8
+    APM_TARGET_AVX2
+    inline __m128i div255_avx2(__m256i v)
+    {
+        v = _mm256_add_epi16(v, _mm256_set1_epi16(128));
+        v = _mm256_srli_epi16(_mm256_add_epi16(v, _mm256_srli_epi16(v, 8)), 8);
+        return _mm_packus_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    }
+
+    //! 16 个 u8 与 16 个 u8 相乘并除以 255（四舍五入）
+    APM_TARGET_AVX2
+    inline __m128i mul_div255_avx2(__m128i p, __m128i a)
+    {
+        return div255_avx2(_mm256_mullo_epi16(_mm256_cvtepu8_epi16(p), _mm256_cvtepu8_epi16(a)));
+    }
+
+    //! 16 个像素分量的混合：(p * a + q * (255 - a)) / 255，和不超过 65025，u16 不会溢出
+    APM_TARGET_AVX2
+    inline __m128i blend_avx2(__m128i p, __m128i q, __m128i a)
+    {
+        __m256i a16 = _mm256_cvtepu8_epi16(a);
+        __m256i b16 = _mm256_sub_epi16(_mm256_set1_epi16(255), a16);
+        return div255_avx2(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_cvtepu8_epi16(p), a16),
+            _mm256_mullo_epi16(_mm256_cvtepu8_epi16(q), b16)));
+    }
+
+    APM_TARGET_AVX2
+    void composite_avx2(const uint8_t* frame, const uint8_t* alpha, uint8_t* dst, int width)
+    {
+        // 将 16 个 alpha 扩展为 48 字节，与 BGR 交错排列对齐
+        const __m128i expand0 = _mm_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+        const __m128i expand1 = _mm_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+        const __m128i expand2 = _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+        int x = 0;
+        for (; x + 16 <= width; x += 16) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(alpha + x));
+            const __m128i a3[3] = {
+                _mm_shuffle_epi8(a, expand0), _mm_shuffle_epi8(a, expand1), _mm_shuffle_epi8(a, expand2)
+            };
+            for (int k = 0; k < 3; ++k) {
+                __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(frame + 3 * x + 16 * k));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 3 * x + 16 * k), mul_div255_avx2(p, a3[k]));
+            }
+        }
+        composite_scalar(frame + 3 * x, alpha + x, dst + 3 * x, width - x);
+    }
+
+    APM_TARGET_AVX2
+    void blend_avx2(const uint8_t* frame, const uint8_t* background, const uint8_t* alpha,
+        uint8_t* dst, int width)
+    {
+        const __m128i expand0 = _mm_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+        const __m128i expand1 = _mm_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+        const __m128i expand2 = _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+        int x = 0;
+        for (; x + 16 <= width; x += 16) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(alpha + x));
+            const __m128i a3[3] = {
+                _mm_shuffle_epi8(a, expand0), _mm_shuffle_epi8(a, expand1), _mm_shuffle_epi8(a, expand2)
+            };
+            for (int k = 0; k < 3; ++k) {
+                __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(frame + 3 * x + 16 * k));
+                __m128i q = _mm_loadu_si128(reinterpret_cast<const __m128i*>(background + 3 * x + 16 * k));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 3 * x + 16 * k), blend_avx2(p, q, a3[k]));
+            }
+        }
+        blend_scalar(frame + 3 * x, background + 3 * x, alpha + x, dst + 3 * x, width - x);
+    }
+
+    APM_TARGET_AVX2
+    uint64_t sad_avx2(const uint8_t* a, const uint8_t* b, int n)
+    {
+        // vpsadbw 每 8 字节得到一个 64 位的部分和，不会溢出
+        __m256i acc = _mm256_setzero_si256();
+        int x = 0;
+        for (; x + 32 <= n; x += 32) {
+            __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + x));
+            __m256i q = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + x));
+            acc = _mm256_add_epi64(acc, _mm256_sad_epu8(p, q));
+        }
+        __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        sum = _mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum));
+        return static_cast<uint64_t>(_mm_cvtsi128_si64(sum)) + sad_scalar(a + x, b + x, n - x);
+    }
+
+    // ========  AVX-512 实现（F + BW） =========
+    APM_TARGET_AVX512
+    void hresize_avx512(const float* src, const int* x0, const int* x1, const float* fx,
+        float* dst, int width)
+    {
+        int x = 0;
+        for (; x + 16 <= width; x += 16) {
+            __m512i i0 = _mm512_loadu_si512(x0 + x);
+            __m512i i1 = _mm512_loadu_si512(x1 + x);
+            __m512 a = _mm512_i32gather_ps(i0, src, 4);
+            __m512 b = _mm512_i32gather_ps(i1, src, 4);
+            __m512 w = _mm512_loadu_ps(fx + x);
+            _mm512_storeu_ps(dst + x, _mm512_fmadd_ps(_mm512_sub_ps(b, a), w, a));
+        }
+        hresize_avx2(src, x0 + x, x1 + x, fx + x, dst + x, width - x);
+    }
+
+    APM_TARGET_AVX512
+    void quantize_avx512(const float* r0, const float* r1, float wy, uint8_t* dst, int width)
+    {
+        const __m512 w = _mm512_set1_ps(wy);
+        const __m512 zero = _mm512_setzero_ps(), one = _mm512_set1_ps(1.0f), scale = _mm512_set1_ps(255.0f);
+        int x = 0;
+        for (; x + 16 <= width; x += 16) {
+            __m512 a = _mm512_loadu_ps(r0 + x), b = _mm512_loadu_ps(r1 + x);
+            __m512 v = _mm512_fmadd_ps(_mm512_sub_ps(b, a), w, a);
+            v = _mm512_mul_ps(_mm512_min_ps(_mm512_max_ps(v, zero), one), scale);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm512_cvtusepi32_epi8(_mm512_cvtps_epi32(v)));
+        }
+        quantize_avx2(r0 + x, r1 + x, wy, dst + x, width - x);
+    }
+
+    //! 32 个 u16（不超过 65025）除以 255（四舍五入）并压缩为 u8
+    APM_TARGET_AVX512
+    inline __m256i div255_avx512(__m512i v)
+    {
+        v = _mm512_add_epi16(v, _mm512_set1_epi16(128));
+        v = _mm512_srli_epi16(_mm512_add_epi16(v, _mm512_srli_epi16(v, 8)), 8);
+        return _mm512_cvtepi16_epi8(v);
+    }
+
+    //! 32 个 u8 与 32 个 u8 相乘并除以 255（四舍五入）
+    APM_TARGET_AVX512
+    inline __m256i mul_div255_avx512(__m256i p, __m256i a)
+    {
+        return div255_avx512(_mm512_mullo_epi16(_mm512_cvtepu8_epi16(p), _mm512_cvtepu8_epi16(a)));
+    }
+
+    //! 32 个像素分量的混合，同 blend_avx2
+    APM_TARGET_AVX512
+    inline __m256i blend_avx512(__m256i p, __m256i q, __m256i a)
+    {
+        __m512i a16 = _mm512_cvtepu8_epi16(a);
+        __m512i b16 = _mm512_sub_epi16(_mm512_set1_epi16(255), a16);
+        return div255_avx512(_mm512_add_epi16(_mm512_mullo_epi16(_mm512_cvtepu8_epi16(p), a16),
+            _mm512_mullo_epi16(_mm512_cvtepu8_epi16(q), b16)));
+    }
+
+    APM_TARGET_AVX512
+    void composite_avx512(const uint8_t* frame, const uint8_t* alpha, uint8_t* dst, int width)
+    {
+        const __m128i expand0 = _mm_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+        const __m128i expand1 = _mm_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+        const __m128i expand2 = _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+        int x = 0;
+        for (; x + 32 <= width; x += 32) {
+            // 32 个 alpha 扩展为 96 字节，分成三个 256 位向量
+            __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(alpha + x));
+            __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(alpha + x + 16));
+            const __m256i a3[3] = {
+                _mm256_set_m128i(_mm_shuffle_epi8(lo, expand1), _mm_shuffle_epi8(lo, expand0)),
+                _mm256_set_m128i(_mm_shuffle_epi8(hi, expand0), _mm_shuffle_epi8(lo, expand2)),
+                _mm256_set_m128i(_mm_shuffle_epi8(hi, expand2), _mm_shuffle_epi8(hi, expand1))
+            };
+            for (int k = 0; k < 3; ++k) {
+                __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(frame + 3 * x + 32 * k));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 3 * x + 32 * k), mul_div255_avx512(p, a3[k]));
+            }
+        }
+        composite_avx2(frame + 3 * x, alpha + x, dst + 3 * x, width - x);
+    }
+
+    APM_TARGET_AVX512
+    void blend_avx512(const uint8_t* frame, const uint8_t* background, const uint8_t* alpha,
+        uint8_t* dst, int width)
+    {
+        const __m128i expand0 = _mm_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+        const __m128i expand1 = _mm_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+        const __m128i expand2 = _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+        int x = 0;
+        for (; x + 32 <= width; x += 32) {
+            __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(alpha + x));
+            __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(alpha + x + 16));
+            const __m256i a3[3] = {
+                _mm256_set_m128i(_mm_shuffle_epi8(lo, expand1), _mm_shuffle_epi8(lo, expand0)),
+                _mm256_set_m128i(_mm_shuffle_epi8(hi, expand0), _mm_shuffle_epi8(lo, expand2)),
+                _mm256_set_m128i(_mm_shuffle_epi8(hi, expand2), _mm_shuffle_epi8(hi, expand1))
+            };
+            for (int k = 0; k < 3; ++k) {
+                __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(frame + 3 * x + 32 * k));
+                __m256i q = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(background + 3 * x + 32 * k));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 3 * x + 32 * k), blend_avx512(p, q, a3[k]));
+            }
+        }
+        blend_avx2(frame + 3 * x, background + 3 * x, alpha + x, dst + 3 * x, width - x);
+    }
+
+    APM_TARGET_AVX512
+    uint64_t sad_avx512(const uint8_t* a, const uint8_t* b, int n)
+    {
+        __m512i acc = _mm512_setzero_si512();
+        int x = 0;
+        for (; x + 64 <= n; x += 64) {
+            __m512i p = _mm512_loadu_si512(a + x);
+            __m512i q = _mm512_loadu_si512(b + x);
+            acc = _mm512_add_epi64(acc, _mm512_sad_epu8(p, q));
+        }
+        return static_cast<uint64_t>(_mm512_reduce_add_epi64(acc)) + sad_avx2(a + x, b + x, n - x);
+    }
+#endif // APM_X86
+
+    matting::Isa detect_isa()
+    {
+#ifdef APM_X86
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) return matting::Isa::Scalar;
+        __cpuid(info, 1);
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        const bool fma = (info[2] & (1 << 12)) != 0;
+        if (!osxsave) return matting::Isa::Scalar;
+        // 操作系统需要保存 YMM（以及 ZMM）寄存器
+        const unsigned long long xcr0 = _xgetbv(0);
+        const bool ymm = (xcr0 & 0x6) == 0x6;
+        const bool zmm = (xcr0 & 0xe6) == 0xe6;
+        __cpuidex(info, 7, 0);
+        const bool avx2 = (info[1] & (1 << 5)) != 0;
+        const bool avx512f = (info[1] & (1 << 16)) != 0;
+        const bool avx512bw = (info[1] & (1 << 30)) != 0;
+        if (zmm && avx512f && avx512bw && avx2 && fma) return matting::Isa::AVX512;
+        if (ymm && avx2 && fma) return matting::Isa::AVX2;
+#else
+        __builtin_cpu_init();
+        const bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        if (avx2 && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+            return matting::Isa::AVX512;
+        if (avx2) return matting::Isa::AVX2;
+#endif
+#endif // APM_X86
+        return matting::Isa::Scalar;
+    }
+
+    RowKernels kernels_for(matting::Isa isa)
+    {
+#ifdef APM_X86
+        switch (isa) {
+        case matting::Isa::AVX512:
+            return { hresize_avx512, quantize_avx512, composite_avx512, blend_avx512, sad_avx512 };
+        case matting::Isa::AVX2:
+            return { hresize_avx2, quantize_avx2, composite_avx2, blend_avx2, sad_avx2 };
+        default: break;
+        }
+#endif
+        return { hresize_scalar, quantize_scalar, composite_scalar, blend_scalar, sad_scalar };
+    }
+
+    matting::Isa active_isa = detect_isa();
+    RowKernels active_kernels = kernels_for(active_isa);
+
+    //! 每个线程复用的行缓冲区，帧尺寸不变时不再分配内存
+    struct Scratch
+    {
+        std::vector<int> x0, x1;
+        std::vector<float> fx;
+        std::vector<float> rows[2];
+        std::vector<uint8_t> alpha;
+    };
+
+    //! cv::resize INTER_LINEAR 的采样位置：src = (dst + 0.5) * scale - 0.5，越界时取边界
+    void source_coord(int dst, double scale, int src_size, int& i0, int& i1, float& w)
+    {
+        double f = (dst + 0.5) * scale - 0.5;
+        i0 = static_cast<int>(std::floor(f));
+        w = static_cast<float>(f - i0);
+        if (i0 < 0) {
+            i0 = 0;
+            w = 0;
+        }
+        if (i0 >= src_size - 1) {
+            i0 = src_size - 1;
+            w = 0;
+        }
+        i1 = std::min(i0 + 1, src_size - 1);
+    }
+
+    /**
+     * @brief 将一行 u8 alpha 与原图合成：有背景时混合到背景上，否则合成到黑色背景。
+     */
+    inline void composite_row(const RowKernels& k, const cv::Mat& frame, const cv::Mat* background,
+        const uint8_t* alpha, cv::Mat& dst, int y)
+    {
+        if (background == nullptr)
+            k.composite(frame.ptr<uint8_t>(y), alpha, dst.ptr<uint8_t>(y), dst.cols);
+        else
+            k.blend(frame.ptr<uint8_t>(y), background->ptr<uint8_t>(y), alpha, dst.ptr<uint8_t>(y), dst.cols);
+    }
+
+    /**
+     * @brief 按行缩放 alpha 到目标尺寸，量化后写入 mask，或与 frame（及可选的背景）合成写入 dst。
+     */
+    void process(const cv::Mat& alpha, const cv::Mat* frame, const cv::Mat* background, cv::Mat& dst)
+    {
+        const RowKernels& k = active_kernels;
+        thread_local Scratch scratch;
+        const int src_w = alpha.cols, src_h = alpha.rows, dst_w = dst.cols, dst_h = dst.rows;
+
+        // ========  Step 1: 预先计算每个目标列的源列与权重 =========
+        const bool hscale = src_w != dst_w;
+        if (hscale) {
+            scratch.x0.resize(dst_w);
+            scratch.x1.resize(dst_w);
+            scratch.fx.resize(dst_w);
+            scratch.rows[0].resize(dst_w);
+            scratch.rows[1].resize(dst_w);
+            const double scale = static_cast<double>(src_w) / dst_w;
+            for (int x = 0; x < dst_w; ++x)
+                source_coord(x, scale, src_w, scratch.x0[x], scratch.x1[x], scratch.fx[x]);
+        }
+        if (frame != nullptr) scratch.alpha.resize(dst_w);
+
+        // 水平缩放后的源行按行号奇偶缓存在两个缓冲区中，相邻目标行共享源行时不重复计算
+        int cached[2] = { -1, -1 };
+        auto source_row = [&](int y) -> const float* {
+            const float* src = alpha.ptr<float>(y);
+            if (!hscale) return src;
+            std::vector<float>& row = scratch.rows[y & 1];
+            if (cached[y & 1] != y) {
+                k.hresize(src, scratch.x0.data(), scratch.x1.data(), scratch.fx.data(), row.data(), dst_w);
+                cached[y & 1] = y;
+            }
+            return row.data();
+        };
+
+        // ========  Step 2: 逐行垂直插值、量化，[可选] 合成 =========
+        const double scale = static_cast<double>(src_h) / dst_h;
+        for (int y = 0; y < dst_h; ++y) {
+            int y0, y1;
+            float wy;
+            source_coord(y, scale, src_h, y0, y1, wy);
+            const float* r0 = source_row(y0);
+            const float* r1 = wy == 0 ? r0 : source_row(y1);
+            if (frame == nullptr) {
+                k.quantize(r0, r1, wy, dst.ptr<uint8_t>(y), dst_w);
+            }
+            else {
+                k.quantize(r0, r1, wy, scratch.alpha.data(), dst_w);
+                composite_row(k, *frame, background, scratch.alpha.data(), dst, y);
+            }
+        }
+    }
+
+    /**
+     * @brief CompositeOnBlack 与 CompositeOnBackground 的实现，background 为空时合成到黑色背景。
+     */
+    void composite(const cv::Mat& alpha, const cv::Mat& frame, const cv::Mat* background, cv::Mat& dst)
+    {
+        if (frame.empty() || frame.type() != CV_8UC3)
+            throw std::invalid_argument("Composite expects a non-empty CV_8UC3 frame.");
+        // 模型已在图内缩放并量化的 u8 alpha，只需要逐行合成
+        if (alpha.type() == CV_8UC1) {
+            if (alpha.size() != frame.size())
+                throw std::invalid_argument("Composite expects a CV_8UC1 alpha of the frame size.");
+            dst.create(frame.size(), CV_8UC3);
+            for (int y = 0; y < frame.rows; ++y)
+                composite_row(active_kernels, frame, background, alpha.ptr<uint8_t>(y), dst, y);
+            return;
+        }
+        if (alpha.empty() || alpha.type() != CV_32FC1)
+            throw std::invalid_argument("Composite expects a non-empty CV_32FC1 alpha.");
+        dst.create(frame.size(), CV_8UC3);
+        process(alpha, &frame, background, dst);
+    }
+}
+
+namespace matting
+{
+    Isa SupportedIsa()
+    {
+        static const Isa supported = detect_isa();
+        return supported;
+    }
+
+    Isa ActiveIsa()
+    {
+        return active_isa;
+    }
+
+    void SetIsa(Isa isa)
+    {
+        active_isa = std::min(isa, SupportedIsa());
+        active_kernels = kernels_for(active_isa);
+    }
+
+    const char* IsaName(Isa isa)
+    {
+        switch (isa) {
+        case Isa::AVX512: return "AVX-512";
+        case Isa::AVX2: return "AVX2";
+        default: return "Scalar";
+        }
+    }
+
+    void AlphaToMask(const cv::Mat& alpha, cv::Mat& mask)
+    {
+        if (alpha.empty() || alpha.type() != CV_32FC1)
+            throw std::invalid_argument("AlphaToMask expects a non-empty CV_32FC1 alpha.");
+        mask.create(mask.empty() ? alpha.size() : mask.size(), CV_8UC1);
+        process(alpha, nullptr, nullptr, mask);
+    }
+
+    void CompositeOnBlack(const cv::Mat& alpha, const cv::Mat& frame, cv::Mat& dst)
+    {
+        composite(alpha, frame, nullptr, dst);
+    }
+
+    void CompositeOnBackground(const cv::Mat& alpha, const cv::Mat& frame, const cv::Mat& background, cv::Mat& dst)
+    {
+        if (background.type() != CV_8UC3 || background.size() != frame.size())
+            throw std::invalid_argument("CompositeOnBackground expects a CV_8UC3 background of the frame size.");
+        if (background.data == dst.data)
+            throw std::invalid_argument("CompositeOnBackground can not write to the background.");
+        composite(alpha, frame, &background, dst);
+    }
+
+    double MeanAbsDiff(const cv::Mat& a, const cv::Mat& b)
+    {
+        if (a.empty() || a.depth() != CV_8U || a.type() != b.type() || a.size() != b.size())
+            throw std::invalid_argument("MeanAbsDiff expects two non-empty u8 images of the same size and type.");
+        const int n = a.cols * a.channels();
+        uint64_t sum = 0;
+        for (int y = 0; y < a.rows; ++y)
+            sum += active_kernels.sad(a.ptr<uint8_t>(y), b.ptr<uint8_t>(y), n);
+        return static_cast<double>(sum) / (static_cast<double>(n) * a.rows);
+    }
+
+    void BgrToYuv420(const cv::Mat& bgr, cv::Mat& yuv, bool nv12)
+    {
+        if (bgr.empty() || bgr.type() != CV_8UC3 || bgr.cols % 2 != 0 || bgr.rows % 2 != 0)
+            throw std::invalid_argument("BgrToYuv420 expects a non-empty CV_8UC3 frame of even size.");
+        if (!nv12) {
+            cv::cvtColor(bgr, yuv, cv::COLOR_BGR2YUV_I420);
+            return;
+        }
+        // OpenCV 没有 BGR -> NV12 的转换：先转换为 I420，再将 U、V 平面交错写入色度平面
+        thread_local cv::Mat i420;
+        cv::cvtColor(bgr, i420, cv::COLOR_BGR2YUV_I420);
+        const int height = bgr.rows;
+        const cv::Size chroma(bgr.cols / 2, bgr.rows / 2);
+        yuv.create(height * 3 / 2, bgr.cols, CV_8UC1);
+        i420.rowRange(0, height).copyTo(yuv.rowRange(0, height));
+        const cv::Mat planes[] = {
+            cv::Mat(chroma, CV_8UC1, i420.ptr(height)),
+            cv::Mat(chroma, CV_8UC1, i420.ptr(height) + chroma.area())
+        };
+        cv::Mat uv(chroma, CV_8UC2, yuv.ptr(height), yuv.step);
+        cv::merge(planes, 2, uv);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,92 @@
+﻿#pragma once
+
+#ifndef MATTING_KERNELS_H
+#define MATTING_KERNELS_H
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * @brief 抠图后处理的融合内核。
+ * 原先的后处理链（resize -> merge 成三通道 -> 原图转 CV_32FC3 -> multiply -> 转回 CV_8UC3）需要对整帧
+ * 遍历约五次，并分配多张 1080p 的浮点图。这里的内核按行一次完成：
+ *  * 双线性缩放 alpha（与 cv::resize 的 INTER_LINEAR 采样位置一致，行缓存复用，相邻输出行不重复计算）；
+ *  * 截断到 [0, 1] 并量化为 u8；
+ *  * [可选] 与原图逐像素相乘，合成到黑色背景，或与背景图逐像素混合；
+ *  * 结果直接写入调用方提供的 u8 缓冲区。
+ * 运行时检测 CPU，选择 AVX-512、AVX2 或标量实现。合成使用 16 位定点运算，与浮点链的结果最多相差 1。
+ * 此外提供静止画面检测使用的帧差（SAD）内核，见 MeanAbsDiff；以及 YUV 输入模型的颜色转换，见 BgrToYuv420。
+ */
+namespace matting
+{
+    /**
+     * @brief 内核使用的指令集。
+     */
+    enum class Isa
+    {
+        Scalar,
+        AVX2,
+        AVX512
+    };
+
+    /**
+     * @brief 当前 CPU 与操作系统支持的最高指令集。
+     */
+    Isa SupportedIsa();
+
+    /**
+     * @brief 内核当前使用的指令集，默认为 SupportedIsa()。
+     */
+    Isa ActiveIsa();
+
+    /**
+     * @brief 指定内核使用的指令集，用于基准测试对比。超过 SupportedIsa() 时使用 SupportedIsa()。
+     *
+     * @note 非线程安全，需在没有内核运行时调用。
+     */
+    void SetIsa(Isa isa);
+
+    //! 指令集的名称
+    const char* IsaName(Isa isa);
+
+    /**
+     * @brief 将 alpha 缩放到 mask 的尺寸并量化为 u8。
+     * @param alpha CV_32FC1 的 alpha，任意尺寸。
+     * @param mask 输出，CV_8UC1；为空时按 alpha 的尺寸分配，否则保持其尺寸并直接写入。
+     */
+    void AlphaToMask(const cv::Mat& alpha, cv::Mat& mask);
+
+    /**
+     * @brief 将 alpha 缩放到原图尺寸，并把原图合成到黑色背景上。
+     * @param alpha CV_32FC1 的 alpha，任意尺寸；或与原图尺寸相同的 CV_8UC1 alpha（只合成，不缩放）。
+     * @param frame CV_8UC3 的原图。
+     * @param dst 输出，CV_8UC3，尺寸与 frame 相同；可以是 frame 自身，也可以是指向外部缓冲区的图像头。
+     */
+    void CompositeOnBlack(const cv::Mat& alpha, const cv::Mat& frame, cv::Mat& dst);
+
+    /**
+     * @brief 将 alpha 缩放到原图尺寸，并把原图合成到背景上：(frame * a + background * (255 - a)) / 255。
+     * @param alpha 同 CompositeOnBlack。
+     * @param frame CV_8UC3 的原图。
+     * @param background CV_8UC3 的背景，尺寸与 frame 相同。
+     * @param dst 输出，同 CompositeOnBlack；可以是 frame 自身，但不能是 background。
+     */
+    void CompositeOnBackground(const cv::Mat& alpha, const cv::Mat& frame, const cv::Mat& background, cv::Mat& dst);
+
+    /**
+     * @brief 两幅图像逐分量的平均绝对差：sum(|a - b|) / (像素数 * 通道数)，与 cv::norm(a, b, NORM_L1) 的均值一致。
+     * @param a u8 图像，任意通道数，可以是不连续的 ROI。
+     * @param b 与 a 尺寸、类型相同的 u8 图像。
+     */
+    double MeanAbsDiff(const cv::Mat& a, const cv::Mat& b);
+
+    /**
+     * @brief 将 BGR 帧转换为单平面 YUV 4:2:0（BT.601，与 cv::COLOR_BGR2YUV_I420 一致），
+     *        用于解码器只能输出 BGR 时喂给 YUV 输入的模型。
+     * @param bgr CV_8UC3 的帧，宽、高为偶数。
+     * @param yuv 输出，CV_8UC1，(高 * 3 / 2) x 宽；尺寸一致时直接写入（例如输入张量的内存）。
+     * @param nv12 为 true 时色度平面为 U、V 交错（NV12），否则依次为 U 平面、V 平面（I420）。
+     */
+    void BgrToYuv420(const cv::Mat& bgr, cv::Mat& yuv, bool nv12);
+}
+
+#endif // MATTING_KERNELS_H
\ No newline at end of file
@@ -0,0 +1,176 @@
+﻿#include <iostream>
+
+#include "matting_session.h"
+#include "matting_kernels.h"
+
+namespace {
+    //! 是否为单平面 YUV 4:2:0
+    bool is_yuv(FrameView::PixelFormat format)
+    {
+        return format == FrameView::PixelFormat::NV12 || format == FrameView::PixelFormat::I420;
+    }
+
+    //! 输入像素格式的通道数，YUV 按单通道的平面计
+    int channels(FrameView::PixelFormat format)
+    {
+        if (is_yuv(format)) return 1;
+        return format == FrameView::PixelFormat::BGR || format == FrameView::PixelFormat::RGB ? 3 : 4;
+    }
+
+    //! 输入像素格式是否就是模型 img 输入的颜色格式
+    bool matches_model(FrameView::PixelFormat format, ModelCache::ColorFormat color)
+    {
+        switch (color) {
+        case ModelCache::ColorFormat::NV12: return format == FrameView::PixelFormat::NV12;
+        case ModelCache::ColorFormat::I420: return format == FrameView::PixelFormat::I420;
+        default: return format == FrameView::PixelFormat::BGR;
+        }
+    }
+
+    //! 转换到 BGR 的 cv::cvtColor 代码，BGR 返回 -1
+    int to_bgr_code(FrameView::PixelFormat format)
+    {
+        switch (format) {
+        case FrameView::PixelFormat::RGB: return cv::COLOR_RGB2BGR;
+        case FrameView::PixelFormat::BGRA: return cv::COLOR_BGRA2BGR;
+        case FrameView::PixelFormat::RGBA: return cv::COLOR_RGBA2BGR;
+        case FrameView::PixelFormat::NV12: return cv::COLOR_YUV2BGR_NV12;
+        case FrameView::PixelFormat::I420: return cv::COLOR_YUV2BGR_I420;
+        default: return -1;
+        }
+    }
+}
+
+MattingSession::MattingSession(ModelCache& models, const cv::Size& frame_size)
+    : entry(models.Get(frame_size)),
+    request(entry.compiled_model.create_infer_request()),
+    state(entry.compiled_model)
+{
+    static_alpha = entry.alp_port.get_partial_shape().is_static();
+    own_alp = request.get_tensor(entry.alp_port);
+}
+
+bool MattingSession::Process(const FrameView& in, AlphaView& out)
+{
+    // ========  Step 1: 检查视图 =========
+    const int out_elem = out.format == AlphaView::PixelFormat::U8 ? 1 : 4;
+    if (in.data == nullptr || in.width <= 0 || in.height <= 0
+        || (in.stride != 0 && in.stride < static_cast<size_t>(in.width) * channels(in.format))
+        || (is_yuv(in.format) && (in.width % 2 != 0 || in.height % 2 != 0))
+        || (in.format == FrameView::PixelFormat::I420 && in.stride != 0 && in.stride != static_cast<size_t>(in.width))) {
+        std::cerr << "[ERROR] Invalid input frame view." << std::endl;
+        return false;
+    }
+    if (out.data == nullptr || out.width <= 0 || out.height <= 0
+        || (out.stride != 0 && out.stride < static_cast<size_t>(out.width) * out_elem)) {
+        std::cerr << "[ERROR] Invalid alpha view." << std::endl;
+        return false;
+    }
+
+    // ========  Step 2: 设置输入；输出为 F32 且与 alp 输出形状一致时，直接绑定调用方内存 =========
+    this->set_input(in);
+    bool alpha_bound = false;
+    if (static_alpha) {
+        const ov::Shape alp_shape = entry.alp_port.get_shape();
+        const size_t row_bytes = static_cast<size_t>(out.width) * sizeof(float);
+        alpha_bound = out.format == AlphaView::PixelFormat::F32
+            && alp_shape.at(2) == static_cast<size_t>(out.height) && alp_shape.at(3) == static_cast<size_t>(out.width)
+            && (out.stride == 0 || out.stride == row_bytes);
+        request.set_tensor(entry.alp_port, alpha_bound
+            ? ov::Tensor(ov::element::f32, alp_shape, out.data)
+            : own_alp);
+    }
+
+    // ========  Step 3: 推理，隐藏状态在两组张量之间交替 =========
+    state.Bind(request);
+    request.start_async();
+    request.wait();
+    state.Advance();
+
+    // ========  Step 4: 输出 alpha =========
+    this->write_alpha(out, alpha_bound);
+    return true;
+}
+
+void MattingSession::set_input(const FrameView& in)
+{
+    const size_t step = in.stride == 0 ? static_cast<size_t>(cv::Mat::AUTO_STEP) : in.stride;
+    // 单平面 YUV 的 Y 平面之下还有一半高度的色度平面
+    const cv::Mat frame(is_yuv(in.format) ? in.height * 3 / 2 : in.height, in.width, CV_8UC(channels(in.format)),
+        const_cast<uint8_t*>(in.data), step);
+    const cv::Size frame_size(in.width, in.height);
+    const cv::Size target = entry.size.empty() ? frame_size : entry.size;
+    const int code = to_bgr_code(in.format);
+
+    // ========  Step 1: 像素格式与模型输入一致、紧密排列、尺寸一致时直接使用调用方内存 =========
+    cv::Mat input;
+    if (matches_model(in.format, entry.color) && frame_size == target && frame.isContinuous()) {
+        input = frame;
+    }
+    // ========  Step 2: 否则转换为 BGR 写入暂存缓冲区，先缩放（像素更少）再转换颜色；YUV 的平面不能直接缩放 =========
+    else {
+        staging.create(target, CV_8UC3);
+        if (code < 0) {
+            if (frame_size == target) frame.copyTo(staging);
+            else cv::resize(frame, staging, target);
+        }
+        else if (frame_size == target) {
+            cv::cvtColor(frame, staging, code);
+        }
+        else if (is_yuv(in.format)) {
+            cv::cvtColor(frame, resized, code);
+            cv::resize(resized, staging, target);
+        }
+        else {
+            cv::resize(frame, resized, target);
+            cv::cvtColor(resized, staging, code);
+        }
+        input = staging;
+        // ========  Step 3: YUV 输入的模型再转换为模型的格式 =========
+        if (entry.color != ModelCache::ColorFormat::BGR) {
+            matting::BgrToYuv420(staging, yuv_staging, entry.color == ModelCache::ColorFormat::NV12);
+            input = yuv_staging;
+        }
+    }
+    const ov::Shape img_shape = entry.size.empty()
+        ? ov::Shape{ 1, static_cast<size_t>(input.rows), static_cast<size_t>(input.cols), 3 }
+        : entry.img_port.get_shape();
+    // 输入张量只在指向的内存或形状变化时重新创建：暂存缓冲区只分配一次，调用方复用同一块缓冲区时同样不再创建
+    if (!input_tensor || input_tensor.data() != input.data || input_tensor.get_shape() != img_shape) {
+        input_tensor = ov::Tensor(entry.img_port.get_element_type(), img_shape, input.data);
+        request.set_tensor(entry.img_port, input_tensor);
+    }
+}
+
+void MattingSession::write_alpha(AlphaView& out, bool alpha_bound)
+{
+    if (alpha_bound) return;
+    const size_t step = out.stride == 0 ? static_cast<size_t>(cv::Mat::AUTO_STEP) : out.stride;
+    const bool u8_out = out.format == AlphaView::PixelFormat::U8;
+    cv::Mat dst(out.height, out.width, u8_out ? CV_8UC1 : CV_32FC1, out.data, step);
+
+    // alp 为 [1, 1, H, W]，f32 或图内量化的 u8
+    ov::Tensor alp_tensor = request.get_tensor(entry.alp_port);
+    const ov::Shape alp_shape = alp_tensor.get_shape();
+    const bool u8_alpha = alp_tensor.get_element_type() == ov::element::u8;
+    const cv::Mat alpha(static_cast<int>(alp_shape.at(2)), static_cast<int>(alp_shape.at(3)),
+        u8_alpha ? CV_8UC1 : CV_32FC1, alp_tensor.data());
+
+    // cv::resize、convertTo 的输出尺寸与类型和 dst 一致，直接写入调用方内存，不会重新分配
+    if (u8_out && !u8_alpha) {
+        matting::AlphaToMask(alpha, dst);
+    }
+    else if (u8_out == u8_alpha) {
+        if (alpha.size() == dst.size()) alpha.copyTo(dst);
+        else cv::resize(alpha, dst, dst.size());
+    }
+    else if (alpha.size() == dst.size()) {
+        alpha.convertTo(dst, CV_32FC1, 1.0 / 255);
+    }
+    else {
+        // 先转换为浮点再缩放，插值结果不经过 u8 截断
+        cv::Mat alpha_f;
+        alpha.convertTo(alpha_f, CV_32FC1, 1.0 / 255);
+        cv::resize(alpha_f, dst, dst.size());
+    }
+}
\ No newline at end of file
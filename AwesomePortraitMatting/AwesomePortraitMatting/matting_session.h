@@ -0,0 +1,143 @@
+﻿#pragma once
+
+#ifndef MATTING_SESSION_H
+#define MATTING_SESSION_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <opencv2/opencv.hpp>
+#include <openvino/openvino.hpp>
+
+#include "model_cache.h"
+#include "recurrent_state.h"
+
+/**
+ * @brief 调用方内存中的一帧输入图像，不拥有数据。
+ */
+struct FrameView
+{
+    //! 像素格式，每个分量 8 位
+    enum class PixelFormat
+    {
+        BGR,
+        RGB,
+        BGRA,
+        RGBA,
+        //! 单平面 NV12：height 行 Y 平面之后是 height / 2 行 U、V 交错的色度平面，各行间距均为 stride
+        NV12,
+        //! 单平面 I420：height 行 Y 平面之后依次是 U 平面、V 平面，需紧密排列
+        I420
+    };
+
+    //! 图像数据；NV12、I420 为 Y 平面的起始地址，宽、高需为偶数
+    const uint8_t* data = nullptr;
+    int width = 0;
+    int height = 0;
+    //! 相邻两行起始地址的字节差，0 表示紧密排列
+    size_t stride = 0;
+    PixelFormat format = PixelFormat::BGR;
+};
+
+/**
+ * @brief 调用方内存中的 alpha 输出缓冲区，不拥有数据。尺寸可以与输入帧不同，alpha 双线性缩放到该尺寸。
+ */
+struct AlphaView
+{
+    //! 像素格式
+    enum class PixelFormat
+    {
+        //! 单通道 u8，round(alpha * 255)
+        U8,
+        //! 单通道 f32，[0, 1]
+        F32
+    };
+
+    uint8_t* data = nullptr;
+    int width = 0;
+    int height = 0;
+    //! 相邻两行起始地址的字节差，0 表示紧密排列
+    size_t stride = 0;
+    PixelFormat format = PixelFormat::U8;
+};
+
+/**
+ * @brief 逐帧处理调用方内存的抠图会话：输入一帧，输出 alpha，不经过文件或窗口。
+ * 会话由 PortraitMatting::CreateSession 创建，共享其编译模型，自身只拥有一个推理请求与一份隐藏状态，
+ * 创建代价很小；每路视频流使用一个会话，不同会话可以在不同线程上同时使用。
+ * 不做隐藏的拷贝，需要拷贝的输入见 Process 的说明：
+ *  * 输入的像素格式与模型 img 输入一致（BGR，或 YUV 输入模型的 NV12、I420）、紧密排列且尺寸与模型一致
+ *    （或模型在图内缩放）时，直接以调用方内存作为模型输入，解码器输出的 YUV 平面不需要转换为 BGR；
+ *    否则颜色转换、缩放或去除行填充写入会话持有的暂存缓冲区，该缓冲区只分配一次；
+ *  * 输出为 F32、紧密排列且尺寸与模型的 alp 输出一致时，模型直接写入调用方内存；
+ *    否则由融合内核一次完成缩放与量化，直接写入调用方内存。
+ *
+ * @note 非线程安全，同一个会话同一时刻只能在一个线程中使用。
+ * @note 调用方内存只在 Process 期间被访问。
+ */
+class MattingSession
+{
+public:
+    /**
+     * @brief 在共享的编译模型上创建会话。
+     * @param models 共享的编译模型缓存，生命周期需长于会话。
+     * @param frame_size 输入帧的尺寸，用于选择原生尺寸的模型。
+     */
+    __declspec(dllexport) MattingSession(ModelCache& models, const cv::Size& frame_size);
+
+    /**
+     * @brief 处理一帧，隐藏状态随之前进一帧。
+     * @param in 输入帧。
+     * @param out alpha 输出缓冲区。
+     * @return 视图无效（空指针、尺寸不为正、stride 小于一行，YUV 的宽、高不是偶数）时输出错误信息并返回 false，隐藏状态不变。
+     *
+     * @note 只有以下输入不经过拷贝，直接作为模型输入：像素格式与模型 img 输入一致（BGR 模型为 BGR，
+     *       YUV 输入模型为对应的 NV12 或 I420），行紧密排列（stride 为 0 或等于一行的字节数），
+     *       并且尺寸等于 ModelSize()（模型在图内缩放时任意尺寸）。其他输入都会拷贝到会话的暂存缓冲区：
+     *       RGB、BGRA、RGBA 转换颜色；与模型不一致的 BGR、NV12、I420 转换格式；尺寸不同时缩放；带行填充时去除填充。
+     *       暂存缓冲区只分配一次，但每帧都有一次整帧的拷贝。
+     * @note 输出为 F32、紧密排列且尺寸与模型的 alp 输出一致时模型直接写入 out；否则从模型的输出缩放、量化到 out。
+     */
+    __declspec(dllexport) bool Process(const FrameView& in, AlphaView& out);
+
+    /**
+     * @brief 将隐藏状态清零，即从视频的第一帧开始。切换到不相关的视频（或场景突变）时调用。
+     */
+    __declspec(dllexport) void Reset() { state.Reset(); }
+
+    //! 模型输入帧的尺寸，为空表示模型在图内缩放；输入与之一致时不需要缩放
+    __declspec(dllexport) cv::Size ModelSize() const { return entry.size; }
+
+protected:
+    MattingSession(const MattingSession&) = delete;
+    MattingSession& operator=(const MattingSession&) = delete;
+
+private:
+    /**
+     * @brief 将输入帧转换为模型输入并设置到推理请求。
+     */
+    void set_input(const FrameView& in);
+
+    /**
+     * @brief 将 alp 输出写入调用方内存，alpha_bound 为 true 时模型已直接写入。
+     */
+    void write_alpha(AlphaView& out, bool alpha_bound);
+
+    ModelCache::Entry& entry;
+    ov::InferRequest request;
+    RecurrentState state;
+    //! 推理请求原本的 alp 输出张量，输出未绑定到调用方内存时使用
+    ov::Tensor own_alp;
+    //! 模型的 alp 输出是否为静态形状，只有静态形状才能绑定到调用方内存
+    bool static_alpha = false;
+    //! 绑定到推理请求的 img 张量，指向调用方内存或暂存缓冲区；内存或形状不变时不重新创建
+    ov::Tensor input_tensor;
+    //! 输入的暂存缓冲区：BGR、模型尺寸
+    cv::Mat staging;
+    //! 非 BGR 输入先在原格式下缩放到模型尺寸，再转换颜色（YUV 输入先转换颜色再缩放）
+    cv::Mat resized;
+    //! YUV 输入的模型：staging 转换后的单平面 YUV
+    cv::Mat yuv_staging;
+};
+
+#endif // MATTING_SESSION_H
\ No newline at end of file
@@ -0,0 +1,232 @@
+﻿#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "metrics.h"
+
+namespace {
+    //! 进程的常驻内存（字节），无法获取时返回 0
+    double resident_memory_bytes()
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            return static_cast<double>(counters.WorkingSetSize);
+        return 0;
+#else
+        // /proc/self/statm 的第二列是常驻页数，页大小因系统而异（4K、16K、64K）
+        std::ifstream statm("/proc/self/statm");
+        long pages = 0, resident = 0;
+        if (!(statm >> pages >> resident)) return 0;
+        const long page_size = sysconf(_SC_PAGESIZE);
+        return page_size > 0 ? static_cast<double>(resident) * page_size : 0;
+#endif
+    }
+
+    //! 指标名称加标签，extra 为额外的标签（如直方图的 le）
+    std::string series(const std::string& name, const std::string& labels, const std::string& extra = "")
+    {
+        if (labels.empty() && extra.empty()) return name;
+        if (labels.empty()) return name + "{" + extra + "}";
+        if (extra.empty()) return name + "{" + labels + "}";
+        return name + "{" + labels + "," + extra + "}";
+    }
+}
+
+Metrics::Histogram::Histogram(const std::vector<double>& bounds)
+    : bounds(bounds), buckets(new std::atomic<uint64_t>[bounds.size() + 1])
+{
+    std::sort(this->bounds.begin(), this->bounds.end());
+    for (size_t i = 0; i <= bounds.size(); ++i) buckets[i].store(0, std::memory_order_relaxed);
+}
+
+void Metrics::Histogram::Observe(double v)
+{
+    const size_t i = std::lower_bound(bounds.begin(), bounds.end(), v) - bounds.begin();
+    buckets[i].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    // C++17 的 atomic<double> 没有 fetch_add
+    double expected = sum.load(std::memory_order_relaxed);
+    while (!sum.compare_exchange_weak(expected, expected + v, std::memory_order_relaxed)) {}
+}
+
+Metrics& Metrics::Instance()
+{
+    static Metrics metrics;
+    return metrics;
+}
+
+std::vector<double> Metrics::LatencyBuckets()
+{
+    return { 0.001, 0.0025, 0.005, 0.01, 0.02, 0.03, 0.05, 0.075, 0.1, 0.25, 0.5, 1.0, 2.5 };
+}
+
+Metrics::Family& Metrics::family(const std::string& name, const std::string& type, const std::string& help)
+{
+    auto it = families.find(name);
+    if (it == families.end()) {
+        it = families.emplace(name, Family()).first;
+        it->second.type = type;
+        it->second.help = help;
+    }
+    else if (it->second.type != type) {
+        throw std::invalid_argument("Metric " + name + " is already registered as " + it->second.type);
+    }
+    return it->second;
+}
+
+Metrics::Counter& Metrics::GetCounter(const std::string& name, const std::string& help, const std::string& labels)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<Counter>& counter = family(name, "counter", help).counters[labels];
+    if (!counter) counter = std::make_unique<Counter>();
+    return *counter;
+}
+
+Metrics::Gauge& Metrics::GetGauge(const std::string& name, const std::string& help, const std::string& labels)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<Gauge>& gauge = family(name, "gauge", help).gauges[labels];
+    if (!gauge) gauge = std::make_unique<Gauge>();
+    return *gauge;
+}
+
+Metrics::Histogram& Metrics::GetHistogram(const std::string& name, const std::string& help,
+    const std::vector<double>& bounds, const std::string& labels)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<Histogram>& histogram = family(name, "histogram", help).histograms[labels];
+    if (!histogram) histogram = std::make_unique<Histogram>(bounds);
+    return *histogram;
+}
+
+std::string Metrics::Export()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ostringstream out;
+    out.precision(15);
+    for (const auto& entry : families) {
+        const std::string& name = entry.first;
+        const Family& f = entry.second;
+        out << "# HELP " << name << " " << f.help << "\n"
+            << "# TYPE " << name << " " << f.type << "\n";
+        for (const auto& counter : f.counters)
+            out << series(name, counter.first) << " " << counter.second->Value() << "\n";
+        for (const auto& gauge : f.gauges)
+            out << series(name, gauge.first) << " " << gauge.second->Value() << "\n";
+        for (const auto& histogram : f.histograms) {
+            const Histogram& h = *histogram.second;
+            // 桶是累计的，le 为上界
+            uint64_t cumulative = 0;
+            for (size_t i = 0; i < h.Bounds().size(); ++i) {
+                cumulative += h.BucketCount(i);
+                std::ostringstream le;
+                le << "le=\"" << h.Bounds()[i] << "\"";
+                out << series(name + "_bucket", histogram.first, le.str()) << " " << cumulative << "\n";
+            }
+            cumulative += h.BucketCount(h.Bounds().size());
+            out << series(name + "_bucket", histogram.first, "le=\"+Inf\"") << " " << cumulative << "\n"
+                << series(name + "_sum", histogram.first) << " " << h.Sum() << "\n"
+                << series(name + "_count", histogram.first) << " " << h.Count() << "\n";
+        }
+    }
+    return out.str();
+}
+
+MattingMetrics::MattingMetrics()
+    : frames_in(Metrics::Instance().GetCounter("apm_frames_in_total",
+        "Frames decoded from videos or captured from cameras.")),
+    frames_out(Metrics::Instance().GetCounter("apm_frames_out_total",
+        "Frames written to outputs or displayed.")),
+    frames_dropped(Metrics::Instance().GetCounter("apm_frames_dropped_total",
+        "Frames that failed to capture or were never written.")),
+    inferred_full(Metrics::Instance().GetCounter("apm_frames_inferred_total",
+        "Frames that ran the network.", "region=\"full\"")),
+    inferred_roi(Metrics::Instance().GetCounter("apm_frames_inferred_total",
+        "Frames that ran the network.", "region=\"roi\"")),
+    skipped_static(Metrics::Instance().GetCounter("apm_frames_skipped_total",
+        "Frames that reused or propagated an earlier alpha instead of running the network.", "reason=\"static\"")),
+    skipped_propagated(Metrics::Instance().GetCounter("apm_frames_skipped_total",
+        "Frames that reused or propagated an earlier alpha instead of running the network.", "reason=\"propagated\"")),
+    inference_seconds(Metrics::Instance().GetHistogram("apm_inference_seconds",
+        "Time from start_async until wait returns.", Metrics::LatencyBuckets())),
+    decoded_depth(Metrics::Instance().GetGauge("apm_queue_depth",
+        "Frames waiting in a video pipeline queue.", "queue=\"decoded\"")),
+    inferred_depth(Metrics::Instance().GetGauge("apm_queue_depth",
+        "Frames waiting in a video pipeline queue.", "queue=\"inferred\"")),
+    matted_depth(Metrics::Instance().GetGauge("apm_queue_depth",
+        "Frames waiting in a video pipeline queue.", "queue=\"matted\"")),
+    startup_seconds(Metrics::Instance().GetGauge("apm_startup_seconds",
+        "Time from reading the model until the first compiled model is ready.")),
+    first_frame_seconds(Metrics::Instance().GetGauge("apm_first_frame_seconds",
+        "Time from starting a video or camera until its first frame is written or displayed."))
+{
+}
+
+MattingMetrics& MattingMetrics::Get()
+{
+    static MattingMetrics metrics;
+    return metrics;
+}
+
+MetricsExporter::MetricsExporter(const std::string& path, int interval_ms)
+    : path(path), interval_ms(std::max(interval_ms, 100))
+{
+    worker = std::thread(&MetricsExporter::run, this);
+}
+
+MetricsExporter::~MetricsExporter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    worker.join();
+    this->Flush();
+}
+
+bool MetricsExporter::Flush()
+{
+    Metrics& metrics = Metrics::Instance();
+    metrics.GetGauge("process_resident_memory_bytes", "Resident memory size in bytes.")
+        .Set(resident_memory_bytes());
+    const std::string text = metrics.Export();
+    const std::string temp_path = path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary);
+        if (!out.is_open() || !(out << text)) return false;
+    }
+    std::error_code error;
+    std::filesystem::rename(temp_path, path, error);
+    return !error;
+}
+
+void MetricsExporter::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!wake.wait_for(lock, std::chrono::milliseconds(interval_ms), [this] { return stopping; })) {
+        lock.unlock();
+        const bool written = this->Flush();
+        lock.lock();
+        // 只警告一次，避免刷屏
+        if (!written && !warned) {
+            std::cerr << "[WARNING] Can not write metrics to: " << path << std::endl;
+            warned = true;
+        }
+    }
+}
\ No newline at end of file
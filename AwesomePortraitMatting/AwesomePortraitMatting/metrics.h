@@ -0,0 +1,212 @@
+﻿#pragma once
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief 进程内的运行指标（计数器、瞬时值、直方图），以 Prometheus 文本格式导出。
+ * 长时间的批处理与虚拟摄像头原先只有 stdout 的进度，导出的指标可以由 Prometheus（node_exporter 的
+ * textfile collector）采集，观察吞吐、跳过比例与内存并设置告警，不需要挂上性能分析器。
+ *  * 指标在第一次获取时注册，之后返回同一个对象，引用在进程内一直有效；
+ *  * 更新只有一次 relaxed 原子操作，热路径上先获取引用再逐帧更新；
+ *  * 同名指标可以带不同的标签，例如 apm_queue_depth{queue="decoded"}。
+ * 进程内只有一个注册表，见 Instance。
+ */
+class Metrics
+{
+public:
+    /**
+     * @brief 单调递增的计数器。
+     */
+    class Counter
+    {
+    public:
+        void Add(uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+        uint64_t Value() const { return value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<uint64_t> value{ 0 };
+    };
+
+    /**
+     * @brief 可增可减的瞬时值。
+     */
+    class Gauge
+    {
+    public:
+        void Set(double v) { value.store(v, std::memory_order_relaxed); }
+        double Value() const { return value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<double> value{ 0 };
+    };
+
+    /**
+     * @brief 固定分桶的直方图，桶的上界升序排列，另有隐含的 +Inf 桶。
+     */
+    class Histogram
+    {
+    public:
+        explicit Histogram(const std::vector<double>& bounds);
+
+        //! 记录一个样本
+        void Observe(double v);
+
+        const std::vector<double>& Bounds() const { return bounds; }
+        //! 第 i 个桶（非累计）的样本数，i == Bounds().size() 为 +Inf 桶
+        uint64_t BucketCount(size_t i) const { return buckets[i].load(std::memory_order_relaxed); }
+        uint64_t Count() const { return count.load(std::memory_order_relaxed); }
+        double Sum() const { return sum.load(std::memory_order_relaxed); }
+
+    private:
+        std::vector<double> bounds;
+        std::unique_ptr<std::atomic<uint64_t>[]> buckets;
+        std::atomic<uint64_t> count{ 0 };
+        std::atomic<double> sum{ 0 };
+    };
+
+    //! 进程内唯一的注册表
+    static Metrics& Instance();
+
+    /**
+     * @brief 获取计数器，不存在时注册。
+     * @param name 指标名称，计数器以 _total 结尾。
+     * @param help 说明，同名指标只使用第一次注册时的说明。
+     * @param labels 标签，例如 queue="decoded"，为空表示没有标签。
+     *
+     * @note 同名指标必须是同一种类型，否则抛出 std::invalid_argument。
+     */
+    Counter& GetCounter(const std::string& name, const std::string& help, const std::string& labels = "");
+
+    //! 获取瞬时值，不存在时注册，参数同 GetCounter
+    Gauge& GetGauge(const std::string& name, const std::string& help, const std::string& labels = "");
+
+    /**
+     * @brief 获取直方图，不存在时注册，参数同 GetCounter。
+     * @param bounds 桶的上界，只在第一次注册时使用。
+     */
+    Histogram& GetHistogram(const std::string& name, const std::string& help,
+        const std::vector<double>& bounds, const std::string& labels = "");
+
+    /**
+     * @brief 以 Prometheus 文本格式（0.0.4）导出所有指标。
+     */
+    std::string Export();
+
+    //! 延迟直方图的默认分桶（秒）：1 ms ~ 2.5 s
+    static std::vector<double> LatencyBuckets();
+
+protected:
+    Metrics() = default;
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+private:
+    /**
+     * @brief 同名的一组指标。
+     */
+    struct Family
+    {
+        //! counter、gauge 或 histogram
+        std::string type;
+        std::string help;
+        //! 按标签索引，同一个 Family 中只会使用与 type 对应的一个
+        std::map<std::string, std::unique_ptr<Counter>> counters;
+        std::map<std::string, std::unique_ptr<Gauge>> gauges;
+        std::map<std::string, std::unique_ptr<Histogram>> histograms;
+    };
+
+    Family& family(const std::string& name, const std::string& type, const std::string& help);
+
+    std::mutex mutex;
+    std::map<std::string, Family> families;
+};
+
+/**
+ * @brief 抠图接口（apm 与虚拟摄像头）共用的指标，第一次使用时注册。
+ * 跳过比例由 apm_frames_skipped_total / apm_frames_in_total 计算，吞吐由 rate(apm_frames_out_total) 计算。
+ */
+struct MattingMetrics
+{
+    //! 解码或捕获的帧数
+    Metrics::Counter& frames_in;
+    //! 写入或展示的帧数
+    Metrics::Counter& frames_out;
+    //! 捕获失败或流水线提前结束而没有输出的帧数
+    Metrics::Counter& frames_dropped;
+    //! 整帧推理的帧数
+    Metrics::Counter& inferred_full;
+    //! ROI 推理的帧数
+    Metrics::Counter& inferred_roi;
+    //! 静止画面跳过推理的帧数
+    Metrics::Counter& skipped_static;
+    //! 关键帧模式传播 alpha、跳过推理的帧数
+    Metrics::Counter& skipped_propagated;
+    //! 从 start_async 到 wait 返回的耗时（秒）
+    Metrics::Histogram& inference_seconds;
+    //! 视频流水线各队列的深度
+    Metrics::Gauge& decoded_depth;
+    Metrics::Gauge& inferred_depth;
+    Metrics::Gauge& matted_depth;
+    //! 从读取模型到第一个编译模型可用的耗时（秒），冷启动直接推迟了第一帧
+    Metrics::Gauge& startup_seconds;
+    //! 从开始处理视频或摄像头到写入或展示第一帧的耗时（秒），包含第一次推理的初始化
+    Metrics::Gauge& first_frame_seconds;
+
+    static MattingMetrics& Get();
+
+private:
+    MattingMetrics();
+};
+
+/**
+ * @brief 定期将 Metrics 写入文件的导出线程。
+ * 先写入 path.tmp 再替换 path，读取方（node_exporter textfile collector、tail、脚本）不会读到写了一半的文件。
+ * 每次写入前更新进程的常驻内存 process_resident_memory_bytes。
+ */
+class MetricsExporter
+{
+public:
+    /**
+     * @param path 输出文件路径，Prometheus textfile collector 要求以 .prom 结尾。
+     * @param interval_ms 刷新间隔（ms）。
+     */
+    MetricsExporter(const std::string& path, int interval_ms = 5000);
+
+    //! 停止导出线程，并写入最后一次
+    ~MetricsExporter();
+
+    /**
+     * @brief 立即写入一次。
+     * @return 无法写入时返回 false。
+     */
+    bool Flush();
+
+protected:
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+private:
+    void run();
+
+    std::string path;
+    int interval_ms;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    //! 是否已经输出过写入失败的警告
+    bool warned = false;
+    std::thread worker;
+};
+
+#endif // METRICS_H
\ No newline at end of file
@@ -0,0 +1,346 @@
+﻿#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include <openvino/opsets/opset8.hpp>
+
+#include "model_cache.h"
+
+namespace {
+    //! 以 --dynamic-ratio 导出的模型中下采样比例输入的名称
+    const char* const ratio_name = "downsample_ratio";
+
+    /**
+     * @brief 将模型的 downsample_ratio 输入替换为常量，编译时随之常量折叠。
+     */
+    void freeze_ratio(const std::shared_ptr<ov::Model>& model, double ratio)
+    {
+        for (const auto& parameter : model->get_parameters()) {
+            if (parameter->output(0).get_names().count(ratio_name) == 0) continue;
+            const ov::PartialShape& shape = parameter->get_partial_shape();
+            auto constant = ov::opset8::Constant::create(parameter->get_element_type(),
+                shape.is_static() ? shape.to_shape() : ov::Shape{ 1 }, std::vector<double>{ ratio });
+            ov::replace_node(parameter, constant);
+            model->remove_parameter(parameter);
+            return;
+        }
+    }
+
+    //! IntegrateModel 以附加张量名记录 YUV 输入格式
+    const char* const nv12_tag = "img_nv12";
+    const char* const i420_tag = "img_i420";
+
+    //! RVM 的隐藏状态尺寸：ceil(floor(size * ratio) / divisor)
+    size_t state_dim(int size, double ratio, size_t divisor)
+    {
+        size_t downsampled = static_cast<size_t>(std::floor(size * ratio + 1e-6));
+        return (downsampled + divisor - 1) / divisor;
+    }
+}
+
+ModelCache::ModelCache(ov::Core& core,
+    const std::shared_ptr<ov::Model>& model,
+    const std::string& device,
+    const ov::AnyMap& config,
+    const std::vector<cv::Size>& native_sizes,
+    double ratio,
+    BlobCache* blobs)
+    : core(core), model(model), device(device), config(config), blobs(blobs)
+{
+    // ========  Step 1: 获取原模型的输入尺寸（NHWC）与颜色格式，图内缩放的模型输入尺寸可变 =========
+    const ov::Output<ov::Node> img = model->input("img");
+    if (img.get_names().count(nv12_tag) > 0) color = ColorFormat::NV12;
+    else if (img.get_names().count(i420_tag) > 0) color = ColorFormat::I420;
+    const ov::PartialShape img_shape = img.get_partial_shape();
+    if (img_shape.is_static()) {
+        // YUV 4:2:0 的 img 在 Y 平面之下还有一半高度的色度平面
+        const int rows = static_cast<int>(img_shape[1].get_length());
+        base_size = cv::Size(static_cast<int>(img_shape[2].get_length()),
+            color == ColorFormat::BGR ? rows : rows * 2 / 3);
+    }
+    for (const auto& input : model->inputs()) {
+        ratio_input = ratio_input || input.get_names().count(ratio_name) > 0;
+    }
+    if (ratio_input) {
+        downsample_ratio = ratio > 0 ? ratio : default_downsample_ratio;
+        std::cout << std::endl << "[INFO] Downsample ratio: " << downsample_ratio << std::endl;
+    }
+
+    // ========  Step 2: 立即编译原模型尺寸，带 downsample_ratio 输入的模型先固定比例 =========
+    std::unique_ptr<Entry> entry = this->compile(ratio_input ? this->reshape_model(base_size) : model, base_size);
+    base = entry.get();
+    entries.emplace(this->entry_key(base_size), std::move(entry));
+
+    // ========  Step 3: 推导隐藏状态规则，确定可用的原生尺寸 =========
+    if (img_shape.is_dynamic()) {
+        // 任意尺寸的输入都在图内缩放到同一个尺寸，只需要一个编译模型
+        std::cout << std::endl << "[INFO] The model resizes input in graph, any input size is accepted." << std::endl;
+        return;
+    }
+    sizes.push_back(base_size);
+    reshapable = ratio_input || this->derive_state_rule();
+    if (ratio > 0 && !ratio_input && std::abs(ratio - downsample_ratio) > 1e-3) {
+        std::cerr << "[WARNING] The model has downsample ratio " << downsample_ratio
+            << " fixed in graph, export it with --dynamic-ratio to use " << ratio << "." << std::endl;
+    }
+    if (!reshapable) {
+        std::cerr << "[WARNING] Can not derive recurrent state shapes from the model, only "
+            << base_size.width << "x" << base_size.height << " is used." << std::endl;
+        return;
+    }
+    for (const auto& size : native_sizes) {
+        if (size != base_size) sizes.push_back(size);
+    }
+}
+
+std::string ModelCache::ColorFormatTag(ColorFormat format)
+{
+    switch (format) {
+    case ColorFormat::NV12: return nv12_tag;
+    case ColorFormat::I420: return i420_tag;
+    default: return std::string();
+    }
+}
+
+std::vector<cv::Size> ModelCache::DefaultSizes()
+{
+    return {
+        cv::Size(1920, 1080), cv::Size(1280, 720), cv::Size(854, 480), cv::Size(640, 480),
+        cv::Size(1080, 1920), cv::Size(720, 1280), cv::Size(480, 854)
+    };
+}
+
+cv::Size ModelCache::NativeSize(const cv::Size& frame_size) const
+{
+    if (frame_size.width <= 0 || frame_size.height <= 0) return base_size;
+    const bool landscape = frame_size.width >= frame_size.height;
+    cv::Size best = base_size;
+    double best_cost = -1;
+    // 优先选择方向相同的尺寸，没有时在全部尺寸中选择
+    for (int pass = 0; pass < 2 && best_cost < 0; ++pass) {
+        for (const auto& size : sizes) {
+            if (pass == 0 && (size.width >= size.height) != landscape) continue;
+            double cost = std::abs(std::log(static_cast<double>(size.width) / frame_size.width))
+                + std::abs(std::log(static_cast<double>(size.height) / frame_size.height));
+            if (best_cost < 0 || cost < best_cost) {
+                best = size;
+                best_cost = cost;
+            }
+        }
+    }
+    return best;
+}
+
+ModelCache::Entry& ModelCache::Get(const cv::Size& frame_size)
+{
+    const cv::Size size = this->NativeSize(frame_size);
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry* entry = this->find_or_compile(size);
+    return entry != nullptr ? *entry : *base;
+}
+
+ModelCache::Entry* ModelCache::GetExact(const cv::Size& size)
+{
+    if (!reshapable) return nullptr;
+    std::lock_guard<std::mutex> lock(mutex);
+    return this->find_or_compile(size);
+}
+
+size_t ModelCache::CompileAll()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    // 图内缩放的模型只有原模型一个编译结果
+    if (sizes.empty()) return 1;
+    size_t compiled = 0;
+    for (const auto& size : sizes) {
+        if (this->find_or_compile(size) != nullptr) ++compiled;
+    }
+    return compiled;
+}
+
+bool ModelCache::SetDownsampleRatio(double ratio)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (std::abs(ratio - downsample_ratio) < 1e-4) return true;
+    if (!ratio_input) {
+        std::cerr << "[WARNING] The model has downsample ratio " << downsample_ratio
+            << " fixed in graph, export it with --dynamic-ratio to change it." << std::endl;
+        return false;
+    }
+    if (ratio <= 0 || ratio > 1) {
+        std::cerr << "[WARNING] Downsample ratio must be in (0, 1], got " << ratio << "." << std::endl;
+        return false;
+    }
+    // 新比例下的原模型尺寸编译失败时保持原来的比例
+    const double previous = downsample_ratio;
+    downsample_ratio = ratio;
+    Entry* entry = this->find_or_compile(base_size);
+    if (entry == nullptr) {
+        downsample_ratio = previous;
+        std::cerr << "[WARNING] Keep downsample ratio " << previous << "." << std::endl;
+        return false;
+    }
+    base = entry;
+    return true;
+}
+
+ModelCache::Key ModelCache::entry_key(const cv::Size& size) const
+{
+    return Key(size.width, size.height, std::lround(downsample_ratio * 10000));
+}
+
+ModelCache::Entry* ModelCache::find_or_compile(const cv::Size& size)
+{
+    const Key key = this->entry_key(size);
+    auto it = entries.find(key);
+    if (it != entries.end()) return it->second.get();
+    if (failed.count(key) > 0) return nullptr;
+
+    // 首次使用该尺寸（或比例），reshape 并编译（开启 cache_dir 时再次运行会直接读取缓存）
+    try {
+        std::cout << "[INFO] Compiling model for native size " << size.width << "x" << size.height;
+        if (ratio_input) std::cout << " (downsample ratio " << downsample_ratio << ")";
+        std::cout << "...";
+        std::unique_ptr<Entry> entry = this->compile(this->reshape_model(size), size);
+        std::cout << "done!" << std::endl;
+        Entry* result = entry.get();
+        entries.emplace(key, std::move(entry));
+        return result;
+    }
+    catch (const std::exception& ex) {
+        std::cerr << std::endl << "[WARNING] Can not compile model for " << size.width << "x" << size.height
+            << ": " << ex.what() << std::endl
+            << "[WARNING] Fall back to " << base_size.width << "x" << base_size.height << "." << std::endl;
+        failed.insert(key);
+        return nullptr;
+    }
+}
+
+std::shared_ptr<ov::Model> ModelCache::reshape_model(const cv::Size& size) const
+{
+    std::shared_ptr<ov::Model> reshaped = model->clone();
+    if (ratio_input) {
+        this->reshape_with_ratio(reshaped, size);
+        return reshaped;
+    }
+    std::map<std::string, ov::PartialShape> shapes;
+    // img 输入为 NHWC
+    ov::Shape img_shape = model->input("img").get_shape();
+    img_shape.at(1) = this->input_rows(size.height);
+    img_shape.at(2) = size.width;
+    shapes["img"] = img_shape;
+    // 隐藏状态为 NCHW
+    for (size_t i = 0; i < states.size(); ++i) {
+        ov::Shape shape = states[i].second;
+        shape.at(2) = state_dim(size.height, downsample_ratio, state_divisors[i]);
+        shape.at(3) = state_dim(size.width, downsample_ratio, state_divisors[i]);
+        shapes[states[i].first] = shape;
+    }
+    reshaped->reshape(shapes);
+    return reshaped;
+}
+
+void ModelCache::reshape_with_ratio(const std::shared_ptr<ov::Model>& reshaped, const cv::Size& size) const
+{
+    // ========  Step 1: 固定下采样比例 =========
+    freeze_ratio(reshaped, downsample_ratio);
+
+    // ========  Step 2: img 设为目标尺寸，隐藏状态的 H、W 设为可变，推导状态输出的形状 =========
+    std::map<std::string, ov::PartialShape> shapes;
+    if (!size.empty()) {
+        ov::Shape img_shape = reshaped->input("img").get_shape();
+        img_shape.at(1) = this->input_rows(size.height);
+        img_shape.at(2) = size.width;
+        shapes["img"] = img_shape;
+    }
+    std::vector<std::string> state_names;
+    for (const auto& input : reshaped->inputs()) {
+        std::string name = input.get_any_name();
+        ov::PartialShape shape = input.get_partial_shape();
+        if (name == "img" || shape.size() != 4) continue;
+        shape[2] = ov::Dimension::dynamic();
+        shape[3] = ov::Dimension::dynamic();
+        shapes[name] = shape;
+        state_names.push_back(name);
+    }
+    reshaped->reshape(shapes);
+
+    // ========  Step 3: 状态输出（s1o）的形状即下一帧状态输入（s1i）的形状 =========
+    for (const auto& name : state_names) {
+        std::string output_name = name;
+        output_name.back() = 'o';
+        const ov::PartialShape& shape = reshaped->output(output_name).get_partial_shape();
+        if (shape.is_dynamic())
+            throw std::runtime_error("can not infer the shape of " + output_name);
+        shapes[name] = shape;
+    }
+    reshaped->reshape(shapes);
+}
+
+size_t ModelCache::input_rows(int height) const
+{
+    return color == ColorFormat::BGR ? static_cast<size_t>(height) : static_cast<size_t>(height) * 3 / 2;
+}
+
+std::unique_ptr<ModelCache::Entry> ModelCache::compile(const std::shared_ptr<ov::Model>& model,
+    const cv::Size& size)
+{
+    std::unique_ptr<Entry> entry(new Entry());
+    if (blobs != nullptr) {
+        // 同一个模型文件的不同 reshape 以尺寸与下采样比例区分
+        std::string variant = size.empty() ? "dynamic"
+            : std::to_string(size.width) + "x" + std::to_string(size.height);
+        if (ratio_input) variant += "@" + std::to_string(std::lround(downsample_ratio * 10000));
+        entry->compiled_model = blobs->Load(model, device, config, variant);
+    }
+    else {
+        entry->compiled_model = core.compile_model(model, device, config);
+    }
+    entry->img_port = entry->compiled_model.input("img");
+    entry->alp_port = entry->compiled_model.output("alp");
+    for (const auto& output : entry->compiled_model.outputs()) {
+        if (output.get_names().count("fgr") == 0) continue;
+        entry->has_fgr = true;
+        entry->fgr_port = output;
+    }
+    entry->size = size;
+    entry->color = color;
+    return entry;
+}
+
+bool ModelCache::derive_state_rule()
+{
+    // ========  Step 1: 收集隐藏状态输入（除 img 外的 4 维静态输入） =========
+    size_t largest = 0;
+    for (const auto& input : model->inputs()) {
+        std::string name = input.get_any_name();
+        const ov::PartialShape& shape = input.get_partial_shape();
+        if (name == "img" || shape.is_dynamic() || shape.size() != 4) continue;
+        states.emplace_back(name, shape.to_shape());
+        largest = std::max(largest, states.back().second.at(2));
+    }
+    if (states.empty() || largest == 0) return false;
+
+    // ========  Step 2: 最大的状态为下采样尺寸的 1/2（向上取整），下采样尺寸只能是 2s 或 2s-1 =========
+    for (size_t downsampled : { 2 * largest, 2 * largest - 1 }) {
+        double ratio = static_cast<double>(downsampled) / base_size.height;
+        std::vector<size_t> divisors;
+        bool match = true;
+        for (const auto& state : states) {
+            const ov::Shape& shape = state.second;
+            double scale = static_cast<double>(downsampled) / shape.at(2);
+            size_t divisor = size_t(1) << static_cast<int>(std::lround(std::log2(scale)));
+            divisors.push_back(divisor);
+            // 推导出的规则必须能够还原原模型的状态形状
+            match = match && state_dim(base_size.height, ratio, divisor) == shape.at(2)
+                && state_dim(base_size.width, ratio, divisor) == shape.at(3);
+        }
+        if (match) {
+            downsample_ratio = ratio;
+            state_divisors = divisors;
+            return true;
+        }
+    }
+    states.clear();
+    return false;
+}
\ No newline at end of file
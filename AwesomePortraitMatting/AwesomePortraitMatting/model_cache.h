@@ -0,0 +1,236 @@
+﻿#pragma once
+
+#ifndef MODEL_CACHE_H
+#define MODEL_CACHE_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include <openvino/openvino.hpp>
+
+#include "blob_cache.h"
+
+/**
+ * @brief 按输入尺寸缓存的编译模型。
+ * 导出的 IR 是静态形状（1080x1920），输入尺寸不同时每帧都要先缩放到模型尺寸，结果再缩放回去。
+ * ModelCache 将模型 reshape 到一组原生尺寸（480p、720p、1080p 及其竖屏方向），首次使用时才编译，
+ * 编译结果按尺寸缓存；每个输入选择最接近的原生尺寸，与原生尺寸一致的输入在两个方向都不需要缩放。
+ *  * img 输入按 NHWC 修改 H、W；
+ *  * 隐藏状态按 RVM 的规则重新计算：下采样尺寸为 floor(H * ratio)，第 k 个状态为 ceil(下采样尺寸 / 2^k)，
+ *    ratio 与 2^k 均从原模型的端口形状推导；
+ *  * batch 维保持不变。
+ * 输入尺寸可变（IntegrateModel 开启图内缩放）的模型不需要 reshape，所有输入共用一个编译模型。
+ * 输入为单平面 YUV 4:2:0 的模型 img 的高度是帧高度的 3/2，尺寸与 reshape 都按帧尺寸换算。
+ * 以 --dynamic-ratio 导出的模型带有 downsample_ratio 输入，下采样比例可以在运行时选择：
+ * 编译前将该输入固定为常量，隐藏状态的形状由图的形状推导得到，编译结果按 (尺寸, 比例) 缓存。
+ * 指定 BlobCache 时，每个 (尺寸, 比例) 的编译结果还会导出到文件，之后的启动直接读取。
+ */
+class ModelCache
+{
+public:
+    /**
+     * @brief 模型 img 输入的颜色格式，由 PortraitMatting::IntegrateModel 决定。
+     */
+    enum class ColorFormat
+    {
+        //! 三通道 BGR，[N, H, W, 3]
+        BGR,
+        //! 单平面 NV12，[N, H * 3 / 2, W, 1]：Y 平面之后是 U、V 交错的色度平面
+        NV12,
+        //! 单平面 I420，[N, H * 3 / 2, W, 1]：Y 平面之后依次是 U 平面、V 平面
+        I420
+    };
+
+    /**
+     * @brief 颜色格式记录为 img 输入的附加张量名（img_nv12、img_i420），随 IR 保存；BGR 模型没有附加名。
+     * @return 格式对应的附加张量名，BGR 返回空字符串。
+     */
+    static std::string ColorFormatTag(ColorFormat format);
+
+    /**
+     * @brief 某个尺寸的编译模型。
+     */
+    struct Entry
+    {
+        //! 编译后的模型
+        ov::CompiledModel compiled_model;
+        //! 模型 img 输入端口
+        ov::Output<const ov::Node> img_port;
+        //! 模型 alp 输出端口
+        ov::Output<const ov::Node> alp_port;
+        //! 模型是否保留了 fgr 输出（PruneModel 会将其删除）
+        bool has_fgr = false;
+        //! 模型 fgr 输出端口，has_fgr 为 true 时有效
+        ov::Output<const ov::Node> fgr_port;
+        //! 模型输入帧的尺寸，为空表示模型在图内缩放，接受任意尺寸
+        cv::Size size;
+        //! img 输入的颜色格式
+        ColorFormat color = ColorFormat::BGR;
+    };
+
+    /**
+     * @brief 构造缓存，并立即编译原模型自身的尺寸。
+     * @param core 用于编译的 OpenVINO Runtime Core，生命周期需长于缓存。
+     * @param model 读取的原模型。
+     * @param device 编译的目标设备。
+     * @param config 编译参数。
+     * @param native_sizes 允许使用的原生尺寸，原模型自身的尺寸总是可用。
+     * @param ratio 模型带有 downsample_ratio 输入时使用的下采样比例，0 表示 default_downsample_ratio。
+     * @param blobs [可选] 编译结果的导出缓存，生命周期需长于缓存；为空时每次都编译。
+     */
+    ModelCache(ov::Core& core,
+        const std::shared_ptr<ov::Model>& model,
+        const std::string& device,
+        const ov::AnyMap& config,
+        const std::vector<cv::Size>& native_sizes = DefaultSizes(),
+        double ratio = 0,
+        BlobCache* blobs = nullptr);
+
+    /**
+     * @brief 默认的原生尺寸：1080p、720p、480p（16:9 与 4:3）以及对应的竖屏尺寸。
+     */
+    static std::vector<cv::Size> DefaultSizes();
+
+    /**
+     * @brief 获取与输入尺寸最接近的原生尺寸。
+     * @param frame_size 输入帧的尺寸。
+     *
+     * @note 只在方向（横屏或竖屏）相同的尺寸中选择，按宽、高的对数比之和衡量距离。
+     */
+    cv::Size NativeSize(const cv::Size& frame_size) const;
+
+    /**
+     * @brief 获取与输入尺寸最接近的原生尺寸的编译模型，尚未编译时在此编译。
+     * @param frame_size 输入帧的尺寸。
+     * @return 编译模型，引用在缓存销毁前一直有效。
+     *
+     * @note 线程安全。reshape 或编译失败时输出警告并返回原模型尺寸的编译模型，之后不再尝试该尺寸。
+     */
+    Entry& Get(const cv::Size& frame_size);
+
+    /**
+     * @brief 获取指定尺寸的编译模型（不在原生尺寸中选择），尚未编译时在此编译。用于 ROI 推理等固定的裁剪尺寸。
+     * @param size 模型输入帧的尺寸。
+     * @return 编译模型；模型不能 reshape（包括图内缩放的模型）或编译失败时返回 nullptr。
+     *
+     * @note 线程安全。
+     */
+    Entry* GetExact(const cv::Size& size);
+
+    /**
+     * @brief 编译当前下采样比例下的所有原生尺寸，用于安装时预先生成 BlobCache。
+     * 只编译当前的下采样比例与编译参数（设备的默认精度）；其他比例需要以该比例创建的缓存再编译一次，
+     * GetExact 的裁剪尺寸不在其中。
+     * @return 可用的原生尺寸数量，编译失败的尺寸不计入。
+     *
+     * @note 线程安全。
+     */
+    size_t CompileAll();
+
+    /**
+     * @brief 原模型自身尺寸（当前下采样比例）的编译模型。
+     */
+    Entry& Base() { return *base; }
+
+    /**
+     * @brief 切换下采样比例，并立即编译原模型尺寸。
+     * @param ratio 下采样比例，范围 (0, 1]。人物较小、场景复杂时取 0.5，近景半身取 0.25 可以显著减少骨干网络的计算量。
+     * @return 切换成功时返回 true。模型没有 downsample_ratio 输入（比例固定在图中）或编译失败时
+     *         输出警告并返回 false，保持原来的比例。
+     *
+     * @note 隐藏状态的形状随比例改变，切换后需要为新的编译模型重新创建推理请求与隐藏状态。
+     * @note 已编译的其他比例仍然保留在缓存中，切换回来时不需要重新编译。
+     */
+    bool SetDownsampleRatio(double ratio);
+
+    //! 当前的下采样比例
+    double DownsampleRatio() const { return downsample_ratio; }
+
+    //! 下采样比例是否可以在运行时选择
+    bool HasRatioInput() const { return ratio_input; }
+
+    //! 模型 img 输入的颜色格式
+    ColorFormat InputColorFormat() const { return color; }
+
+    //! 与 MattingNetwork.forward 的默认值一致
+    static constexpr double default_downsample_ratio = 0.4;
+
+protected:
+    ModelCache(const ModelCache&) = delete;
+    ModelCache& operator=(const ModelCache&) = delete;
+
+private:
+    //! 编译模型的缓存键：(宽, 高, 下采样比例 * 10000)
+    using Key = std::tuple<int, int, long>;
+
+    Key entry_key(const cv::Size& size) const;
+
+    /**
+     * @brief 查找当前下采样比例下指定尺寸的编译模型，尚未编译时在此编译，调用时需持有 mutex。
+     * @return 编译失败时返回 nullptr。
+     */
+    Entry* find_or_compile(const cv::Size& size);
+
+    /**
+     * @brief 将原模型 reshape 到指定的输入尺寸（为空时不修改 img 输入）。
+     */
+    std::shared_ptr<ov::Model> reshape_model(const cv::Size& size) const;
+
+    /**
+     * @brief 将 downsample_ratio 输入固定为当前比例，并由状态输出的形状推导状态输入的形状。
+     */
+    void reshape_with_ratio(const std::shared_ptr<ov::Model>& reshaped, const cv::Size& size) const;
+
+    /**
+     * @brief 帧高度为 height 时 img 输入的行数，YUV 4:2:0 模型为 height * 3 / 2。
+     */
+    size_t input_rows(int height) const;
+
+    /**
+     * @brief 编译模型并填充端口信息。
+     */
+    std::unique_ptr<Entry> compile(const std::shared_ptr<ov::Model>& model, const cv::Size& size);
+
+    /**
+     * @brief 从原模型的端口形状推导下采样比例与各隐藏状态的缩小倍数，成功时返回 true。
+     */
+    bool derive_state_rule();
+
+    ov::Core& core;
+    std::shared_ptr<ov::Model> model;
+    std::string device;
+    ov::AnyMap config;
+    BlobCache* blobs = nullptr;
+    std::vector<cv::Size> sizes;
+
+    //! 原模型输入帧的尺寸
+    cv::Size base_size;
+    //! img 输入的颜色格式
+    ColorFormat color = ColorFormat::BGR;
+    //! 原模型中每个隐藏状态输入的名称与形状
+    std::vector<std::pair<std::string, ov::Shape>> states;
+    //! 隐藏状态相对于下采样尺寸的缩小倍数，与 states 一一对应
+    std::vector<size_t> state_divisors;
+    //! 模型内部的下采样比例
+    double downsample_ratio = 0;
+    //! 是否能够 reshape，无法推导隐藏状态规则时只使用原模型尺寸
+    bool reshapable = false;
+    //! 模型是否带有 downsample_ratio 输入
+    bool ratio_input = false;
+
+    std::mutex mutex;
+    //! 已编译的模型
+    std::map<Key, std::unique_ptr<Entry>> entries;
+    //! reshape 或编译失败的尺寸与比例
+    std::set<Key> failed;
+    Entry* base = nullptr;
+};
+
+#endif // MODEL_CACHE_H
\ No newline at end of file
@@ -1,117 +1,587 @@
 ﻿#include <cmath>
+#include <cstring>
 #include <chrono>
+#include <filesystem>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <map>
+#include <mutex>
+
+#include <openvino/opsets/opset8.hpp>
 
 #include "portrait_matting.h"
+#include "bounded_queue.h"
+#include "stream_scheduler.h"
+#include "batched_streams.h"
+#include "matting_kernels.h"
+#include "metrics.h"
+
+namespace {
+    /**
+     * @brief 在图内将 alpha 缩放到目标尺寸，并量化为 u8：round(alpha * 255)，截断到 [0, 255]。
+     * @param alp 模型的 alp 输出，[N, 1, H, W]。
+     * @param img 模型的 img 输入（NHWC），alpha_size 为空时缩放到它的 H、W。
+     * @param alpha_size 固定的输出尺寸。
+     * @param yuv img 是否为单平面 YUV 4:2:0，其高度是帧高度的 3/2。
+     */
+    ov::Output<ov::Node> alpha_to_u8(const ov::Output<ov::Node>& alp,
+        const ov::Output<ov::Node>& img,
+        const cv::Size& alpha_size,
+        const bool yuv)
+    {
+        using namespace ov::opset8;
+        ov::Output<ov::Node> target;
+        if (alpha_size.area() > 0) {
+            target = Constant::create(ov::element::i64, ov::Shape{ 2 },
+                std::vector<int64_t>{ alpha_size.height, alpha_size.width });
+        }
+        else {
+            auto img_shape = std::make_shared<ShapeOf>(img, ov::element::i64);
+            target = std::make_shared<Gather>(img_shape,
+                Constant::create(ov::element::i64, ov::Shape{ 2 }, std::vector<int64_t>{ 1, 2 }),
+                Constant::create(ov::element::i64, ov::Shape{}, std::vector<int64_t>{ 0 }));
+            if (yuv) {
+                auto doubled = std::make_shared<Multiply>(target,
+                    Constant::create(ov::element::i64, ov::Shape{ 2 }, std::vector<int64_t>{ 2, 1 }));
+                target = std::make_shared<Divide>(doubled,
+                    Constant::create(ov::element::i64, ov::Shape{ 2 }, std::vector<int64_t>{ 3, 1 }));
+            }
+        }
+        // 与 cv::resize 的 INTER_LINEAR 采样位置一致
+        Interpolate::InterpolateAttrs attrs;
+        attrs.mode = Interpolate::InterpolateMode::LINEAR_ONNX;
+        attrs.shape_calculation_mode = Interpolate::ShapeCalcMode::SIZES;
+        attrs.coordinate_transformation_mode = Interpolate::CoordinateTransformMode::HALF_PIXEL;
+        auto resized = std::make_shared<Interpolate>(alp, target,
+            Constant::create(ov::element::f32, ov::Shape{ 2 }, std::vector<float>{ 1.0f, 1.0f }),
+            Constant::create(ov::element::i64, ov::Shape{ 2 }, std::vector<int64_t>{ 2, 3 }),
+            attrs);
+        auto scaled = std::make_shared<Multiply>(resized,
+            Constant::create(ov::element::f32, ov::Shape{}, std::vector<float>{ 255.0f }));
+        auto rounded = std::make_shared<Round>(scaled, Round::RoundMode::HALF_TO_EVEN);
+        auto clamped = std::make_shared<Clamp>(rounded, 0.0, 255.0);
+        return std::make_shared<Convert>(clamped, ov::element::u8);
+    }
+
+    /**
+     * @brief 删除模型中名为 name 的输出，只被该输出使用的计算在序列化时一并删除。
+     * @return 模型没有该输出时返回 false。
+     */
+    bool remove_output(const std::shared_ptr<ov::Model>& model, const std::string& name)
+    {
+        for (const auto& result : model->get_results()) {
+            if (result->input_value(0).get_names().count(name) == 0) continue;
+            model->remove_result(result);
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief 将模型的 fgr 输出（[N, 3, H, W]，RGB，[0, 1]）转换为指定尺寸的 BGR u8 图像。
+     */
+    cv::Mat foreground_bgr(const ov::Tensor& fgr_tensor, const cv::Size& size)
+    {
+        const ov::Shape fgr_shape = fgr_tensor.get_shape();
+        const int rows = static_cast<int>(fgr_shape.at(2)), cols = static_cast<int>(fgr_shape.at(3));
+        float* fgr_ptr = fgr_tensor.data<float>();
+        const size_t plane = static_cast<size_t>(rows) * cols;
+        std::vector<cv::Mat> bgr = {
+            cv::Mat(rows, cols, CV_32FC1, fgr_ptr + 2 * plane),
+            cv::Mat(rows, cols, CV_32FC1, fgr_ptr + plane),
+            cv::Mat(rows, cols, CV_32FC1, fgr_ptr)
+        };
+        cv::Mat foreground;
+        cv::merge(bgr, foreground);
+        foreground.convertTo(foreground, CV_8UC3, 255);
+        if (foreground.size() != size)
+            cv::resize(foreground, foreground, size);
+        return foreground;
+    }
+
+    /**
+     * @brief 将 alp 输出张量（[N, 1, H, W]，f32 或图内量化的 u8）包装为第一个 batch 的 cv::Mat，不拷贝数据。
+     */
+    cv::Mat alpha_mat(const ov::Tensor& alp_tensor)
+    {
+        const ov::Shape alp_shape = alp_tensor.get_shape();
+        const int alp_type = alp_tensor.get_element_type() == ov::element::u8 ? CV_8UC1 : CV_32FC1;
+        return cv::Mat(static_cast<int>(alp_shape.at(2)), static_cast<int>(alp_shape.at(3)),
+            alp_type, alp_tensor.data());
+    }
+
+    /**
+     * @brief 将输出张量拷贝到池中的缓冲区，用于保存形状可变的输出，避免被下一次推理覆盖。
+     * 池在第一次拷贝时按输出的形状创建，形状变化时重新创建；帧尺寸不变时稳态下不再分配内存。
+     * @param pool [输入/输出] 缓冲池，为空时创建。
+     * @param buffer [输出] 拷贝所在的缓冲区，持有期间不会被之后的帧复用。
+     * @return 指向 buffer 的张量。
+     */
+    ov::Tensor pooled_copy(const ov::Tensor& tensor, std::unique_ptr<FramePool>& pool, cv::Mat& buffer)
+    {
+        if (!pool || pool->Shape() != tensor.get_shape())
+            pool = std::make_unique<FramePool>(tensor.get_element_type(), tensor.get_shape());
+        ov::Tensor copy;
+        buffer = pool->Acquire(&copy);
+        std::memcpy(copy.data(), tensor.data(), tensor.get_byte_size());
+        return copy;
+    }
+
+    /**
+     * @brief 保存图片的抠图结果，失败时输出错误信息并返回 false。
+     */
+    bool write_image(const std::string& output_path, const cv::Mat& result)
+    {
+        try {
+            if (!cv::imwrite(output_path, result)) {
+                std::cerr << "[ERROR] Can not save image to: " << output_path
+                    << "  Check if directory exists." << std::endl;
+                return false;
+            }
+        }
+        catch (const cv::Exception& ex) {
+            std::cerr << "[ERROR] Exception save image to JPG format: " << ex.what() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief 模型 img 输入（NHWC）的形状，图内缩放的模型按帧的实际尺寸（图内缩放只用于 BGR 输入）。
+     */
+    ov::Shape input_shape(const ModelCache::Entry& entry, const cv::Size& frame_size)
+    {
+        return entry.size.empty()
+            ? ov::Shape{ 1, static_cast<size_t>(frame_size.height), static_cast<size_t>(frame_size.width), 3 }
+            : entry.img_port.get_shape();
+    }
+
+    /**
+     * @brief 创建模型 img 输入的输入环，张量在第一次使用时分配，之后循环复用。
+     * BGR 模型的缓冲区为 CV_8UC3；YUV 模型为 CV_8UC1，(高 * 3 / 2) x 宽，Y 平面之下是色度平面。
+     * @param frame_size 帧尺寸，只用于图内缩放的模型。
+     */
+    std::unique_ptr<FramePool> make_input_ring(const ModelCache::Entry& entry, const cv::Size& frame_size)
+    {
+        return std::make_unique<FramePool>(entry.img_port.get_element_type(), input_shape(entry, frame_size),
+            entry.color == ModelCache::ColorFormat::BGR ? 3 : 1);
+    }
+
+    /**
+     * @brief 从 capture 读取一帧，并从输入环中取出一个输入张量。
+     * 帧尺寸与输入张量一致时直接解码到张量的内存中，不再拷贝；否则解码到 frame 自身的缓冲区（循环中复用），
+     * 再由 fill_input 缩放到张量中。
+     * @param frame [输入/输出] 原尺寸的帧，直接解码时与 input 共享数据。
+     * @param input [输出] 输入张量的内存（见 make_input_ring），推理完成前需持有。
+     * @param tensor [输出] 指向 input 的输入张量，可以直接绑定到推理请求。
+     * @return 读取失败时返回 false。
+     */
+    bool read_frame(cv::VideoCapture& capture, FramePool& ring, cv::Mat& frame, cv::Mat& input, ov::Tensor& tensor)
+    {
+        input = ring.Acquire(&tensor);
+        // 第一帧先尝试直接解码，尺寸不同时 frame 会得到自己的缓冲区，之后的帧解码到该缓冲区
+        if (frame.empty() || frame.size() == input.size())
+            frame = input;
+        else
+            DetachShared(frame);
+        return capture.read(frame) && !frame.empty();
+    }
+
+    /**
+     * @brief 帧没有直接解码到输入张量时，缩放（尺寸相同时拷贝）到输入张量的内存中。
+     * YUV 输入的模型先缩放 BGR 帧，再转换为模型的格式写入输入张量。
+     * @param frame BGR 帧。
+     * @param color 模型 img 输入的颜色格式。
+     */
+    void fill_input(const cv::Mat& frame, cv::Mat& input, const ModelCache::ColorFormat color)
+    {
+        if (frame.data == input.data) return;
+        if (color != ModelCache::ColorFormat::BGR) {
+            const cv::Size size(input.cols, input.rows * 2 / 3);
+            thread_local cv::Mat resized;
+            if (frame.size() != size) cv::resize(frame, resized, size);
+            matting::BgrToYuv420(frame.size() != size ? resized : frame, input, color == ModelCache::ColorFormat::NV12);
+            return;
+        }
+        if (frame.size() != input.size())
+            cv::resize(frame, input, input.size());
+        else
+            frame.copyTo(input);
+    }
+
+    /**
+     * @brief 帧是否为 frame_size 的单平面 NV12：CV_8UC1，(高 * 3 / 2) x 宽。
+     */
+    bool is_nv12(const cv::Mat& frame, const cv::Size& frame_size)
+    {
+        return frame.type() == CV_8UC1 && frame.rows == frame_size.height * 3 / 2 && frame.cols == frame_size.width;
+    }
+
+    /**
+     * @brief 探测 capture 能否输出原生的 NV12 帧：关闭颜色转换后读取一帧，只有 is_nv12 的帧才是 NV12。
+     * OpenCV 的 FFmpeg 后端（文件的默认后端）关闭颜色转换后输出 高 x 宽 的灰度帧，不能当作 NV12。
+     * 探测消耗了一帧，之后重新打开输入；不是 NV12 时保持默认的 BGR 输出。
+     * @return capture 是否输出 NV12。重新打开失败时 capture 处于关闭状态，调用方需检查。
+     */
+    bool probe_nv12(cv::VideoCapture& capture, const std::string& video_path, const cv::Size& frame_size)
+    {
+        cv::Mat probe;
+        const bool nv12 = capture.set(cv::CAP_PROP_CONVERT_RGB, 0) && capture.read(probe) && is_nv12(probe, frame_size);
+        capture.open(video_path);
+        if (nv12) capture.set(cv::CAP_PROP_CONVERT_RGB, 0);
+        return nv12;
+    }
+
+    /**
+     * @brief 输出旁的临时文件路径：<输出名><tag><k><扩展名>，例如 out.part1.mp4。
+     */
+    std::string sibling_path(const std::string& output_path, const std::string& tag, int k)
+    {
+        const std::filesystem::path output(output_path);
+        std::filesystem::path sibling = output;
+        sibling.replace_filename(output.stem().generic_string() + tag + std::to_string(k) + output.extension().generic_string());
+        return sibling.generic_string();
+    }
+
+    /**
+     * @brief 将视频文件的所有帧按顺序追加到 writer，用于拼接分段或分块的输出。
+     * @param merge_mode 输出是否为三通道的融合图；单通道的 alpha 经过编码后读回为三通道，需要转换回来。
+     * @return 追加的帧数，文件无法打开时返回 -1。
+     */
+    int append_video(cv::VideoWriter& writer, const std::string& path, bool merge_mode)
+    {
+        cv::VideoCapture part(path);
+        if (!part.isOpened()) return -1;
+        int frames = 0;
+        cv::Mat mat;
+        while (part.read(mat) && !mat.empty()) {
+            if (!merge_mode && mat.channels() != 1)
+                cv::cvtColor(mat, mat, cv::COLOR_BGR2GRAY);
+            writer.write(mat);
+            ++frames;
+        }
+        return frames;
+    }
+}
 
 
-PortraitMatting::PortraitMatting(const std::string& model_path)
+PortraitMatting::PortraitMatting(const std::string& model_path, double downsample_ratio, const std::string& blob_dir)
 {
+    auto start = std::chrono::steady_clock::now();
+    // Debug 构建中统计帧缓冲的分配次数
+    AllocationCounter::Install();
     // ========  Step 1: 创建 OpenVINO Runime Core =========
     core.set_property(ov::cache_dir("cl_cache"));
-    // ========  Step 2: 编译模型到设备 =========
+    if (!blob_dir.empty())
+        blobs = std::make_unique<BlobCache>(core, blob_dir, model_path);
+    // ========  Step 2: 编译模型到设备，有可用的导出缓存时直接读取 =========
     model = core.read_model(model_path);
+    auto read_end = std::chrono::steady_clock::now();
     std::cout << "[INFO] Compiling and loading model into device..." << std::endl
         << "[INFO] If this is first time, it may take a while...";
-    ov::CompiledModel compiled_model = core.compile_model(model, "AUTO:GPU,CPU",
-        ov::hint::performance_mode(ov::hint::PerformanceMode::THROUGHPUT));
+    // 图内缩放的模型输入形状可变，交给 CPU 插件执行（GPU 插件不支持动态形状）
+    const bool dynamic_input = model->input("img").get_partial_shape().is_dynamic();
+    models = std::make_unique<ModelCache>(core, model, dynamic_input ? "CPU" : "AUTO:GPU,CPU",
+        ov::AnyMap{ ov::hint::performance_mode(ov::hint::PerformanceMode::THROUGHPUT) },
+        ModelCache::DefaultSizes(), downsample_ratio, blobs.get());
     std::cout << "done!" << std::endl;
     // ========  Step 3: 创建推理请求 =========
-    for (const auto& name : input_to_output) {
-        input_port[name.first] = compiled_model.input(name.first);
-    }
-    infer_request = compiled_model.create_infer_request();
+    batch_size = models->Base().img_port.get_partial_shape()[0].get_length();
+    this->use_model(models->Base().size);
+
+    // 启动耗时：冷启动直接推迟了第一帧
+    auto end = std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::milli> read_elapsed = read_end - start, elapsed = end - start;
+    std::cout << "[INFO] Startup time: " << elapsed.count() << "ms (read model: " << read_elapsed.count()
+        << "ms, compile or import: " << elapsed.count() - read_elapsed.count() << "ms)" << std::endl;
+    MattingMetrics::Get().startup_seconds.Set(elapsed.count() / 1000.0);
+}
+
+std::future<std::unique_ptr<PortraitMatting>> PortraitMatting::CreateAsync(const std::string& model_path,
+    double downsample_ratio,
+    const std::string& blob_dir,
+    const cv::Size& warmup_size,
+    std::function<void(PortraitMatting&)> on_ready)
+{
+    return std::async(std::launch::async, [=]() {
+        auto start = std::chrono::steady_clock::now();
+        std::unique_ptr<PortraitMatting> matte = std::make_unique<PortraitMatting>(model_path, downsample_ratio, blob_dir);
+        matte->Warmup(warmup_size);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "[INFO] Ready in " << elapsed.count() << "ms (compile or import + warm-up)" << std::endl;
+        if (on_ready) on_ready(*matte);
+        return matte;
+        });
+}
+
+void PortraitMatting::Warmup(const cv::Size& frame_size)
+{
+    if (batch_size > 1) return;
+    auto start = std::chrono::steady_clock::now();
+    // ========  Step 1: 选择之后使用的原生尺寸，推理请求与隐藏状态随之创建 =========
+    this->use_model(frame_size.empty() ? models->Base().size : frame_size);
+    if (warmed) return;
+    // 图内缩放的模型接受任意尺寸，按帧尺寸（未知时按 720p）预热
+    cv::Size size = !active->size.empty() ? active->size
+        : !frame_size.empty() ? frame_size : cv::Size(1280, 720);
+    // ========  Step 2: 以全 0 的帧推理一次，隐藏状态清零后与从未推理过一致 =========
+    cv::Mat dummy = cv::Mat::zeros(size, CV_8UC3);
+    cv::Mat input = this->set_input_img(infer_request, *active, dummy);
+    hide_status->Reset();
+    hide_status->Bind(infer_request);
+    infer_request.start_async();
+    infer_request.wait();
+    hide_status->Reset();
+    warmed = true;
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "[INFO] Warm-up inference: " << elapsed.count() << "ms" << std::endl;
 }
 
 void PortraitMatting::IntegrateModel(const std::string& original_model,
-    const std::string& integrated_model)
+    const std::string& integrated_model,
+    const bool resize_in_graph,
+    const bool u8_alpha,
+    const cv::Size& alpha_size,
+    const bool keep_fgr,
+    const ModelCache::ColorFormat color_format)
 {
     // ========  Step 1: read original model =========
     ov::Core core;
     std::shared_ptr<ov::Model> model =
         core.read_model(original_model);
+    const bool yuv = color_format != ModelCache::ColorFormat::BGR;
+    const ov::Dimension batch = model->input("img").get_partial_shape()[0];
+    if (yuv && (resize_in_graph || batch.is_dynamic() || batch.get_length() != 1)) {
+        std::cerr << "[ERROR] YUV input requires a batch size 1 model without in-graph resize." << std::endl;
+        return;
+    }
 
     // ======== Step 2: Preprocessing ================
     ov::preprocess::PrePostProcessor ppp(model);
-    // Declare section of desired application's input format
-    ppp.input("img").tensor()
+    // Declare section of desired application's input format.
+    // NV12 / I420 are single-plane u8 images of shape [1, H * 3 / 2, W, 1], as decoders produce them
+    ov::preprocess::ColorFormat tensor_color = ov::preprocess::ColorFormat::BGR;
+    if (color_format == ModelCache::ColorFormat::NV12)
+        tensor_color = ov::preprocess::ColorFormat::NV12_SINGLE_PLANE;
+    else if (color_format == ModelCache::ColorFormat::I420)
+        tensor_color = ov::preprocess::ColorFormat::I420_SINGLE_PLANE;
+    ov::preprocess::InputTensorInfo& img_tensor = ppp.input("img").tensor()
         .set_element_type(ov::element::u8)
         .set_layout("NHWC")
-        .set_color_format(ov::preprocess::ColorFormat::BGR);
+        .set_color_format(tensor_color);
+    // Accept frames of any size, they are resized to the model size in graph
+    if (resize_in_graph)
+        img_tensor.set_spatial_dynamic_shape();
     // Specify actual model layout
     ppp.input("img").model()
         .set_layout("NHWC");
     // Explicit preprocessing steps. Layout conversion will be done automatically as last step
-    ppp.input("img").preprocess()
+    ov::preprocess::PreProcessSteps& img_steps = ppp.input("img").preprocess()
         .convert_element_type()
-        .convert_color(ov::preprocess::ColorFormat::RGB)
-        //.resize(ov::preprocess::ResizeAlgorithm::RESIZE_LINEAR)
-        .scale(255.0f);
+        .convert_color(ov::preprocess::ColorFormat::RGB);
+    if (resize_in_graph)
+        img_steps.resize(ov::preprocess::ResizeAlgorithm::RESIZE_LINEAR);
+    img_steps.scale(255.0f);
     model = ppp.build();
+    // Record the color format as an extra tensor name of img, so the runtime knows the layout of the planes
+    if (yuv)
+        model->input("img").get_tensor().add_names({ ModelCache::ColorFormatTag(color_format) });
 
-    // ======== Step 3: Save the model ================
+    // ======== Step 3: Postprocessing ================
+    // Resize alp to the frame size (or alpha_size) and quantize to u8 in graph.
+    // Done with a second PrePostProcessor so that the img parameter is already the final one
+    if (u8_alpha) {
+        const ov::Output<ov::Node> img = model->input("img");
+        ov::preprocess::PrePostProcessor post(model);
+        post.output("alp").postprocess()
+            .custom([&img, &alpha_size, yuv](const ov::Output<ov::Node>& alp) {
+                return alpha_to_u8(alp, img, alpha_size, yuv);
+            });
+        model = post.build();
+    }
+    // The runtime composites with alpha only, fgr is needed by the foreground mode
+    if (!keep_fgr)
+        remove_output(model, "fgr");
+
+    // ======== Step 4: Save the model ================
     std::string xml(integrated_model + ".xml");
     std::string bin(integrated_model + ".bin");
     ov::pass::Serialize(xml, bin).run_on_model(model);
 }
 
-inline
-void PortraitMatting::init_hide_status()
+void PortraitMatting::PruneModel(const std::string& original_model,
+    const std::string& pruned_model)
+{
+    // ========  Step 1: read original model =========
+    ov::Core core;
+    std::shared_ptr<ov::Model> model =
+        core.read_model(original_model);
+
+    // ======== Step 2: Remove the fgr output ================
+    // Serialization only visits ops reachable from the remaining results,
+    // so the fgr-only part of the graph is dropped with it
+    if (!remove_output(model, "fgr")) {
+        std::cout << "[WARNING] The model has no fgr output, nothing to prune." << std::endl;
+    }
+
+    // ======== Step 3: Save the model ================
+    std::string xml(pruned_model + ".xml");
+    std::string bin(pruned_model + ".bin");
+    ov::pass::Serialize(xml, bin).run_on_model(model);
+}
+
+bool PortraitMatting::check_foreground(const ModelCache::Entry& entry) const
+{
+    if (entry.has_fgr) return true;
+    std::cerr << "[ERROR] Foreground mode requires a model with the fgr output, "
+        << "integrate it with --keep-fgr." << std::endl;
+    return false;
+}
+
+void PortraitMatting::SetDownsampleRatio(double downsample_ratio)
+{
+    if (!models->SetDownsampleRatio(downsample_ratio)) return;
+    std::cout << "[INFO] Downsample ratio: " << models->DownsampleRatio() << std::endl;
+    // 隐藏状态的形状随比例改变，为当前尺寸在新比例下的模型重新创建推理请求与隐藏状态
+    const cv::Size frame_size = active->size;
+    active = nullptr;
+    this->use_model(frame_size);
+}
+
+std::unique_ptr<MattingSession> PortraitMatting::CreateSession(const cv::Size& frame_size)
 {
-    for (const auto& name : input_to_output) {
-        if (name.first == "img") continue;
-        infer_request.set_tensor(name.first, ov::Tensor(input_port.at(name.first).get_element_type(),
-            input_port.at(name.first).get_shape(), init_status_handler.at(name.first).data()));
+    if (batch_size > 1) {
+        std::cerr << "[ERROR] Matting sessions require a model exported with batch size 1." << std::endl;
+        return nullptr;
     }
+    return std::make_unique<MattingSession>(*models, frame_size);
+}
+
+void PortraitMatting::StartTrace(const std::string& trace_path)
+{
+    this->trace_path = trace_path;
+    FrameTracer::Instance().Start();
+}
+
+bool PortraitMatting::StopTrace()
+{
+    if (trace_path.empty()) return true;
+    FrameTracer& tracer = FrameTracer::Instance();
+    tracer.Stop();
+    if (!tracer.Write(trace_path)) {
+        std::cerr << "[ERROR] Can not save trace to: " << trace_path << std::endl;
+        return false;
+    }
+    std::cout << "[INFO] Trace: " << trace_path << "  (open in chrome://tracing or ui.perfetto.dev)" << std::endl;
+    if (tracer.DroppedCount() > 0) {
+        std::cout << "[WARNING] " << tracer.DroppedCount() << " oldest spans were overwritten, only the last "
+            << FrameTracer::ring_capacity << " spans of each thread are kept." << std::endl;
+    }
+    trace_path.clear();
+    return true;
+}
+
+std::unique_ptr<AlphaPropagator> PortraitMatting::make_propagator(const std::string& mode) const
+{
+    if (keyframe_interval > 1 && mode == "foreground") {
+        std::cout << "[WARNING] Keyframe mode is disabled in foreground mode." << std::endl;
+        return std::make_unique<AlphaPropagator>(1);
+    }
+    return std::make_unique<AlphaPropagator>(keyframe_interval);
+}
+
+std::unique_ptr<RoiTracker> PortraitMatting::make_roi_tracker(const std::string& mode)
+{
+    int interval = roi_interval;
+    if (interval > 0 && mode == "foreground") {
+        std::cout << "[WARNING] ROI mode is disabled in foreground mode." << std::endl;
+        interval = 0;
+    }
+    if (interval > 0 && active->size.empty()) {
+        std::cout << "[WARNING] ROI mode is disabled: the model resizes input in graph." << std::endl;
+        interval = 0;
+    }
+    return std::make_unique<RoiTracker>(*models, interval);
+}
+
+void PortraitMatting::use_model(const cv::Size& frame_size)
+{
+    ModelCache::Entry& entry = models->Get(frame_size);
+    if (&entry == active) return;
+    active = &entry;
+    infer_request = entry.compiled_model.create_infer_request();
+    warmed = false;
+    hide_status = std::make_unique<RecurrentState>(entry.compiled_model);
 }
 
 inline
-void PortraitMatting::set_input_img(cv::Mat& mat)
+cv::Mat PortraitMatting::set_input_img(ov::InferRequest& request,
+    const ModelCache::Entry& entry,
+    const cv::Mat& mat)
 {
-    // ========  Step 1: 检查输入大小 =========
+    // ========  Step 1: 分配输入缓冲区并创建指向它的张量，图内缩放的模型按帧的实际尺寸分配 =========
     //cv::cvtColor(img_mat, img_mat, cv::COLOR_BGR2RGB);
     //img_mat.convertTo(img_mat, CV_32FC3, 1.0f / 255.0f);
-    int model_width = input_port.at("img").get_shape().at(2),
-        model_height = input_port.at("img").get_shape().at(1);
-    if (input_height != model_height || input_width != model_width) {
-        cv::resize(mat, mat, cv::Size(model_width, model_height));
-    }
-    // ========  Step 2: 设置 img 输入 =========
-    infer_request.set_tensor("img", ov::Tensor(input_port.at("img").get_element_type(),
-        input_port.at("img").get_shape(), mat.data));
+    // 单张图片只用一次，直接分配一块缓冲区，不创建输入环（与 make_input_ring 的布局一致）
+    const ov::Shape shape = input_shape(entry, mat.size());
+    const int channels = entry.color == ModelCache::ColorFormat::BGR ? 3 : 1;
+    const int cols = static_cast<int>(shape[shape.size() - 2]);
+    const int rows = static_cast<int>(ov::shape_size(shape) / (static_cast<size_t>(cols) * channels));
+    cv::Mat input(rows, cols, CV_MAKETYPE(entry.img_port.get_element_type() == ov::element::u8 ? CV_8U : CV_32F, channels));
+    ov::Tensor tensor(entry.img_port.get_element_type(), shape, input.data);
+    // ========  Step 2: 缩放到张量的内存中，与原生尺寸一致或模型在图内缩放时直接拷贝 =========
+    fill_input(mat, input, entry.color);
+    // ========  Step 3: 设置 img 输入，张量的内存由返回的 cv::Mat 持有 =========
+    request.set_tensor(entry.img_port, tensor);
+    return input;
 }
 
 inline
-void PortraitMatting::set_input_status()
+cv::Mat PortraitMatting::generate_matting(ov::Tensor& alp_tensor,
+    cv::Mat& original_mat,
+    const bool merge_mode,
+    const ov::Tensor* fgr_tensor,
+    Background* background,
+    cv::Mat* result_buffer)
 {
-    for (const auto& name : input_to_output) {
-        if (name.first == "img") continue;
-        infer_request.set_tensor(name.first, infer_request.get_tensor(name.second));
+    // ========  Step 0: [可选] 使用模型预测的前景代替原图 =========
+    if (fgr_tensor != nullptr) {
+        original_mat = foreground_bgr(*fgr_tensor, original_mat.size());
     }
+    // ========  Step 1: 从输出 tensor 获取 alpha 结果（[N, 1, H, W]，f32 或图内量化的 u8） =========
+    return this->generate_matting(alpha_mat(alp_tensor), original_mat, merge_mode, background, result_buffer);
 }
 
 inline
-cv::Mat PortraitMatting::generate_matting(ov::Tensor& alp_tensor,
+cv::Mat PortraitMatting::generate_matting(cv::Mat alp_mat,
     cv::Mat& original_mat,
-    const bool merge_mode)
+    const bool merge_mode,
+    Background* background,
+    cv::Mat* result_buffer)
 {
-    // ========  Step 1: 从输出 tensor 获取 alpha 结果 =========
-    float* alp_ptr = alp_tensor.data<float>();
-    cv::Mat alp_mat(input_port.at("img").get_shape().at(1),
-        input_port.at("img").get_shape().at(2), CV_32FC1, alp_ptr);
-    cv::resize(alp_mat, alp_mat, cv::Size(input_width, input_height));
-    // ========  Step 2: [可选] 将前景通过 alpha 融合到黑色背景 =========
+    // 图内量化的 u8 alpha 通常已是原图尺寸，否则在此缩放
+    if (alp_mat.type() == CV_8UC1 && alp_mat.size() != original_mat.size()) {
+        cv::resize(alp_mat, alp_mat, original_mat.size());
+    }
+    // ========  Step 2: [可选] 缩放 alpha 并将前景融合到背景（默认黑色），一次遍历直接写回原图 =========
     if (merge_mode) {
-        cv::Mat alp3_mat;
-        std::vector<cv::Mat> alp_vec = { alp_mat, alp_mat, alp_mat };
-        cv::merge(alp_vec, alp3_mat);
-        original_mat.convertTo(original_mat, CV_32FC3);
-        cv::multiply(original_mat, alp3_mat, original_mat);
-        original_mat.convertTo(original_mat, CV_8UC3);
+        if (background != nullptr)
+            background->Composite(alp_mat, original_mat, original_mat);
+        else
+            matting::CompositeOnBlack(alp_mat, original_mat, original_mat);
         return original_mat;
     }
-    // ========  Step 3: 保存 alpha 结果 =========
-    alp_mat.convertTo(alp_mat, CV_8UC1, 255);
-    return alp_mat;
+    // ========  Step 3: 缩放并量化 alpha 结果 =========
+    if (alp_mat.type() == CV_8UC1) {
+        return alp_mat;
+    }
+    cv::Mat local_result;
+    cv::Mat& result = result_buffer != nullptr ? *result_buffer : local_result;
+    DetachShared(result);
+    result.create(original_mat.size(), CV_8UC1);
+    matting::AlphaToMask(alp_mat, result);
+    return result;
 }
 
 
@@ -120,28 +590,39 @@ void PortraitMatting::ImageMatting(const std::string& image_path,
     const std::string& output_path,
     const std::string& mode)
 {
+    if (batch_size > 1) {
+        std::cerr << "[ERROR] Image matting requires a model exported with batch size 1." << std::endl;
+        return;
+    }
     // ========  Step 1: 读取输入图片 =========
     cv::Mat mat = cv::imread(image_path);
     if (mat.empty()) {
         std::cerr << "[ERROR] Can not read image from: " << image_path << std::endl;
         return;
     }
-    input_height = mat.rows;
-    input_width = mat.cols;
 
     // ========  Step 2: 前处理+推理+后处理 =========
     std::cout << "[INFO] Processing image: " << image_path << std::endl;
     auto start = std::chrono::system_clock::now();
-    // 初始化隐藏状态
-    this->init_hide_status();
-    // 前处理
-    this->set_input_img(mat);
+    // 选择原生尺寸的模型并初始化隐藏状态
+    this->use_model(mat.size());
+    const bool foreground_mode = mode == "foreground";
+    if (foreground_mode && !this->check_foreground(*active)) return;
+    Background background(mode, background_path);
+    if (!background.IsOpened()) return;
+    hide_status->Reset();
+    // 前处理（缩放到输入张量中，mat 保持原始尺寸用于后处理）
+    cv::Mat input = this->set_input_img(infer_request, *active, mat);
     // 推理
+    hide_status->Bind(infer_request);
     infer_request.start_async();
     infer_request.wait();
+    hide_status->Advance();
     // 后处理
-    ov::Tensor alp_tensor = infer_request.get_tensor("alp");
-    cv::Mat result = this->generate_matting(alp_tensor, mat, mode == "merge");
+    ov::Tensor alp_tensor = infer_request.get_tensor(active->alp_port);
+    ov::Tensor fgr_tensor = foreground_mode ? infer_request.get_tensor(active->fgr_port) : ov::Tensor();
+    cv::Mat result = this->generate_matting(alp_tensor, mat, mode != "alpha",
+        foreground_mode ? &fgr_tensor : nullptr, &background);
     // 推理时间计算
     auto end = std::chrono::system_clock::now();
     std::chrono::duration<double, std::milli> elapsed = end - start; // 前处理 + 推理 + 后处理 耗时（ms）
@@ -149,17 +630,7 @@ void PortraitMatting::ImageMatting(const std::string& image_path,
         << elapsed.count() << std::endl;
 
     // ========  Step 3: 保存推理结果 =========
-    try {
-        if (!cv::imwrite(output_path, result)) {
-            std::cerr << "[ERROR] Can not save image to: " << output_path
-                << "  Check if directory exists." << std::endl;
-            return;
-        }
-    }
-    catch (const cv::Exception& ex) {
-        std::cerr << "[ERROR] Exception save image to JPG format: " << ex.what() << std::endl;
-        return;
-    }
+    if (!write_image(output_path, result)) return;
     std::cout << "[INFO] Successful!" << std::endl
         << "[INFO] Output: " << output_path << std::endl;
 }
@@ -169,7 +640,12 @@ void PortraitMatting::VideoMatting(const std::string& video_path,
     const std::string& mode,
     double writer_fps)
 {
-    bool merge_mode = mode == "merge"; // 输出模式是否为融合图
+    if (batch_size > 1) {
+        this->BatchVideoMatting({ video_path }, { output_path }, mode);
+        return;
+    }
+    bool merge_mode = mode != "alpha"; // 输出模式是否为融合图
+    const bool foreground_mode = mode == "foreground"; // 是否使用模型预测的前景
 
     // ========  Step 1: 创建一个从输入视频捕获帧的 capture =========
     cv::VideoCapture capture = cv::VideoCapture(video_path);
@@ -178,128 +654,1157 @@ void PortraitMatting::VideoMatting(const std::string& video_path,
         return;
     }
     // ========  Step 2: 获取输入相关信息 =========
-    input_width = static_cast<int>(capture.get(cv::CAP_PROP_FRAME_WIDTH));
-    input_height = static_cast<int>(capture.get(cv::CAP_PROP_FRAME_HEIGHT));
-    if (writer_fps == NULL)
+    int input_width = static_cast<int>(capture.get(cv::CAP_PROP_FRAME_WIDTH));
+    int input_height = static_cast<int>(capture.get(cv::CAP_PROP_FRAME_HEIGHT));
+    if (writer_fps == 0.0)
         writer_fps = capture.get(cv::CAP_PROP_FPS);
     double frame_count = capture.get(cv::CAP_PROP_FRAME_COUNT);
     //int ex = static_cast<int>(capture.get(cv::CAP_PROP_FOURCC));
     int ex = cv::VideoWriter::fourcc('m', 'p', '4', 'v');
+    // 选择与视频尺寸最接近的原生尺寸的模型
+    this->use_model(cv::Size(input_width, input_height));
+    if (foreground_mode && !this->check_foreground(*active)) return;
+    // NV12 输入的模型：解码器能输出原生的 NV12 平面时不再转换为 BGR，尺寸一致时直接解码到输入张量。
+    // 不能输出时（例如 FFmpeg 后端）仍解码为 BGR，在主机端转换；I420 不是解码器常见的输出格式，总是在主机端转换
+    const bool native_yuv = active->color == ModelCache::ColorFormat::NV12
+        && probe_nv12(capture, video_path, cv::Size(input_width, input_height));
+    if (!capture.isOpened()) {
+        std::cerr << "[ERROR] Can not open video from: " << video_path << std::endl;
+        return;
+    }
+    if (active->color == ModelCache::ColorFormat::NV12) {
+        std::cout << "[INFO] NV12 input: " << (native_yuv ? "decoded natively" : "converted from BGR on host") << std::endl;
+    }
+    // 背景只在后处理线程中使用，视频背景由其自身的预取线程解码
+    Background background(mode, background_path);
+    if (!background.IsOpened()) return;
+    // 关键帧模式的传播器、静止画面检测与 ROI 跟踪只在推理阶段使用
+    std::unique_ptr<AlphaPropagator> propagator = this->make_propagator(mode);
+    ChangeGate gate(change_threshold);
+    std::unique_ptr<RoiTracker> roi = this->make_roi_tracker(mode);
     // ========  Step 3: 创建一个保存抠图结果 alpha 的 writer =========
-    cv::VideoWriter alpha_writer = cv::VideoWriter(output_path, ex, writer_fps,
-        cv::Size(input_width, input_height), merge_mode);
+    // 开启断点时输出分块写入；从断点继续时恢复隐藏状态与解码位置，从下一个分块开始写入
+    const bool checkpointing = checkpoint_interval > 0;
+    const std::string checkpoint_path = output_path + ".ckpt";
+    const cv::Size frame_size(input_width, input_height);
+    Checkpoint checkpoint;
+    checkpoint.video_path = video_path;
+    checkpoint.frame_size = frame_size;
+    hide_status->Reset();
+    if (checkpointing && resume) {
+        Checkpoint saved;
+        if (!saved.Read(checkpoint_path)) {
+            std::cout << "[INFO] No checkpoint at: " << checkpoint_path << ", starting from the first frame." << std::endl;
+        }
+        else if (!saved.Matches(video_path, frame_size)) {
+            std::cerr << "[WARNING] Checkpoint " << checkpoint_path
+                << " belongs to another input, starting from the first frame." << std::endl;
+        }
+        else if (!hide_status->Restore(saved.state)) {
+            std::cerr << "[WARNING] Recurrent state in " << checkpoint_path
+                << " does not match the model, starting from the first frame." << std::endl;
+        }
+        else if (saved.next_frame > 0 && !capture.set(cv::CAP_PROP_POS_FRAMES, static_cast<double>(saved.next_frame))) {
+            std::cerr << "[WARNING] Can not seek to frame " << saved.next_frame
+                << ", starting from the first frame." << std::endl;
+            hide_status->Reset();
+        }
+        else {
+            checkpoint = std::move(saved);
+            std::cout << "[INFO] Resuming from frame " << checkpoint.next_frame
+                << " (" << checkpoint.chunks << " chunks written)." << std::endl;
+        }
+    }
+    cv::VideoWriter alpha_writer = cv::VideoWriter(
+        checkpointing ? sibling_path(output_path, ".chunk", checkpoint.chunks) : output_path,
+        ex, writer_fps, frame_size, merge_mode);
     if (!alpha_writer.isOpened()) {
         std::cerr << "[ERROR] Can not save video to: " << output_path
             << "  Check if directory exists." << std::endl;
         return;
     }
 
-    // ========  Step 4: matting loop 处理视频流 =========
-    cv::Mat mat, result;
+    // ========  Step 4: matting pipeline 处理视频流 =========
+    // 解码 -> [decoded] -> 推理 -> [inferred] -> 后处理 -> [matted] -> 编码 -> [recycled] -> 解码
+    BoundedQueue<PipelineFrame> decoded(pipeline_depth), inferred(pipeline_depth), matted(pipeline_depth);
+    // 写出后的帧归还给解码线程，帧的缓冲区（原图、缩放后的输入、alpha 结果）在之后的帧中复用
+    BoundedQueue<PipelineFrame> recycled(pipeline_frames);
+    for (size_t i = 0; i < pipeline_frames; ++i) recycled.push(PipelineFrame());
+    // 解码线程直接写入输入环中的张量，推理阶段只负责绑定
+    std::unique_ptr<FramePool> input_ring = make_input_ring(*active, frame_size);
+    // 只输出 alpha 时原图只用于确定尺寸，不需要 BGR；合成与画面分析仍需要 BGR 原图，在解码线程转换
+    const bool need_bgr = merge_mode || gate.Enabled() || propagator->Enabled() || roi->Enabled();
+    const ov::Output<const ov::Node> alp_port = active->alp_port;
+    const bool static_alpha = alp_port.get_partial_shape().is_static();
+    // 形状固定的 alp 输出写入池中的缓冲区，缓冲区在没有帧引用后复用
+    std::unique_ptr<FramePool> alpha_pool = static_alpha
+        ? std::make_unique<FramePool>(alp_port.get_element_type(), alp_port.get_shape()) : nullptr;
+    // 形状可变的 alp（此时 alpha_pool 为空）与 foreground 模式的 fgr 推理后拷贝到池中的缓冲区，池在第一次拷贝时创建
+    std::unique_ptr<FramePool> fgr_pool;
+    std::atomic<int> written(0);
+    // 最后一个分块是否还没有写入任何帧（视频恰好在断点处结束）
+    bool last_chunk_empty = false;
+    // 下一个分块无法创建时编码线程停止流水线；保存失败的断点个数。两者都只由编码线程写入
+    bool chunk_failed = false;
+    int checkpoint_failures = 0;
+    // Debug 构建：每一帧都被使用过之后，统计逐帧的帧缓冲分配次数
+    const int steady_frames = static_cast<int>(2 * pipeline_frames);
+    uint64_t steady_allocations = 0;
+    int decoded_count = 0;
+    MattingMetrics& metrics = MattingMetrics::Get();
+    std::chrono::steady_clock::time_point pipeline_start = std::chrono::steady_clock::now(), first_frame;
 
-    // 累计 前处理 + 推理 + 后处理 耗时（ms)
-    double progress = 0, diff = 100.0 / frame_count;
+    double diff = 100.0 / frame_count, progress = diff * checkpoint.next_frame;
     std::cout << "[INFO] Processing video: " << video_path << " [  0%]";
     auto start = std::chrono::system_clock::now();
-    // ========  Step 4-0: 初始化隐藏状态 =========
-    this->init_hide_status();
-    auto end = std::chrono::system_clock::now();
-    std::chrono::duration<double, std::milli> elapsed = end - start;
 
-    while (capture.read(mat)) {
-        if (mat.empty()) break;
-        start = std::chrono::system_clock::now();
+    // 阶段线程中的异常（解码、颜色转换、合成、编码的 cv::Exception 等）不能逃出 std::thread：
+    // 记录第一个异常并关闭所有队列让其他阶段退出，shutdown 之后在调用线程重新抛出
+    std::exception_ptr stage_error;
+    std::mutex error_mutex;
+    auto fail = [&]() {
+        {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!stage_error) stage_error = std::current_exception();
+        }
+        decoded.close();
+        inferred.close();
+        matted.close();
+        recycled.close();
+    };
 
-        // ========  Step 4-1: 前处理 =========
-        this->set_input_img(mat); // 前处理，设置输入 Tensor
-        // ========  Step 4-2: 推理 =========
-        infer_request.start_async();
-        infer_request.wait();
-        // ========  Step 4-3: 后处理 =========
-        ov::Tensor alp_tensor = infer_request.get_tensor("alp");
-        result = this->generate_matting(alp_tensor, mat, merge_mode);
-        // ========  Step 4-4: 设置下一次推理的隐藏状态 =========
-        this->set_input_status();
+    // ========  Step 4-1: 解码线程 =========
+    std::thread decoder([&]() {
+        try {
+            FrameTracer::Instance().NameThread("decoder");
+            PipelineFrame frame;
+            // 原生 NV12 的解码目标：直接解码时是输入张量，否则是解码线程自己的缓冲区
+            cv::Mat raw;
+            for (int index = static_cast<int>(checkpoint.next_frame);; ++index) {
+                // 取回一帧已写出的帧，所有帧都在流水线中时等待编码线程归还
+                if (!recycled.pop(frame)) break;
+                FrameTracer::Span span("capture", index);
+                if (!read_frame(capture, *input_ring, native_yuv ? raw : frame.original, frame.input, frame.input_tensor))
+                    break;
+                frame.index = index;
+                ++decoded_count;
+                metrics.frames_in.Add();
+                // 前处理中的缩放在解码线程完成，直接写入输入张量，推理阶段只负责绑定
+                span.Next("resize");
+                if (native_yuv && raw.data == frame.input.data) {
+                    // NV12 平面已在输入张量中，不需要前处理；原图按需转换为 BGR，否则只是 Y 平面的图像头
+                    raw.release();
+                    if (need_bgr) {
+                        DetachShared(frame.original);
+                        cv::cvtColor(frame.input, frame.original, cv::COLOR_YUV2BGR_NV12);
+                    }
+                    else {
+                        frame.original = frame.input.rowRange(0, frame_size.height);
+                    }
+                }
+                else {
+                    // 尺寸与模型不同的 NV12 帧先转换为 BGR；其他帧是 BGR，交换缓冲区，raw 接手原图原来的缓冲区
+                    if (native_yuv && is_nv12(raw, frame_size)) {
+                        DetachShared(frame.original);
+                        cv::cvtColor(raw, frame.original, cv::COLOR_YUV2BGR_NV12);
+                    }
+                    else if (native_yuv) {
+                        std::swap(raw, frame.original);
+                    }
+                    fill_input(frame.original, frame.input, active->color);
+                }
+                span.End();
+                if (!decoded.push(std::move(frame))) break;
+            }
+            decoded.close();
+        }
+        catch (...) {
+            fail();
+        }
+        });
+    // ========  Step 4-3: 后处理线程 =========
+    std::thread postprocessor([&]() {
+        try {
+            FrameTracer::Instance().NameThread("postprocessor");
+            PipelineFrame frame;
+            while (inferred.pop(frame)) {
+                metrics.inferred_depth.Set(static_cast<double>(inferred.size()));
+                FrameTracer::Span span("generate_matting", frame.index);
+                frame.result = !frame.use_host_alpha
+                    ? this->generate_matting(frame.alp, frame.original, merge_mode,
+                        foreground_mode ? &frame.fgr : nullptr, &background, &frame.result)
+                    : this->generate_matting(frame.host_alpha, frame.original, merge_mode, &background, &frame.result);
+                span.End();
+                if (!matted.push(std::move(frame))) break;
+            }
+            matted.close();
+        }
+        catch (...) {
+            fail();
+        }
+        });
+    // ========  Step 4-4: 编码线程 =========
+    std::thread encoder([&]() {
+        try {
+            FrameTracer::Instance().NameThread("encoder");
+            PipelineFrame frame;
+            while (matted.pop(frame)) {
+                metrics.matted_depth.Set(static_cast<double>(matted.size()));
+                FrameTracer::Span span("write", frame.index);
+                alpha_writer.write(frame.result);
+                last_chunk_empty = false;
+                if (written == 0) {
+                    first_frame = std::chrono::steady_clock::now();
+                    std::chrono::duration<double> first_elapsed = first_frame - pipeline_start;
+                    metrics.first_frame_seconds.Set(first_elapsed.count());
+                }
+                ++written;
+                if (written == steady_frames) steady_allocations = AllocationCounter::Count();
+                metrics.frames_out.Add();
+                progress += diff;
+                printf("\b\b\b\b\b\b[%3.0f%%]", progress);
+                // 本帧及之前的输出已写入分块：关闭该分块，保存断点，再开始下一个分块
+                if (frame.checkpoint) {
+                    span.Next("checkpoint");
+                    alpha_writer.release();
+                    checkpoint.next_frame = frame.index + 1;
+                    checkpoint.chunks += 1;
+                    checkpoint.state = std::move(*frame.checkpoint);
+                    if (!checkpoint.Write(checkpoint_path)) ++checkpoint_failures;
+                    const std::string chunk = sibling_path(output_path, ".chunk", checkpoint.chunks);
+                    if (!alpha_writer.open(chunk, ex, writer_fps, frame_size, merge_mode)) {
+                        // 之后的帧无处写入：停止流水线，保留已完成的分块与最近的断点
+                        std::cerr << std::endl << "[ERROR] Can not save video to: " << chunk << std::endl;
+                        chunk_failed = true;
+                        decoded.close();
+                        inferred.close();
+                        matted.close();
+                        break;
+                    }
+                    last_chunk_empty = true;
+                }
+                // 释放与其他帧共享的数据，保留本帧自己的缓冲区，归还给解码线程
+                span.Next("recycle");
+                frame.alp = ov::Tensor();
+                frame.fgr = ov::Tensor();
+                frame.alp_buffer.release();
+                frame.fgr_buffer.release();
+                frame.checkpoint.reset();
+                // 结果只是别处内存的图像头时丢弃：融合模式下是原图；u8 alpha 时是 host_alpha 或 alp 张量本身。
+                // 否则下一次使用该帧时 host_alpha 仍被 result 引用，每帧都会重新分配整帧的缓冲区
+                if (frame.result.data == frame.original.data || frame.result.data == frame.host_alpha.data
+                    || frame.result.u == nullptr)
+                    frame.result.release();
+                if (!recycled.push(std::move(frame))) break;
+            }
+        }
+        catch (...) {
+            fail();
+        }
+        });
+    auto shutdown = [&]() {
+        decoded.close();
+        inferred.close();
+        matted.close();
+        recycled.close();
+        decoder.join();
+        postprocessor.join();
+        encoder.join();
+    };
 
-        // 累加耗时
-        end = std::chrono::system_clock::now();
-        elapsed += end - start;
-        progress += diff;
-        printf("\b\b\b\b\b\b[%3.0f%%]", progress);
+    // ========  Step 4-2: 推理阶段（当前线程），隐藏状态逐帧按顺序传递 =========
+    try {
+        FrameTracer::Instance().NameThread("inference");
+        PipelineFrame frame;
+        // 上一次生成的 alpha（与 fgr），各帧的输出张量相互独立，静止帧共享只读
+        ov::Tensor last_alp, last_fgr;
+        cv::Mat last_alp_buffer, last_fgr_buffer, last_host_alpha;
+        // 每隔 checkpoint_interval 帧附带一份处理该帧之后的隐藏状态，由编码线程在写入该帧后保存
+        auto push = [&](PipelineFrame& inferred_frame) {
+            // 之后的阶段不再需要输入张量，尽早归还给输入环；直接解码的帧仍由 original 持有
+            inferred_frame.input.release();
+            inferred_frame.input_tensor = ov::Tensor();
+            if (checkpointing && (inferred_frame.index + 1) % checkpoint_interval == 0)
+                inferred_frame.checkpoint = std::make_shared<RecurrentState::Snapshot>(hide_status->Save());
+            return inferred.push(std::move(inferred_frame));
+        };
+        while (decoded.pop(frame)) {
+            metrics.decoded_depth.Set(static_cast<double>(decoded.size()));
+            // 静止画面：复用上一次生成的 alpha，跳过推理
+            FrameTracer::Span span("change_gate", frame.index);
+            if (gate.Unchanged(frame.original)) {
+                span.End();
+                metrics.skipped_static.Add();
+                frame.alp = last_alp;
+                frame.alp_buffer = last_alp_buffer;
+                frame.fgr = last_fgr;
+                frame.fgr_buffer = last_fgr_buffer;
+                frame.use_host_alpha = !last_host_alpha.empty();
+                if (frame.use_host_alpha) frame.host_alpha = last_host_alpha;
+                if (!push(frame)) break;
+                continue;
+            }
+            // 关键帧模式：运动补偿可靠时由上一关键帧传播 alpha，跳过推理
+            // ROI 模式：只对人物所在的区域推理，alpha 贴回整帧
+            // 静止画面的强制刷新直接整帧推理，不能由传播或 ROI 代替
+            span.Next("propagate");
+            DetachShared(frame.host_alpha);
+            const bool refresh = gate.ForcedRefresh();
+            const bool propagated = !refresh && propagator->Propagate(frame.original, frame.host_alpha);
+            span.Next("roi_infer");
+            if (propagated || (!refresh && roi->Infer(frame.original, frame.host_alpha))) {
+                if (!propagated) propagator->SetKeyframe(frame.original, frame.host_alpha);
+                frame.use_host_alpha = true;
+                last_host_alpha = frame.host_alpha;
+                span.End();
+                (propagated ? metrics.skipped_propagated : metrics.inferred_roi).Add();
+                if (!push(frame)) break;
+                continue;
+            }
+            span.Next("set_input_img");
+            infer_request.set_tensor(active->img_port, frame.input_tensor);
+            // 从 ROI 推理回到整帧推理：整帧的隐藏状态停在多帧之前，且来自不同的视野，清零
+            if (roi->SinceFull() > 0) hide_status->Reset();
+            // 每帧的 alp 写入池中独立的缓冲区，避免后处理读取时被下一帧的推理覆盖
+            if (static_alpha) {
+                frame.alp_buffer = alpha_pool->Acquire(&frame.alp);
+                infer_request.set_tensor(alp_port, frame.alp);
+            }
+            span.Next("bind_state");
+            hide_status->Bind(infer_request);
+            span.Next("start_async");
+            auto infer_start = std::chrono::steady_clock::now();
+            infer_request.start_async();
+            span.Next("wait");
+            infer_request.wait();
+            std::chrono::duration<double> infer_elapsed = std::chrono::steady_clock::now() - infer_start;
+            metrics.inference_seconds.Observe(infer_elapsed.count());
+            metrics.inferred_full.Add();
+            hide_status->Advance();
+            span.Next("update");
+            // 形状可变的输出（图内缩放到帧尺寸）推理后才能确定形状，拷贝到池中的缓冲区
+            if (!static_alpha)
+                frame.alp = pooled_copy(infer_request.get_tensor(alp_port), alpha_pool, frame.alp_buffer);
+            if (foreground_mode)
+                frame.fgr = pooled_copy(infer_request.get_tensor(active->fgr_port), fgr_pool, frame.fgr_buffer);
+            propagator->SetKeyframe(frame.original, alpha_mat(frame.alp));
+            roi->Update(alpha_mat(frame.alp), frame.original.size());
+            frame.use_host_alpha = false;
+            last_alp = frame.alp;
+            last_alp_buffer = frame.alp_buffer;
+            last_fgr = frame.fgr;
+            last_fgr_buffer = frame.fgr_buffer;
+            last_host_alpha = cv::Mat();
+            span.End();
+            if (!push(frame)) break;
+        }
+        inferred.close();
+    }
+    catch (...) {
+        shutdown();
+        throw;
+    }
+    shutdown();
+    if (stage_error) std::rethrow_exception(stage_error);
+    // 解码后没有写入的帧（某个阶段提前结束）计为丢弃
+    if (decoded_count > written) metrics.frames_dropped.Add(decoded_count - written);
+    metrics.decoded_depth.Set(0);
+    metrics.inferred_depth.Set(0);
+    metrics.matted_depth.Set(0);
 
-        // ========  Step 4-5: 写入输出 =========
-        alpha_writer.write(result);
+    auto end = std::chrono::system_clock::now();
+    std::chrono::duration<double, std::milli> elapsed = end - start;
+    std::cout << "\n[INFO] Decoding + Inference + Post-processing + Encoding time: " << elapsed.count() << "ms" << std::endl;
+    std::cout << "[INFO] Total frame count: " << written << "   Each frame cost: "
+        << (written > 0 ? elapsed.count() / written : 0.0) << "ms" << std::endl;
+    // 第一帧包含流水线的填充与第一次推理的初始化，与稳态分开统计
+    if (written > 1) {
+        std::chrono::duration<double, std::milli> first_elapsed = first_frame - pipeline_start,
+            steady_elapsed = std::chrono::steady_clock::now() - first_frame;
+        std::cout << "[INFO] First frame latency: " << first_elapsed.count() << "ms   Steady state: "
+            << steady_elapsed.count() / (written - 1) << "ms per frame" << std::endl;
+    }
+    if (AllocationCounter::Enabled() && written > steady_frames) {
+        std::cout << "[DEBUG] Frame buffer allocations per steady-state frame: "
+            << static_cast<double>(AllocationCounter::Count() - steady_allocations) / (written - steady_frames)
+            << "   Pooled alpha buffers: " << (alpha_pool ? alpha_pool->Size() : 0) << std::endl;
+    }
+    if (propagator->Enabled()) {
+        std::cout << "[INFO] Keyframes: " << propagator->KeyframeCount()
+            << "   Propagated frames: " << propagator->PropagatedCount() << std::endl;
+    }
+    if (gate.Enabled()) {
+        std::cout << "[INFO] Static frames skipped: " << gate.SkippedCount() << " / "
+            << gate.SkippedCount() + gate.ProcessedCount() << " (" << gate.SkipRatio() * 100 << "%)" << std::endl;
+    }
+    if (roi->Enabled()) {
+        std::cout << "[INFO] ROI frames: " << roi->RoiCount() << "   Full frames: " << roi->FullCount() << std::endl;
     }
-    std::cout << "\n[INFO] Pre-processing + Inference + Post-processing time: " << elapsed.count() << "ms" << std::endl;
-    std::cout << "[INFO] Total frame count: " << frame_count << "   Each frame cost: " << elapsed.count() / frame_count << "ms" << std::endl;
 
     // ========  Step 5: Release =========
     capture.release();
     alpha_writer.release();
+    if (checkpoint_failures > 0) {
+        std::cerr << "[WARNING] " << checkpoint_failures << " checkpoint(s) could not be saved to: "
+            << checkpoint_path << ", --resume restarts from an earlier frame." << std::endl;
+    }
+    if (chunk_failed) {
+        std::cerr << "[ERROR] Stopped at frame " << checkpoint.next_frame << ": the next chunk can not be created. "
+            << "The chunks and the checkpoint are kept, fix the output directory and rerun with --resume." << std::endl;
+        return;
+    }
+
+    // ========  Step 6: [可选] 按顺序拼接分块，完成后删除分块与断点 =========
+    if (checkpointing) {
+        cv::VideoWriter writer(output_path, ex, writer_fps, frame_size, merge_mode);
+        if (!writer.isOpened()) {
+            std::cerr << "[ERROR] Can not save video to: " << output_path
+                << "  Check if directory exists." << std::endl;
+            return;
+        }
+        const int chunk_count = checkpoint.chunks + (last_chunk_empty ? 0 : 1);
+        for (int k = 0; k < chunk_count; ++k) {
+            if (append_video(writer, sibling_path(output_path, ".chunk", k), merge_mode) < 0) {
+                std::cerr << "[ERROR] Can not open chunk " << k << ", keeping the chunks and the checkpoint." << std::endl;
+                return;
+            }
+        }
+        writer.release();
+        std::error_code ec;
+        for (int k = 0; k <= checkpoint.chunks; ++k)
+            std::filesystem::remove(sibling_path(output_path, ".chunk", k), ec);
+        std::filesystem::remove(checkpoint_path, ec);
+    }
     std::cout << "[INFO] Successful!" << std::endl
         << "[INFO] Output: " << output_path << std::endl;
 }
 
+void PortraitMatting::MultiVideoMatting(const std::vector<std::string>& video_paths,
+    const std::vector<std::string>& output_paths,
+    const std::string& mode,
+    size_t jobs)
+{
+    if (video_paths.size() != output_paths.size()) {
+        std::cerr << "[ERROR] The number of videos and outputs does not match." << std::endl;
+        return;
+    }
+    if (batch_size > 1) {
+        this->BatchVideoMatting(video_paths, output_paths, mode);
+        return;
+    }
+    if (mode == "foreground" && !this->check_foreground(models->Base())) return;
+
+    // ========  Step 1: 在共享的编译模型上创建多个推理请求 =========
+    StreamScheduler scheduler(models->Base().compiled_model, jobs);
+    std::cout << "[INFO] Processing " << video_paths.size() << " videos with "
+        << scheduler.StreamCount() << " infer requests." << std::endl;
+
+    // ========  Step 2: 每个推理请求依次领取视频并处理 =========
+    std::mutex log_mutex;
+    std::atomic<int> total_frames(0);
+    auto start = std::chrono::system_clock::now();
+    scheduler.Run(video_paths.size(), [&](ov::InferRequest& request, size_t i) {
+        FrameTracer::Instance().NameThread("stream");
+        auto video_start = std::chrono::system_clock::now();
+        int frames = this->stream_matting(request, video_paths[i], output_paths[i], mode);
+        std::chrono::duration<double, std::milli> video_elapsed = std::chrono::system_clock::now() - video_start;
+        if (frames < 0) return;
+        total_frames += frames;
+
+        std::lock_guard<std::mutex> lock(log_mutex);
+        std::cout << "[INFO] Finished: " << video_paths[i] << "  frames: " << frames
+            << "  time: " << video_elapsed.count() << "ms" << std::endl
+            << "[INFO] Output: " << output_paths[i] << std::endl;
+        });
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::system_clock::now() - start;
+
+    // ========  Step 3: 汇总吞吐 =========
+    std::cout << "[INFO] Total frame count: " << total_frames << "   Total time: " << elapsed.count() << "ms"
+        << "   Aggregate fps: " << (elapsed.count() > 0 ? total_frames * 1000.0 / elapsed.count() : 0.0) << std::endl;
+}
+
+void PortraitMatting::SegmentVideoMatting(const std::string& video_path,
+    const std::string& output_path,
+    const std::string& mode,
+    int segments,
+    int warmup_frames,
+    int start_frame,
+    int end_frame)
+{
+    if (batch_size > 1) {
+        std::cerr << "[ERROR] Segment matting requires a model exported with batch size 1." << std::endl;
+        return;
+    }
+    if (mode == "foreground" && !this->check_foreground(models->Base())) return;
+    const bool merge_mode = mode != "alpha"; // 输出模式是否为融合图
+
+    // ========  Step 1: 确定处理范围，帧数未知时最后一段处理到视频结束 =========
+    cv::VideoCapture capture(video_path);
+    if (!capture.isOpened()) {
+        std::cerr << "[ERROR] Can not open video from: " << video_path << std::endl;
+        return;
+    }
+    const int frame_count = static_cast<int>(capture.get(cv::CAP_PROP_FRAME_COUNT));
+    const double fps = capture.get(cv::CAP_PROP_FPS);
+    const cv::Size frame_size(static_cast<int>(capture.get(cv::CAP_PROP_FRAME_WIDTH)),
+        static_cast<int>(capture.get(cv::CAP_PROP_FRAME_HEIGHT)));
+    capture.release();
+    const int begin = std::max(0, start_frame);
+    int end = end_frame < 0 ? frame_count : end_frame;
+    if (frame_count > 0) end = std::min(end, frame_count);
+    if (end <= begin) {
+        if (frame_count <= 0 && end_frame < 0) {
+            std::cerr << "[ERROR] Can not get the frame count of: " << video_path << std::endl;
+        }
+        else {
+            std::cerr << "[ERROR] Empty frame range [" << begin << ", " << end << ")." << std::endl;
+        }
+        return;
+    }
+    segments = std::max(1, std::min(segments, end - begin));
+
+    // ========  Step 2: 划分时间段，第一段直接写入输出，其余段写入临时文件 =========
+    std::vector<FrameRange> ranges(segments);
+    std::vector<std::string> part_paths(segments);
+    for (int k = 0; k < segments; ++k) {
+        ranges[k].begin = begin + static_cast<int>(static_cast<int64_t>(end - begin) * k / segments);
+        ranges[k].end = begin + static_cast<int>(static_cast<int64_t>(end - begin) * (k + 1) / segments);
+        ranges[k].warmup = warmup_frames;
+        part_paths[k] = k == 0 ? output_path : sibling_path(output_path, ".part", k);
+    }
+    // 帧数可能不准确，未指定结束帧时最后一段处理到视频结束
+    if (end_frame < 0) ranges.back().end = -1;
+    cv::VideoWriter writer(output_path, cv::VideoWriter::fourcc('m', 'p', '4', 'v'), fps, frame_size, merge_mode);
+    if (!writer.isOpened()) {
+        std::cerr << "[ERROR] Can not save video to: " << output_path
+            << "  Check if directory exists." << std::endl;
+        return;
+    }
+
+    // ========  Step 3: 各段在各自的推理请求上并行处理 =========
+    StreamScheduler scheduler(models->Base().compiled_model, segments);
+    std::cout << "[INFO] Processing frames [" << begin << ", " << (end_frame < 0 ? std::string("end") : std::to_string(end))
+        << ") of " << video_path << " in " << segments << " segments on " << scheduler.StreamCount()
+        << " infer requests, " << warmup_frames << " warm-up frames each." << std::endl;
+    std::vector<int> frames(segments, -1);
+    auto start = std::chrono::system_clock::now();
+    scheduler.Run(segments, [&](ov::InferRequest& request, size_t k) {
+        FrameTracer::Instance().NameThread("segment");
+        frames[k] = this->stream_matting(request, video_path, part_paths[k], mode, ranges[k],
+            k == 0 ? &writer : nullptr);
+        });
+
+    // ========  Step 4: 按顺序将其余段追加到输出并删除临时文件 =========
+    int written = std::max(frames[0], 0);
+    bool complete = frames[0] >= 0;
+    for (int k = 1; k < segments; ++k) {
+        const int appended = frames[k] < 0 ? -1 : append_video(writer, part_paths[k], merge_mode);
+        if (appended < 0) {
+            complete = false;
+            continue;
+        }
+        written += appended;
+        std::error_code ec;
+        std::filesystem::remove(part_paths[k], ec);
+    }
+    writer.release();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::system_clock::now() - start;
+
+    if (!complete) {
+        std::cerr << "[ERROR] Some segments failed, the output is incomplete." << std::endl;
+    }
+    std::cout << "[INFO] Total frame count: " << written << "   Total time: " << elapsed.count() << "ms"
+        << "   Aggregate fps: " << (elapsed.count() > 0 ? written * 1000.0 / elapsed.count() : 0.0) << std::endl
+        << "[INFO] Output: " << output_path << std::endl;
+}
+
+void PortraitMatting::MultiImageMatting(const std::vector<std::string>& image_paths,
+    const std::vector<std::string>& output_paths,
+    const std::string& mode,
+    size_t jobs)
+{
+    if (image_paths.size() != output_paths.size()) {
+        std::cerr << "[ERROR] The number of images and outputs does not match." << std::endl;
+        return;
+    }
+    auto start = std::chrono::system_clock::now();
+    size_t saved = 0;
+    if (batch_size > 1) {
+        saved = this->batch_image_matting(image_paths, output_paths, mode, jobs);
+    }
+    else {
+        const bool foreground_mode = mode == "foreground";
+        if (foreground_mode && !this->check_foreground(models->Base())) return;
+
+        // ========  Step 1: 在共享的编译模型上创建多个推理请求 =========
+        StreamScheduler scheduler(models->Base().compiled_model, jobs);
+        std::cout << "[INFO] Processing " << image_paths.size() << " images with "
+            << scheduler.StreamCount() << " infer requests." << std::endl;
+
+        //! 工作线程在某个原生尺寸上的推理请求与隐藏状态
+        struct NativeRequest
+        {
+            ov::InferRequest request;
+            std::unique_ptr<RecurrentState> state;
+        };
+        //! 工作线程在图片之间复用的资源，以其独占的推理请求区分
+        struct Worker
+        {
+            std::map<const ModelCache::Entry*, NativeRequest> requests;
+            std::unique_ptr<Background> background;
+        };
+        std::map<const ov::InferRequest*, Worker> workers;
+        std::mutex workers_mutex, log_mutex;
+        std::atomic<size_t> saved_count(0);
+
+        // ========  Step 2: 每个推理请求依次领取图片，读取、推理并保存 =========
+        scheduler.Run(image_paths.size(), [&](ov::InferRequest& request, size_t i) {
+            Worker* worker = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(workers_mutex);
+                worker = &workers[&request];
+            }
+            if (!worker->background) {
+                FrameTracer::Instance().NameThread("image");
+                worker->background = std::make_unique<Background>(mode, background_path);
+            }
+            if (!worker->background->IsOpened()) return;
+            MattingMetrics& metrics = MattingMetrics::Get();
+            FrameTracer::Span span("capture", static_cast<int>(i));
+            cv::Mat mat = cv::imread(image_paths[i]);
+            if (mat.empty()) {
+                std::lock_guard<std::mutex> lock(log_mutex);
+                std::cerr << "[ERROR] Can not read image from: " << image_paths[i] << std::endl;
+                return;
+            }
+            metrics.frames_in.Add();
+
+            // 选择原生尺寸的模型，原模型尺寸直接使用调度器的推理请求；隐藏状态逐张清零
+            ModelCache::Entry& entry = models->Get(mat.size());
+            NativeRequest& native = worker->requests[&entry];
+            if (!native.state) {
+                native.request = &entry == &models->Base() ? request : entry.compiled_model.create_infer_request();
+                native.state = std::make_unique<RecurrentState>(entry.compiled_model);
+            }
+            native.state->Reset();
+            span.Next("set_input_img");
+            cv::Mat input = this->set_input_img(native.request, entry, mat);
+            span.Next("bind_state");
+            native.state->Bind(native.request);
+            span.Next("start_async");
+            auto infer_start = std::chrono::steady_clock::now();
+            native.request.start_async();
+            span.Next("wait");
+            native.request.wait();
+            std::chrono::duration<double> infer_elapsed = std::chrono::steady_clock::now() - infer_start;
+            metrics.inference_seconds.Observe(infer_elapsed.count());
+            metrics.inferred_full.Add();
+
+            span.Next("generate_matting");
+            ov::Tensor alp_tensor = native.request.get_tensor(entry.alp_port);
+            ov::Tensor fgr_tensor = foreground_mode ? native.request.get_tensor(entry.fgr_port) : ov::Tensor();
+            cv::Mat result = this->generate_matting(alp_tensor, mat, mode != "alpha",
+                foreground_mode ? &fgr_tensor : nullptr, worker->background.get());
+            span.Next("write");
+            if (!write_image(output_paths[i], result)) return;
+            metrics.frames_out.Add();
+            ++saved_count;
+            });
+        saved = saved_count;
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::system_clock::now() - start;
+
+    // ========  Step 3: 汇总吞吐 =========
+    std::cout << "[INFO] Saved images: " << saved << "/" << image_paths.size()
+        << "   Total time: " << elapsed.count() << "ms"
+        << "   Images per second: " << (elapsed.count() > 0 ? saved * 1000.0 / elapsed.count() : 0.0) << std::endl;
+}
+
+size_t PortraitMatting::batch_image_matting(const std::vector<std::string>& image_paths,
+    const std::vector<std::string>& output_paths,
+    const std::string& mode,
+    size_t jobs)
+{
+    const bool merge_mode = mode != "alpha"; // 输出模式是否为融合图
+    if (mode == "foreground") {
+        std::cerr << "[ERROR] Foreground mode is not supported with batched inference." << std::endl;
+        return 0;
+    }
+    if (models->Base().size.empty()) {
+        std::cerr << "[ERROR] Batched inference requires a model with a static input size." << std::endl;
+        return 0;
+    }
+
+    // ========  Step 1: 每个工作线程一个 batch 推理请求 =========
+    size_t worker_count = StreamScheduler::OptimalRequests(models->Base().compiled_model, jobs);
+    size_t batches = (image_paths.size() + batch_size - 1) / batch_size;
+    worker_count = std::max<size_t>(std::min(worker_count, batches), 1);
+    std::cout << "[INFO] Processing " << image_paths.size() << " images with " << worker_count
+        << " infer requests of batch size " << batch_size << "." << std::endl;
+
+    std::atomic<size_t> next_job(0), saved(0);
+    std::mutex log_mutex;
+    auto worker = [&]() {
+        FrameTracer::Instance().NameThread("batch");
+        MattingMetrics& metrics = MattingMetrics::Get();
+        BatchedStreams batch(models->Base().compiled_model);
+        Background background(mode, background_path);
+        if (!background.IsOpened()) return;
+        std::vector<cv::Mat> mats(batch.BatchSize());
+        std::vector<size_t> slot_jobs(batch.BatchSize());
+        for (int step = 0;; ++step) {
+            // ========  Step 2-1: 为每个槽位读取一张图片并直接写入 batch 输入 =========
+            for (size_t slot = 0; slot < batch.BatchSize(); ++slot) {
+                batch.Leave(slot);
+                for (size_t i = next_job++; i < image_paths.size(); i = next_job++) {
+                    FrameTracer::Span span("capture", static_cast<int>(i));
+                    mats[slot] = cv::imread(image_paths[i]);
+                    if (mats[slot].empty()) {
+                        std::lock_guard<std::mutex> lock(log_mutex);
+                        std::cerr << "[ERROR] Can not read image from: " << image_paths[i] << std::endl;
+                        continue;
+                    }
+                    metrics.frames_in.Add();
+                    span.Next("set_input_img");
+                    if (!batch.SetInput(slot, mats[slot])) continue;
+                    // 加入时槽位的隐藏状态清零，每张图片相互独立
+                    batch.Join(slot);
+                    slot_jobs[slot] = i;
+                    break;
+                }
+            }
+            if (batch.ActiveCount() == 0) break;
+            // ========  Step 2-2: batch 推理，以 batch 的序号作为帧序号 =========
+            {
+                FrameTracer::Span span("batch_infer", step);
+                auto infer_start = std::chrono::steady_clock::now();
+                batch.Infer();
+                std::chrono::duration<double> infer_elapsed = std::chrono::steady_clock::now() - infer_start;
+                metrics.inference_seconds.Observe(infer_elapsed.count());
+                metrics.inferred_full.Add(batch.ActiveCount());
+            }
+            // ========  Step 2-3: 后处理并保存各自的结果 =========
+            for (size_t slot = 0; slot < batch.BatchSize(); ++slot) {
+                if (!batch.Active(slot)) continue;
+                const size_t i = slot_jobs[slot];
+                FrameTracer::Span span("generate_matting", static_cast<int>(i));
+                cv::Mat result = this->generate_matting(batch.Alpha(slot), mats[slot], merge_mode, &background);
+                span.Next("write");
+                if (!write_image(output_paths[i], result)) continue;
+                metrics.frames_out.Add();
+                ++saved;
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(worker_count);
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers.emplace_back([&]() {
+            try {
+                worker();
+            }
+            catch (const std::exception& ex) {
+                std::cerr << "[ERROR] Batch worker failed: " << ex.what() << std::endl;
+            }
+            });
+    }
+    for (auto& t : workers) {
+        t.join();
+    }
+    return saved;
+}
+
+void PortraitMatting::BatchVideoMatting(const std::vector<std::string>& video_paths,
+    const std::vector<std::string>& output_paths,
+    const std::string& mode)
+{
+    if (video_paths.size() != output_paths.size()) {
+        std::cerr << "[ERROR] The number of videos and outputs does not match." << std::endl;
+        return;
+    }
+    const bool merge_mode = mode != "alpha"; // 输出模式是否为融合图
+    if (mode == "foreground") {
+        std::cerr << "[ERROR] Foreground mode is not supported with batched inference." << std::endl;
+        return;
+    }
+
+    // ========  Step 1: 创建 batch 推理请求 =========
+    // batch 中各槽位共享同一个输入尺寸，使用原模型尺寸
+    if (models->Base().size.empty()) {
+        std::cerr << "[ERROR] Batched inference requires a model with a static input size." << std::endl;
+        return;
+    }
+    BatchedStreams batch(models->Base().compiled_model);
+    std::cout << "[INFO] Processing " << video_paths.size() << " videos with batch size "
+        << batch.BatchSize() << "." << std::endl;
+
+    //! 占用一个槽位的视频
+    struct SlotStream
+    {
+        size_t job = 0;
+        cv::VideoCapture capture;
+        cv::VideoWriter writer;
+        cv::Mat mat;
+        //! 该视频的背景，视频背景从头播放
+        std::unique_ptr<Background> background;
+        int frames = 0;
+    };
+    std::vector<SlotStream> streams(batch.BatchSize());
+    size_t next_job = 0;
+    int total_frames = 0;
+
+    // 为空闲槽位打开下一个视频，没有可处理的视频时返回 false
+    auto join_next = [&](size_t slot) -> bool {
+        while (next_job < video_paths.size()) {
+            SlotStream& stream = streams[slot];
+            stream = SlotStream();
+            stream.job = next_job++;
+            if (!stream.capture.open(video_paths[stream.job])) {
+                std::cerr << "[ERROR] Can not open video from: " << video_paths[stream.job] << std::endl;
+                continue;
+            }
+            cv::Size size(static_cast<int>(stream.capture.get(cv::CAP_PROP_FRAME_WIDTH)),
+                static_cast<int>(stream.capture.get(cv::CAP_PROP_FRAME_HEIGHT)));
+            if (!stream.writer.open(output_paths[stream.job], cv::VideoWriter::fourcc('m', 'p', '4', 'v'),
+                stream.capture.get(cv::CAP_PROP_FPS), size, merge_mode)) {
+                std::cerr << "[ERROR] Can not save video to: " << output_paths[stream.job]
+                    << "  Check if directory exists." << std::endl;
+                continue;
+            }
+            stream.background = std::make_unique<Background>(mode, background_path);
+            if (!stream.background->IsOpened()) continue;
+            batch.Join(slot);
+            return true;
+        }
+        return false;
+    };
+    // 视频结束，释放槽位
+    auto leave = [&](size_t slot) {
+        SlotStream& stream = streams[slot];
+        stream.capture.release();
+        stream.writer.release();
+        stream.background.reset();
+        batch.Leave(slot);
+        total_frames += stream.frames;
+        std::cout << "[INFO] Finished: " << video_paths[stream.job] << "  frames: " << stream.frames << std::endl
+            << "[INFO] Output: " << output_paths[stream.job] << std::endl;
+    };
+
+    // ========  Step 2: matting loop，每次推理处理所有槽位的一帧 =========
+    auto start = std::chrono::system_clock::now();
+    MattingMetrics& metrics = MattingMetrics::Get();
+    FrameTracer::Instance().NameThread("batch");
+    for (int step = 0;; ++step) {
+        // ========  Step 2-1: 为每个槽位解码一帧并直接写入 batch 输入 =========
+        for (size_t slot = 0; slot < batch.BatchSize(); ++slot) {
+            while (batch.Active(slot) || join_next(slot)) {
+                SlotStream& stream = streams[slot];
+                FrameTracer::Span span("capture", stream.frames);
+                if (stream.capture.read(stream.mat) && !stream.mat.empty()) {
+                    metrics.frames_in.Add();
+                    span.Next("set_input_img");
+                    // 类型错误的帧不写入槽位，与读取失败一样结束该路视频
+                    if (batch.SetInput(slot, stream.mat)) break;
+                }
+                span.End();
+                leave(slot);
+            }
+        }
+        if (batch.ActiveCount() == 0) break;
+        // ========  Step 2-2: batch 推理，以 batch 的序号作为帧序号 =========
+        {
+            FrameTracer::Span span("batch_infer", step);
+            auto infer_start = std::chrono::steady_clock::now();
+            batch.Infer();
+            std::chrono::duration<double> infer_elapsed = std::chrono::steady_clock::now() - infer_start;
+            metrics.inference_seconds.Observe(infer_elapsed.count());
+            metrics.inferred_full.Add(batch.ActiveCount());
+        }
+        // ========  Step 2-3: 后处理并写入各自的输出 =========
+        for (size_t slot = 0; slot < batch.BatchSize(); ++slot) {
+            if (!batch.Active(slot)) continue;
+            SlotStream& stream = streams[slot];
+            FrameTracer::Span span("generate_matting", stream.frames);
+            cv::Mat result = this->generate_matting(batch.Alpha(slot), stream.mat, merge_mode,
+                stream.background.get());
+            span.Next("write");
+            stream.writer.write(result);
+            ++stream.frames;
+            metrics.frames_out.Add();
+        }
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::system_clock::now() - start;
+
+    // ========  Step 3: 汇总吞吐 =========
+    std::cout << "[INFO] Total frame count: " << total_frames << "   Total time: " << elapsed.count() << "ms"
+        << "   Aggregate fps: " << (elapsed.count() > 0 ? total_frames * 1000.0 / elapsed.count() : 0.0) << std::endl;
+}
+
+int PortraitMatting::stream_matting(ov::InferRequest& request,
+    const std::string& video_path,
+    const std::string& output_path,
+    const std::string& mode,
+    const FrameRange& range,
+    cv::VideoWriter* writer)
+{
+    const bool merge_mode = mode != "alpha"; // 输出模式是否为融合图
+    const bool foreground_mode = mode == "foreground"; // 是否使用模型预测的前景
+    // ========  Step 1: 打开输入、输出与背景 =========
+    cv::VideoCapture capture(video_path);
+    if (!capture.isOpened()) {
+        std::cerr << "[ERROR] Can not open video from: " << video_path << std::endl;
+        return -1;
+    }
+    int input_width = static_cast<int>(capture.get(cv::CAP_PROP_FRAME_WIDTH));
+    int input_height = static_cast<int>(capture.get(cv::CAP_PROP_FRAME_HEIGHT));
+    // 从预热的第一帧开始解码
+    const int first_frame = std::max(0, range.begin - range.warmup);
+    if (first_frame > 0 && !capture.set(cv::CAP_PROP_POS_FRAMES, first_frame)) {
+        std::cerr << "[ERROR] Can not seek to frame " << first_frame << " in: " << video_path << std::endl;
+        return -1;
+    }
+    cv::VideoWriter own_writer;
+    if (writer == nullptr) {
+        int ex = cv::VideoWriter::fourcc('m', 'p', '4', 'v');
+        own_writer.open(output_path, ex, capture.get(cv::CAP_PROP_FPS),
+            cv::Size(input_width, input_height), merge_mode);
+        if (!own_writer.isOpened()) {
+            std::cerr << "[ERROR] Can not save video to: " << output_path
+                << "  Check if directory exists." << std::endl;
+            return -1;
+        }
+    }
+    cv::VideoWriter& alpha_writer = writer != nullptr ? *writer : own_writer;
+    Background background(mode, background_path);
+    if (!background.IsOpened()) return -1;
+
+    // ========  Step 2: 选择原生尺寸的模型，与原模型尺寸不同时创建该模型的推理请求 =========
+    ModelCache::Entry& entry = models->Get(cv::Size(input_width, input_height));
+    ov::InferRequest native_request;
+    if (&entry != &models->Base())
+        native_request = entry.compiled_model.create_infer_request();
+    ov::InferRequest& infer = &entry != &models->Base() ? native_request : request;
+
+    // ========  Step 3: matting loop，隐藏状态属于该推理请求 =========
+    int frames = 0;
+    cv::Mat mat, input, result;
+    ov::Tensor input_tensor;
+    std::unique_ptr<FramePool> input_ring = make_input_ring(entry, cv::Size(input_width, input_height));
+    RecurrentState state(entry.compiled_model);
+    MattingMetrics& metrics = MattingMetrics::Get();
+    for (int index = first_frame; range.end < 0 || index < range.end; ++index) {
+        FrameTracer::Span span("capture", index);
+        if (!read_frame(capture, *input_ring, mat, input, input_tensor)) break;
+        metrics.frames_in.Add();
+        span.Next("set_input_img");
+        fill_input(mat, input, entry.color);
+        infer.set_tensor(entry.img_port, input_tensor);
+        span.Next("bind_state");
+        state.Bind(infer);
+        span.Next("start_async");
+        auto infer_start = std::chrono::steady_clock::now();
+        infer.start_async();
+        span.Next("wait");
+        infer.wait();
+        std::chrono::duration<double> infer_elapsed = std::chrono::steady_clock::now() - infer_start;
+        metrics.inference_seconds.Observe(infer_elapsed.count());
+        metrics.inferred_full.Add();
+        state.Advance();
+        // 预热帧只用于让隐藏状态收敛，结果丢弃
+        if (index < range.begin) continue;
+        ov::Tensor alp_tensor = infer.get_tensor(entry.alp_port);
+        ov::Tensor fgr_tensor = foreground_mode ? infer.get_tensor(entry.fgr_port) : ov::Tensor();
+        span.Next("generate_matting");
+        result = this->generate_matting(alp_tensor, mat, merge_mode, foreground_mode ? &fgr_tensor : nullptr,
+            &background, &result);
+        span.Next("write");
+        alpha_writer.write(result);
+        ++frames;
+        metrics.frames_out.Add();
+    }
+
+    // ========  Step 4: Release =========
+    capture.release();
+    own_writer.release();
+    return frames;
+}
+
 void PortraitMatting::CameraMatting(const int camera_id,
     const std::string& window_name,
     const std::string& mode)
 {
+    if (batch_size > 1) {
+        std::cerr << "[ERROR] Camera matting requires a model exported with batch size 1." << std::endl;
+        return;
+    }
     // ========  Step 1: 创建一个从输入视频捕获帧的 capture =========
+    cv::VideoCapture capture = OpenCamera(camera_id);
+    if (!capture.isOpened()) return;
+    this->CameraMatting(capture, window_name, mode);
+}
+
+cv::VideoCapture PortraitMatting::OpenCamera(const int camera_id)
+{
     cv::VideoCapture capture(camera_id);
     capture.set(3, 1920);
     capture.set(4, 1080);
     if (!capture.isOpened()) {
         std::cerr << "[ERROR] Can not open video camer: " << camera_id << std::endl;
+    }
+    return capture;
+}
+
+void PortraitMatting::CameraMatting(cv::VideoCapture& capture,
+    const std::string& window_name,
+    const std::string& mode)
+{
+    if (batch_size > 1) {
+        std::cerr << "[ERROR] Camera matting requires a model exported with batch size 1." << std::endl;
         return;
     }
     // ========  Step 2: 获取输入相关信息 =========
-    input_width = static_cast<int>(capture.get(cv::CAP_PROP_FRAME_WIDTH));
-    input_height = static_cast<int>(capture.get(cv::CAP_PROP_FRAME_HEIGHT));
     double frame_count = 0;
+    // 摄像头不一定支持 1080p，按实际分辨率选择原生尺寸的模型
+    const cv::Size frame_size(static_cast<int>(capture.get(cv::CAP_PROP_FRAME_WIDTH)),
+        static_cast<int>(capture.get(cv::CAP_PROP_FRAME_HEIGHT)));
+    this->use_model(frame_size);
     // ========  Step 3: 创建一个展示抠图结果 merger 的窗口 =========
     cv::namedWindow(window_name, cv::WINDOW_AUTOSIZE);
 
     // ========  Step 4: matting loop 处理视频流 =========
-    cv::Mat mat, result;
-    const bool merge_mode = mode == "merge"; // 输出模式是否为融合图
+    // 捕获、输入张量与 alpha 结果的缓冲区在循环中复用；帧尺寸与模型输入一致时直接捕获到输入张量中
+    cv::Mat mat, input, result;
+    ov::Tensor input_tensor;
+    std::unique_ptr<FramePool> input_ring = make_input_ring(*active, frame_size);
+    const bool merge_mode = mode != "alpha"; // 输出模式是否为融合图
+    const bool foreground_mode = mode == "foreground"; // 是否使用模型预测的前景
+    if (foreground_mode && !this->check_foreground(*active)) return;
+    Background background(mode, background_path);
+    if (!background.IsOpened()) return;
+    std::unique_ptr<AlphaPropagator> propagator = this->make_propagator(mode);
+    ChangeGate gate(change_threshold);
+    std::unique_ptr<RoiTracker> roi = this->make_roi_tracker(mode);
+    // 上一次生成的 alpha：整帧推理的输出保留在推理请求中，传播或 ROI 推理的结果保存在 host_alpha 中
+    ov::Tensor alp_tensor, fgr_tensor;
+    cv::Mat host_alpha;
+    bool use_host_alpha = false;
 
     // 累计 前处理 + 推理 + 后处理 耗时（ms)
     auto start = std::chrono::system_clock::now();
     // ========  Step 4-0: 初始化隐藏状态 =========
-    this->init_hide_status();
+    hide_status->Reset();
     auto end = std::chrono::system_clock::now();
     std::chrono::duration<double, std::milli> elapsed = end - start;
     std::cout << "[INFO] Processing video from camera. Press ESC to quit!" << std::endl;
+    FrameTracer::Instance().NameThread("camera");
+    MattingMetrics& metrics = MattingMetrics::Get();
+    // 第一帧的延迟（包含摄像头的第一次捕获与第一次推理的初始化）与稳态分开统计
+    const auto loop_start = std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::milli> first_elapsed(0), first_cost(0);
+    // Debug 构建：前两帧分配各个缓冲区，之后统计逐帧的帧缓冲分配次数
+    const double steady_frames = 2;
+    uint64_t steady_allocations = 0;
 
-    while (capture.read(mat)) {
-        if (mat.empty()) break;
+    while (true) {
+        FrameTracer::Span span("capture", static_cast<int>(frame_count));
+        if (!read_frame(capture, *input_ring, mat, input, input_tensor)) break;
         ++frame_count;
+        metrics.frames_in.Add();
         start = std::chrono::system_clock::now();
 
-        // ========  Step 4-1: 前处理 =========
-        cv::Mat img_mat = mat.clone();
-        this->set_input_img(img_mat); // 前处理，设置输入 Tensor
-        // ========  Step 4-2: 推理 =========
-        infer_request.start_async();
-        infer_request.wait();
+        // ========  Step 4-0: [可选] 静止画面直接复用上一次生成的 alpha，跳过推理 =========
+        span.Next("change_gate");
+        if (!gate.Unchanged(mat)) {
+            // [可选] 关键帧模式，运动补偿可靠时由上一关键帧传播 alpha，跳过推理
+            // 静止画面的强制刷新直接整帧推理，不能由传播或 ROI 代替
+            span.Next("propagate");
+            const bool refresh = gate.ForcedRefresh();
+            use_host_alpha = !refresh && propagator->Propagate(mat, host_alpha);
+            // [可选] ROI 模式，只对人物所在的区域推理
+            span.Next("roi_infer");
+            if (use_host_alpha) {
+                metrics.skipped_propagated.Add();
+            }
+            else if (!refresh && roi->Infer(mat, host_alpha)) {
+                propagator->SetKeyframe(mat, host_alpha);
+                use_host_alpha = true;
+                metrics.inferred_roi.Add();
+            }
+            if (!use_host_alpha) {
+                // ========  Step 4-1: 前处理 =========
+                span.Next("set_input_img");
+                fill_input(mat, input, active->color); // 前处理，缩放到输入张量中
+                infer_request.set_tensor(active->img_port, input_tensor);
+                // 从 ROI 推理回到整帧推理：整帧的隐藏状态停在多帧之前，且来自不同的视野，清零
+                if (roi->SinceFull() > 0) hide_status->Reset();
+                // ========  Step 4-2: 推理，隐藏状态在两组张量之间交替 =========
+                span.Next("bind_state");
+                hide_status->Bind(infer_request);
+                span.Next("start_async");
+                auto infer_start = std::chrono::steady_clock::now();
+                infer_request.start_async();
+                span.Next("wait");
+                infer_request.wait();
+                std::chrono::duration<double> infer_elapsed = std::chrono::steady_clock::now() - infer_start;
+                metrics.inference_seconds.Observe(infer_elapsed.count());
+                metrics.inferred_full.Add();
+                hide_status->Advance();
+                span.Next("update");
+                alp_tensor = infer_request.get_tensor(active->alp_port);
+                fgr_tensor = foreground_mode ? infer_request.get_tensor(active->fgr_port) : ov::Tensor();
+                propagator->SetKeyframe(mat, alpha_mat(alp_tensor));
+                roi->Update(alpha_mat(alp_tensor), mat.size());
+            }
+        }
+        else {
+            metrics.skipped_static.Add();
+        }
         // ========  Step 4-3: 后处理 =========
-        ov::Tensor alp_tensor = infer_request.get_tensor("alp");
-        result = this->generate_matting(alp_tensor, mat, merge_mode);
-        // ========  Step 4-4: 设置下一次推理的隐藏状态 =========
-        this->set_input_status();
+        span.Next("generate_matting");
+        result = use_host_alpha
+            ? this->generate_matting(host_alpha, mat, merge_mode, &background, &result)
+            : this->generate_matting(alp_tensor, mat, merge_mode, foreground_mode ? &fgr_tensor : nullptr,
+                &background, &result);
 
         // 累加耗时
         end = std::chrono::system_clock::now();
         elapsed += end - start;
 
-        // ========  Step 4-5: 写入输出 =========
+        // ========  Step 4-4: 写入输出 =========
+        span.Next("write");
         cv::imshow(window_name, result);
+        metrics.frames_out.Add();
+        if (frame_count == 1) {
+            first_elapsed = std::chrono::steady_clock::now() - loop_start;
+            first_cost = end - start;
+            metrics.first_frame_seconds.Set(first_elapsed.count() / 1000.0);
+        }
+        if (frame_count == steady_frames) steady_allocations = AllocationCounter::Count();
         if (cv::waitKey(1) == 27) {
             break;
         }
     }
     std::cout << "\n[INFO] Pre-processing + Inference + Post-processing time: " << elapsed.count() << "ms" << std::endl;
     std::cout << "[INFO] Total frame count: " << frame_count << "   Each frame cost: " << elapsed.count() / frame_count << "ms" << std::endl;
+    if (frame_count > 1) {
+        std::cout << "[INFO] First frame latency: " << first_elapsed.count() << "ms   Steady state: "
+            << (elapsed - first_cost).count() / (frame_count - 1) << "ms per frame" << std::endl;
+    }
+    if (AllocationCounter::Enabled() && frame_count > steady_frames) {
+        std::cout << "[DEBUG] Frame buffer allocations per steady-state frame: "
+            << (AllocationCounter::Count() - steady_allocations) / (frame_count - steady_frames) << std::endl;
+    }
+    if (propagator->Enabled()) {
+        std::cout << "[INFO] Keyframes: " << propagator->KeyframeCount()
+            << "   Propagated frames: " << propagator->PropagatedCount() << std::endl;
+    }
+    if (gate.Enabled()) {
+        std::cout << "[INFO] Static frames skipped: " << gate.SkippedCount() << " / "
+            << gate.SkippedCount() + gate.ProcessedCount() << " (" << gate.SkipRatio() * 100 << "%)" << std::endl;
+    }
+    if (roi->Enabled()) {
+        std::cout << "[INFO] ROI frames: " << roi->RoiCount() << "   Full frames: " << roi->FullCount() << std::endl;
+    }
 
     // ========  Step 5: Release =========
     capture.release();
@@ -3,6 +3,9 @@
 #ifndef PORTRAIT_MATTING_H
 #define PORTRAIT_MATTING_H
 
+#include <functional>
+#include <future>
+#include <memory>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -11,6 +14,18 @@
 #include <openvino/openvino.hpp>
 #include <openvino/pass/serialize.hpp>
 
+#include "alpha_propagator.h"
+#include "background.h"
+#include "blob_cache.h"
+#include "change_gate.h"
+#include "checkpoint.h"
+#include "frame_pool.h"
+#include "frame_tracer.h"
+#include "matting_session.h"
+#include "model_cache.h"
+#include "recurrent_state.h"
+#include "roi_tracker.h"
+
 /**
  * @brief 该类实现对图片、视频以及相机的人像抠图。
  * PortraitMatting 类主要提供三个对外接口：
@@ -24,20 +39,90 @@ public:
     /**
      * @brief 从指定模型构造用于人像抠图的对象。
      * @param model_path 指向 IR 模型的路径，是 .xml 文件的路径而不是 .bin 。
+     * @param downsample_ratio 下采样比例，0 表示使用模型的默认值。只有以 --dynamic-ratio 导出的模型支持，
+     *        见 SetDownsampleRatio。
+     * @param blob_dir 编译模型的导出缓存目录，为空时每次启动都编译，见 BlobCache。
      *
      * @note 路径中最好不要有非 ASCII 字符。
+     * @note 构造时只编译模型自身的尺寸，其他原生尺寸在第一次遇到对应输入时编译，见 ModelCache。
+     * @note 启动耗时（读取模型、编译或读取缓存）输出到日志，并记录到 apm_startup_seconds 指标。
+     */
+    __declspec(dllexport) explicit PortraitMatting(const std::string& model_path,
+        double downsample_ratio = 0,
+        const std::string& blob_dir = default_blob_dir);
+
+    //! 默认的编译模型导出缓存目录
+    static constexpr const char* default_blob_dir = "blob_cache";
+
+    /**
+     * @brief 在后台线程中构造对象并预热，调用方可以同时打开摄像头或解码器。
+     * @param model_path 同构造函数。
+     * @param downsample_ratio 同构造函数。
+     * @param blob_dir 同构造函数。
+     * @param warmup_size 预热推理的帧尺寸，为空时使用模型自身的尺寸，见 Warmup。
+     * @param on_ready [可选] 预热完成后在后台线程中调用。
+     * @return 就绪的对象；构造失败时 get() 抛出构造函数的异常。
+     */
+    __declspec(dllexport) static std::future<std::unique_ptr<PortraitMatting>> CreateAsync(
+        const std::string& model_path,
+        double downsample_ratio = 0,
+        const std::string& blob_dir = default_blob_dir,
+        const cv::Size& warmup_size = cv::Size(),
+        std::function<void(PortraitMatting&)> on_ready = nullptr);
+
+    /**
+     * @brief 以全 0 的帧运行一次推理，提前支付第一次推理的内存分配与内核初始化，之后隐藏状态清零。
+     * @param frame_size 之后输入的帧尺寸，用于选择原生尺寸的模型；为空时使用模型自身的尺寸。
+     *
+     * @note batch 大于 1 时推理请求在每次调用时创建，不做任何事。
+     * @note 选中的模型已经预热过（推理请求没有重新创建）时直接返回，可以在得知实际帧尺寸后再次调用。
      */
-    __declspec(dllexport) explicit PortraitMatting(const std::string& model_path);
+    __declspec(dllexport) void Warmup(const cv::Size& frame_size = cv::Size());
 
     /**
-     * @brief 将前处理嵌入模型。
+     * @brief 编译当前下采样比例下的所有原生尺寸并导出到缓存，用于安装。
+     * 只覆盖构造时的一个下采样比例与设备的默认精度，见 ModelCache::CompileAll。
+     * @return 可用的原生尺寸数量。
+     */
+    __declspec(dllexport) size_t Precompile() { return models->CompileAll(); }
+
+    /**
+     * @brief 将前处理（以及可选的后处理）嵌入模型。
      * @param original_model 原始模型的路径。
      * @param integrated_model 将前处理整合后模型的输出路径。
+     * @param resize_in_graph 为 true 时 img 输入接受任意尺寸的 u8 帧，在图内缩放到模型尺寸，
+     *        主机端不再调用 cv::resize。
+     * @param u8_alpha 为 true 时 alp 输出在图内缩放并量化为 u8（round(alpha * 255)），
+     *        主机端不再调用 cv::resize 与 convertTo。
+     * @param alpha_size u8 alp 的输出尺寸，为空时与输入帧的尺寸相同。
+     * @param keep_fgr 为 false 时删除运行时不使用的 fgr 输出，同 PruneModel。
+     * @param color_format img 输入的颜色格式。NV12、I420 为解码器输出的单平面 YUV 4:2:0（[1, H * 3 / 2, W, 1]），
+     *        在图内转换为 RGB，主机端不再做整帧的颜色转换；格式以附加的张量名记录在模型中，见 ModelCache::ColorFormatTag。
      *
      * @note 路径中最好不要有非 ASCII 字符。
+     * @note 开启图内缩放后输入形状可变，模型由 CPU 插件执行，并且只能用于 batch 1。
+     * @note YUV 输入只能用于 batch 1，不能与图内缩放同时开启；帧的宽、高需为偶数。
      */
     __declspec(dllexport) static void IntegrateModel(const std::string& original_model,
-        const std::string& integrated_model);
+        const std::string& integrated_model,
+        const bool resize_in_graph = false,
+        const bool u8_alpha = false,
+        const cv::Size& alpha_size = cv::Size(),
+        const bool keep_fgr = true,
+        const ModelCache::ColorFormat color_format = ModelCache::ColorFormat::BGR);
+
+    /**
+     * @brief 从模型中删除运行时不使用的 fgr 输出。
+     * @param original_model 原始模型（或 IntegrateModel 整合后模型）的路径。
+     * @param pruned_model 删除 fgr 后模型的输出路径，不含扩展名。
+     *
+     * @note 只有 fgr 独占的计算（前景残差与原图相加、截断等）会随之删除，与 alpha 共享的
+     *       refiner 计算仍然保留。
+     * @note 删除后不能再使用 foreground 模式。
+     * @note 路径中最好不要有非 ASCII 字符。
+     */
+    __declspec(dllexport) static void PruneModel(const std::string& original_model,
+        const std::string& pruned_model);
 
     /**
      * @brief 对图片进行人像抠图。
@@ -45,7 +130,10 @@ public:
      * @param output_path 抠图结果的输出路径。
      * @param mode 抠图模式，决定了输出的类型：
      * * alpha：输出为 mask(alpha)；
-     * * merge：输出为 使用 mask 从原图中抠出的主体（叠加在黑色背景上）。
+     * * merge：输出为 使用 mask 从原图中抠出的主体（叠加在黑色背景上）；
+     * * foreground：输出为 使用 mask 从模型预测的前景中抠出的主体，要求模型保留 fgr 输出；
+     * * replace：输出为 主体叠加在 SetBackground 指定的图片或视频上；
+     * * blur：输出为 主体叠加在虚化的原图背景上。
      *
      * @note 路径中最好不要有非 ASCII 字符。
      */
@@ -59,15 +147,195 @@ public:
      * @param output_path 抠图结果的输出路径。
      * @param mode 抠图模式，决定了输出的类型：
      * * alpha：输出为 mask(alpha)；
-     * * merge：输出为 使用 mask 从原图中抠出的主体（叠加在黑色背景上）。
+     * * merge：输出为 使用 mask 从原图中抠出的主体（叠加在黑色背景上）；
+     * * foreground：输出为 使用 mask 从模型预测的前景中抠出的主体，要求模型保留 fgr 输出；
+     * * replace：输出为 主体叠加在 SetBackground 指定的图片或视频上；
+     * * blur：输出为 主体叠加在虚化的原图背景上。
      * @param writer_fps 输出结果写入文件的 fps，若不指定则与输入保持一致。
      *
      * @note 路径中最好不要有非 ASCII 字符。
+     * @note 解码、推理、后处理、编码分为四个阶段并行执行，阶段之间以有界队列连接，
+     *       隐藏状态仍然逐帧按顺序传递。
+     * @note 流水线中的帧与 alp 输出的缓冲区循环复用，流水线填满之后逐帧不再分配帧缓冲；
+     *       Debug 构建中输出稳态每帧的分配次数，见 AllocationCounter。
+     * @note 第一帧的延迟（从开始处理到写入第一帧）与之后的稳态耗时分开统计。
+     * @note SetCheckpoint 开启断点时输出分块写入，处理完成后拼接为 output_path，见 SetCheckpoint。
      */
     __declspec(dllexport) void VideoMatting(const std::string& video_path,
         const std::string& output_path,
         const std::string& mode,
-        double writer_fps = NULL);
+        double writer_fps = 0.0);
+
+    /**
+     * @brief 同时对多个视频进行人像抠图。
+     * @param video_paths 需要抠图的视频路径。
+     * @param output_paths 抠图结果的输出路径，与 video_paths 一一对应。
+     * @param mode 抠图模式，同 VideoMatting。
+     * @param jobs 同时处理的视频数量的上限，0 表示不设上限。
+     *
+     * @note 所有视频共享同一个编译模型，按 ov::optimal_number_of_infer_requests 创建推理请求，
+     *       每个推理请求同一时刻处理一个视频，各视频拥有独立的隐藏状态。
+     * @note 路径中最好不要有非 ASCII 字符。
+     */
+    __declspec(dllexport) void MultiVideoMatting(const std::vector<std::string>& video_paths,
+        const std::vector<std::string>& output_paths,
+        const std::string& mode,
+        size_t jobs = 0);
+
+    /**
+     * @brief 将一个长视频按时间分段，在多个推理请求上并行抠图，再按顺序拼接输出；也用于只处理视频的一段。
+     * @param video_path 需要抠图的视频路径。
+     * @param output_path 抠图结果的输出路径。
+     * @param mode 抠图模式，同 VideoMatting。
+     * @param segments 分段数，每段一个推理请求，同时运行的段数不超过 ov::optimal_number_of_infer_requests。
+     * @param warmup_frames 每段提前开始推理的帧数。隐藏状态逐帧传递，每段从全 0 状态开始，
+     *        先推理该段之前的这些帧使状态收敛，结果丢弃，只输出段内的帧。0 表示不预热。
+     * @param start_frame 处理范围的第一帧（含）。
+     * @param end_frame 处理范围的最后一帧（不含），-1 表示到视频结束。
+     *
+     * @note 第一段直接写入输出，其余段先写入临时文件，全部完成后按顺序追加到输出并删除。
+     * @note 每段使用独立的隐藏状态与背景（视频背景在每段从头播放）；关键帧、静止画面与 ROI 模式不作用于分段。
+     * @note 路径中最好不要有非 ASCII 字符。
+     */
+    __declspec(dllexport) void SegmentVideoMatting(const std::string& video_path,
+        const std::string& output_path,
+        const std::string& mode,
+        int segments,
+        int warmup_frames = default_warmup_frames,
+        int start_frame = 0,
+        int end_frame = -1);
+
+    //! 分段处理时每段默认的预热帧数
+    static constexpr int default_warmup_frames = 30;
+
+    /**
+     * @brief 同时对多张图片进行人像抠图，用于批量处理目录。
+     * @param image_paths 需要抠图的图片路径。
+     * @param output_paths 抠图结果的输出路径，与 image_paths 一一对应。
+     * @param mode 抠图模式，同 ImageMatting。
+     * @param jobs 同时处理的图片数量的上限，0 表示不设上限。
+     *
+     * @note 所有图片共享同一个编译模型。batch 1 的模型按 ov::optimal_number_of_infer_requests 创建推理请求，
+     *       每个工作线程在独占的推理请求上依次读取、推理、保存图片，读图与编码和其他线程的推理重叠；
+     *       推理请求与隐藏状态按原生尺寸在线程内复用，每张图片只将隐藏状态清零。
+     * @note batch > 1 的模型将图片缩放到模型尺寸后打包进 batch 推理，每个工作线程一个 batch 推理请求；
+     *       不支持 foreground 模式。
+     * @note 路径中最好不要有非 ASCII 字符。
+     */
+    __declspec(dllexport) void MultiImageMatting(const std::vector<std::string>& image_paths,
+        const std::vector<std::string>& output_paths,
+        const std::string& mode,
+        size_t jobs = 0);
+
+    /**
+     * @brief 将多个视频打包进 batch 推理进行人像抠图，要求模型以 batch > 1 导出。
+     * @param video_paths 需要抠图的视频路径。
+     * @param output_paths 抠图结果的输出路径，与 video_paths 一一对应。
+     * @param mode 抠图模式，同 VideoMatting。
+     *
+     * @note 每个 batch 槽位同一时刻处理一个视频，拥有该槽位切片上独立的隐藏状态；
+     *       一个视频结束后，下一个视频立即加入空出的槽位。
+     * @note 路径中最好不要有非 ASCII 字符。
+     */
+    __declspec(dllexport) void BatchVideoMatting(const std::vector<std::string>& video_paths,
+        const std::vector<std::string>& output_paths,
+        const std::string& mode);
+
+    /**
+     * @brief 创建逐帧处理调用方内存的会话，用于已在内存中解码的帧，不经过文件或窗口，见 MattingSession。
+     * @param frame_size 输入帧的尺寸，用于选择原生尺寸的模型。
+     * @return 会话；模型的 batch 大小大于 1 时输出错误信息并返回 nullptr。
+     *
+     * @note 会话共享本对象的编译模型，创建时只分配推理请求与隐藏状态；本对象需比会话存活更久。
+     * @note 不同会话可以在不同线程上同时使用。关键帧、静止画面与 ROI 模式不作用于会话。
+     */
+    __declspec(dllexport) std::unique_ptr<MattingSession> CreateSession(const cv::Size& frame_size);
+
+    /**
+     * @brief 模型的 batch 大小。大于 1 时只能处理视频与 MultiImageMatting 的图片，且所有视频都经由 BatchVideoMatting 处理。
+     */
+    __declspec(dllexport) size_t BatchSize() const { return batch_size; }
+
+    /**
+     * @brief 选择骨干网络的输入分辨率（原生尺寸 * downsample_ratio），以精度换取速度。
+     * @param downsample_ratio 下采样比例，范围 (0, 1]。人物较小、场景复杂时取 0.5；
+     *        近景半身（视频会议）取 0.25，骨干网络的计算量约为 0.4 时的一半。
+     *
+     * @note 要求模型以 --dynamic-ratio 导出（带有 downsample_ratio 输入），否则输出警告并保持原比例。
+     * @note 隐藏状态的形状随之改变，切换后隐藏状态清零，相当于从视频的第一帧开始。
+     */
+    __declspec(dllexport) void SetDownsampleRatio(double downsample_ratio);
+
+    //! 当前的下采样比例
+    __declspec(dllexport) double DownsampleRatio() const { return models->DownsampleRatio(); }
+
+    /**
+     * @brief 设置关键帧模式，用于 VideoMatting 与 CameraMatting。
+     * @param keyframe_interval 关键帧的最大间隔，1 表示每帧都推理。大于 1 时网络最多每隔该帧数运行一次，
+     *        其余帧由上一关键帧的 alpha 经运动补偿传播得到；运动补偿不可靠时提前推理，见 AlphaPropagator。
+     *
+     * @note foreground 模式需要每帧的 fgr 输出，不使用关键帧模式。
+     */
+    __declspec(dllexport) void SetKeyframeInterval(int keyframe_interval) { this->keyframe_interval = keyframe_interval; }
+
+    /**
+     * @brief 设置静止画面检测，用于 VideoMatting 与 CameraMatting。
+     * @param change_threshold 缩略图分块平均绝对差的阈值（0~255），0 表示关闭。画面与上一次生成 alpha 的帧相比
+     *        不超过该值时复用其 alpha，跳过推理且不改变隐藏状态，见 ChangeGate。固定机位取 2 左右。
+     *
+     * @note 与关键帧模式同时开启时先检测静止画面，画面变化时再尝试传播。
+     */
+    __declspec(dllexport) void SetChangeThreshold(double change_threshold) { this->change_threshold = change_threshold; }
+
+    /**
+     * @brief 设置 ROI 模式，用于 VideoMatting 与 CameraMatting。
+     * @param roi_interval 连续 ROI 推理的最大帧数，0 表示关闭。开启后由上一帧的 alpha 推导人物的包围框，
+     *        只对人物所在的裁剪区域推理，每隔该帧数（或人物变大、离开区域时）整帧推理一次，见 RoiTracker。
+     *
+     * @note 要求模型输入尺寸固定且能够 reshape；foreground 模式需要整帧的 fgr 输出，不使用 ROI 模式。
+     */
+    __declspec(dllexport) void SetRoiInterval(int roi_interval) { this->roi_interval = roi_interval; }
+
+    /**
+     * @brief 设置断点，用于 VideoMatting 处理长视频：中断后从最近的断点继续，而不是从头开始。
+     * @param checkpoint_interval 保存断点的间隔帧数，0 表示关闭。开启后输出按该间隔分块写入
+     *        （<输出名>.chunkN<扩展名>），每写完一块就将下一帧的帧序号与隐藏状态保存到 <输出路径>.ckpt，
+     *        见 Checkpoint；处理完成后按顺序拼接为输出，并删除分块与断点文件。
+     * @param resume 是否从 <输出路径>.ckpt 继续：解码器跳到断点的帧，恢复隐藏状态，从下一个分块继续写入。
+     *        没有断点，或断点属于其他输入、隐藏状态的形状不同时从头开始。
+     *
+     * @note 关键帧、静止画面与 ROI 模式的状态不保存，恢复后重新开始；视频背景从头播放。
+     * @note 中断时正在写入的分块不完整，恢复后会被覆盖。
+     */
+    __declspec(dllexport) void SetCheckpoint(int checkpoint_interval, bool resume = false)
+    {
+        this->checkpoint_interval = checkpoint_interval;
+        this->resume = resume;
+    }
+
+    /**
+     * @brief 设置 replace 模式使用的背景。
+     * @param background_path 背景图片或视频的路径。视频背景循环播放。
+     *
+     * @note 路径中最好不要有非 ASCII 字符。
+     */
+    __declspec(dllexport) void SetBackground(const std::string& background_path) { this->background_path = background_path; }
+
+    /**
+     * @brief 开始记录逐帧的时间线，用于在 chrome://tracing 或 Perfetto 中查看流水线的停顿、队列空泡与抖动。
+     * @param trace_path Chrome trace JSON 的输出路径，在 StopTrace 时写入。
+     *
+     * @note 视频、多路视频、batch 与摄像头的每一帧记录 capture、set_input_img、bind_state（设置隐藏状态）、
+     *       start_async、wait、generate_matting、write 等区间，带有帧序号与线程 ID，见 FrameTracer。
+     * @note 未开启时每个区间只有一次原子读的开销。
+     */
+    __declspec(dllexport) void StartTrace(const std::string& trace_path);
+
+    /**
+     * @brief 停止记录并写入 StartTrace 指定的文件，需在所有抠图接口返回后调用。
+     * @return 写入失败时返回 false；没有开启记录时返回 true。
+     */
+    __declspec(dllexport) bool StopTrace();
 
     /**
      * @brief 从摄像头捕获视频流进行人像抠图，并将结果以窗口实时展示。
@@ -75,47 +343,183 @@ public:
      * @param window_name 展示抠图结果的窗口名。
      * @param mode 抠图模式，决定了输出的类型：
      * * alpha：输出为 mask(alpha)；
-     * * merge：输出为 使用 mask 从原图中抠出的主体（叠加在黑色背景上）。
+     * * merge：输出为 使用 mask 从原图中抠出的主体（叠加在黑色背景上）；
+     * * foreground：输出为 使用 mask 从模型预测的前景中抠出的主体，要求模型保留 fgr 输出；
+     * * replace：输出为 主体叠加在 SetBackground 指定的图片或视频上；
+     * * blur：输出为 主体叠加在虚化的原图背景上。
      */
     __declspec(dllexport) void CameraMatting(const int camera_id,
         const std::string& window_name,
         const std::string& mode);
 
-private:
     /**
-     * @brief 初始化模型的四个隐藏状态。
+     * @brief 从已打开的摄像头进行人像抠图，参数同上。用于在 CreateAsync 的同时打开摄像头。
+     * @param capture 已打开的摄像头，见 OpenCamera。
      *
-     * @note 和训练时保持一致，初始状态以全 0 填充。
+     * @note 第一帧的延迟（从开始捕获到展示第一帧）与之后的稳态耗时分开统计，并记录到 apm_first_frame_seconds 指标。
+     * @note 前处理与后处理的缓冲区逐帧复用；Debug 构建中输出稳态每帧的分配次数，见 AllocationCounter。
      */
-    void init_hide_status();
+    __declspec(dllexport) void CameraMatting(cv::VideoCapture& capture,
+        const std::string& window_name,
+        const std::string& mode);
 
     /**
-     * @brief 设置模型的 img 输入。
-     * @param img_mat 图片或者视频的一帧，喂给模型的 img 输入。
+     * @brief 打开摄像头并请求 1080p，打开失败时输出错误信息，返回的 capture 未打开。
+     * @param camera_id 摄像头 ID。
+     */
+    __declspec(dllexport) static cv::VideoCapture OpenCamera(const int camera_id);
+
+private:
+    /**
+     * @brief 切换单路推理（infer_request、hide_status）使用的模型为与输入尺寸最接近的原生尺寸。
+     * @param frame_size 输入帧的尺寸。
      *
-     * @note 对实参的非 const 引用，进行前处理时将对实参产生更改。
-     * @note 由于 OpenVINO 设置输入时不是深拷贝，因此必须确保推理时实参没有被销毁。
+     * @note 与当前模型相同时不做任何事；切换时重新创建推理请求与隐藏状态。
      */
-    void set_input_img(cv::Mat& img_mat);
+    void use_model(const cv::Size& frame_size);
 
     /**
-     * @brief 设置模型四个隐藏状态输入。在经过一次推理后，直接获取输出张量来设置输入。
+     * @brief 设置模型的 img 输入：直接分配一块输入缓冲区及指向它的张量（不创建输入环），将图片缩放（尺寸相同时拷贝）到张量的内存中再绑定。用于单张图片。
+     * @param request 需要设置输入的推理请求。
+     * @param entry 推理请求所属的模型，输入尺寸与之不同时缩放到该模型的尺寸。
+     * @param img_mat 图片或者视频的一帧，喂给模型的 img 输入，不会被修改。
+     * @return 输入张量的内存，推理完成前需持有；之后 img_mat 可以随时销毁。
+     *
+     * @note 视频与摄像头的逐帧循环使用输入环：帧直接解码（或缩放）到预先分配的输入张量中，
+     *       不再逐帧创建张量，见 portrait_matting.cpp 中的 read_frame。
      */
-    void set_input_status();
+    cv::Mat set_input_img(ov::InferRequest& request, const ModelCache::Entry& entry, const cv::Mat& img_mat);
 
     /**
      * @brief 生成抠图结果。
      * @param alp_tensor 从 OpenVINO 推理请求获取到的 alp 输出张量。
-     * @param original_mat 原始输入图像，如果要叠加到背景将直接作用在原图上。
+     * @param original_mat 原始输入图像，alpha 将被缩放到其尺寸；如果要叠加到背景将直接作用在原图上。
      * @param merge_mode 输出结果的类型：
      * * 0：输出为 mask(alpha)；
      * * 1：输出为 使用 mask 从原图中抠出的主体（叠加在黑色背景上）。
+     * @param fgr_tensor [可选] 模型的 fgr 输出。指定时 original_mat 先被替换为模型预测的前景，
+     *        merge 模式下得到真实的前景颜色，而不是原图的颜色。
+     * @param background [可选] merge 模式下合成的背景，为空时合成到黑色背景。
+     * @param result_buffer [可选] alpha 模式下写入 mask 的缓冲区，尺寸一致且没有被共享时直接复用。
      *
      * @return 返回抠图结果。
      */
     cv::Mat generate_matting(ov::Tensor& alp_tensor,
         cv::Mat& original_mat,
-        const bool merge_mode);
+        const bool merge_mode,
+        const ov::Tensor* fgr_tensor = nullptr,
+        Background* background = nullptr,
+        cv::Mat* result_buffer = nullptr);
+
+    /**
+     * @brief 生成抠图结果。
+     * @param alp_mat CV_32FC1 的 alpha，例如 batch 输出中某个槽位的切片；或图内量化的 CV_8UC1 alpha。
+     * @param original_mat 同上。
+     * @param merge_mode 同上。
+     * @param background 同上。
+     * @param result_buffer 同上。
+     *
+     * @return 返回抠图结果。alpha 模式下 u8 alpha 直接作为结果返回，与 alp_mat 共享数据。
+     * @note 缩放、量化与合成由 matting_kernels 中的融合内核一次完成，见 matting::CompositeOnBlack。
+     */
+    cv::Mat generate_matting(cv::Mat alp_mat,
+        cv::Mat& original_mat,
+        const bool merge_mode,
+        Background* background = nullptr,
+        cv::Mat* result_buffer = nullptr);
+
+    /**
+     * @brief 视频中需要处理的帧范围。
+     */
+    struct FrameRange
+    {
+        FrameRange(int begin = 0, int end = -1, int warmup = 0) : begin(begin), end(end), warmup(warmup) {}
+        //! 第一帧（含）
+        int begin;
+        //! 最后一帧（不含），-1 表示到视频结束
+        int end;
+        //! 在 begin 之前推理、不输出的帧数，用于隐藏状态的预热
+        int warmup;
+    };
+
+    /**
+     * @brief 在指定的推理请求上逐帧处理一个视频，不输出进度。
+     * @param request 处理该视频独占的推理请求，属于原模型尺寸；视频使用其他原生尺寸时另建推理请求。
+     * @param video_path 需要抠图的视频路径。
+     * @param output_path 抠图结果的输出路径。
+     * @param mode 抠图模式，同 VideoMatting。
+     * @param range [可选] 处理的帧范围，默认为整个视频。
+     * @param writer [可选] 已打开的输出，指定时写入其中而不打开 output_path，返回后不释放。
+     *
+     * @return 返回写入的帧数，打开输入、输出或背景失败时返回 -1。
+     */
+    int stream_matting(ov::InferRequest& request,
+        const std::string& video_path,
+        const std::string& output_path,
+        const std::string& mode,
+        const FrameRange& range = FrameRange(),
+        cv::VideoWriter* writer = nullptr);
+
+    /**
+     * @brief 将多张图片打包进 batch 推理进行人像抠图，参数同 MultiImageMatting，要求模型以 batch > 1 导出。
+     * @return 成功保存的图片数量。
+     */
+    size_t batch_image_matting(const std::vector<std::string>& image_paths,
+        const std::vector<std::string>& output_paths,
+        const std::string& mode,
+        size_t jobs);
+
+    /**
+     * @brief 检查模型是否支持 foreground 模式，不支持时输出错误信息。
+     */
+    bool check_foreground(const ModelCache::Entry& entry) const;
+
+    /**
+     * @brief 按抠图模式创建关键帧模式的传播器，foreground 模式下不开启。
+     */
+    std::unique_ptr<AlphaPropagator> make_propagator(const std::string& mode) const;
+
+    /**
+     * @brief 按抠图模式创建 ROI 模式的跟踪器，foreground 模式或模型在图内缩放时不开启。
+     */
+    std::unique_ptr<RoiTracker> make_roi_tracker(const std::string& mode);
+
+    /**
+     * @brief 视频流水线中在各阶段之间传递的一帧。
+     */
+    struct PipelineFrame
+    {
+        //! 原始帧，merge 模式下直接在其上合成；NV12 模型直接解码且不需要 BGR 原图时只是 Y 平面的图像头
+        cv::Mat original;
+        //! 喂给模型的帧：输入环中输入张量的内存，尺寸与模型输入一致（与原始帧尺寸相同时原始帧直接解码在其中）
+        cv::Mat input;
+        //! 指向 input 的模型输入张量，推理阶段直接绑定；推理之后与 input 一起释放，归还给输入环
+        ov::Tensor input_tensor;
+        //! 本帧的 alp 输出，推理时直接写入该张量，后处理不会被下一帧的推理覆盖
+        ov::Tensor alp;
+        //! alp 所在的 FramePool 缓冲区，持有期间不会被之后的帧复用
+        cv::Mat alp_buffer;
+        //! 本帧的 fgr 输出，只在 foreground 模式下保存
+        ov::Tensor fgr;
+        //! fgr 所在的 FramePool 缓冲区，持有期间不会被之后的帧复用
+        cv::Mat fgr_buffer;
+        //! 在主机端得到的 alpha（关键帧传播，或 ROI 推理后贴回整帧），use_host_alpha 为 true 时代替 alp
+        cv::Mat host_alpha;
+        //! host_alpha 是否有效，无效时 host_alpha 只是留待复用的缓冲区
+        bool use_host_alpha = false;
+        //! 抠图结果
+        cv::Mat result;
+        //! 帧序号，用于时间线
+        int index = 0;
+        //! 不为空时，本帧写入后保存断点，内容为处理本帧之后的隐藏状态
+        std::shared_ptr<RecurrentState::Snapshot> checkpoint;
+    };
+
+    //! 流水线相邻阶段之间最多缓存的帧数
+    static constexpr size_t pipeline_depth = 4;
+    //! 流水线中最多同时存在的帧数：三个队列各 pipeline_depth 帧，加上四个阶段各自正在处理的一帧。
+    //! VideoMatting 预先创建这么多帧，写出后归还给解码线程，帧的缓冲区在之后的帧中复用
+    static constexpr size_t pipeline_frames = 3 * pipeline_depth + 4;
 
 protected:
     PortraitMatting(const PortraitMatting&) = delete;
@@ -126,31 +530,33 @@ protected:
 private:
     ov::Core core;
     std::shared_ptr<ov::Model> model;
+    //! 编译模型的导出缓存，为空表示不导出；需先于 models 构造、晚于 models 析构
+    std::unique_ptr<BlobCache> blobs;
+    //! 按原生尺寸缓存的编译模型，所有推理请求共享
+    std::unique_ptr<ModelCache> models;
+    //! 单路推理当前使用的模型
+    ModelCache::Entry* active = nullptr;
     ov::InferRequest infer_request;
-
-    //! 全 0 填充的数组，用于初始化模型隐藏状态的 handler
-    std::unordered_map<std::string, std::vector<float>> init_status_handler = {
-        {"s1i", std::vector<float>(518400, 0)},
-        {"s2i", std::vector<float>(163200, 0)},
-        {"s3i", std::vector<float>(81600, 0)},
-        {"s4i", std::vector<float>(32640, 0)}
-    };
-
-    //! 模型五个输入和五个输出名称的硬编码
-    std::unordered_map<std::string, std::string> input_to_output = {
-        {"img", "alp"},
-        {"s1i", "s1o"},
-        {"s2i", "s2o"},
-        {"s3i", "s3o"},
-        {"s4i", "s4o"}
-    };
-
-    //! 模型输入端口
-    std::unordered_map<std::string, ov::Output<const ov::Node>> input_port;
-    //! 模型输入支持的高
-    int input_height = 1080;
-    //! 模型输入支持的宽
-    int input_width = 1920;
+    //! infer_request 是否已经预热，切换模型重新创建推理请求时清除
+    bool warmed = false;
+    //! infer_request 的隐藏状态，形状从编译模型推导
+    std::unique_ptr<RecurrentState> hide_status;
+    //! 模型的 batch 大小
+    size_t batch_size = 1;
+    //! replace 模式使用的背景图片或视频
+    std::string background_path;
+    //! 关键帧的最大间隔，1 表示每帧都推理
+    int keyframe_interval = 1;
+    //! 静止画面检测的阈值，0 表示关闭
+    double change_threshold = 0;
+    //! ROI 模式连续 ROI 推理的最大帧数，0 表示关闭
+    int roi_interval = 0;
+    //! 保存断点的间隔帧数，0 表示关闭
+    int checkpoint_interval = 0;
+    //! 是否从断点继续
+    bool resume = false;
+    //! 时间线的输出路径，为空表示没有开启记录
+    std::string trace_path;
 };
 
 #endif // PORTRAIT_MATTING_H
\ No newline at end of file
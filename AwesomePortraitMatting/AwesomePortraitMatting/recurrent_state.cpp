@@ -0,0 +1,112 @@
+﻿#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include "recurrent_state.h"
+
+namespace {
+    //! 状态缓冲区的对齐字节数，覆盖 AVX-512 的向量宽度
+    constexpr size_t state_alignment = 64;
+
+    float* aligned_zeros(size_t count)
+    {
+        size_t bytes = (count * sizeof(float) + state_alignment - 1) / state_alignment * state_alignment;
+#ifdef _MSC_VER
+        void* ptr = _aligned_malloc(bytes, state_alignment);
+#else
+        void* ptr = std::aligned_alloc(state_alignment, bytes);
+#endif
+        if (ptr == nullptr) throw std::bad_alloc();
+        std::memset(ptr, 0, bytes);
+        return static_cast<float*>(ptr);
+    }
+}
+
+void RecurrentState::AlignedDeleter::operator()(float* ptr) const
+{
+#ifdef _MSC_VER
+    _aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+
+RecurrentState::RecurrentState(const ov::CompiledModel& compiled_model)
+{
+    // ========  Step 1: 从模型端口推导隐藏状态：xxi 输入对应 xxo 输出 =========
+    std::vector<ov::Output<const ov::Node>> outputs = compiled_model.outputs();
+    for (const auto& input : compiled_model.inputs()) {
+        std::string name = input.get_any_name();
+        if (name == "img" || name.empty() || name.back() != 'i') continue;
+        std::string output_name = name.substr(0, name.size() - 1) + "o";
+        for (const auto& output : outputs) {
+            if (output.get_names().count(output_name) == 0) continue;
+            if (input.get_element_type() != ov::element::f32) {
+                throw std::runtime_error("Recurrent state " + name + " must be f32.");
+            }
+            in_ports.push_back(input);
+            out_ports.push_back(output);
+            break;
+        }
+    }
+
+    // ========  Step 2: 预先分配两组对齐的全 0 状态张量 =========
+    for (int set = 0; set < 2; ++set) {
+        for (const auto& port : in_ports) {
+            const ov::Shape& shape = port.get_shape();
+            buffers.emplace_back(aligned_zeros(ov::shape_size(shape)));
+            tensors[set].emplace_back(ov::element::f32, shape, buffers.back().get());
+        }
+    }
+}
+
+void RecurrentState::Bind(ov::InferRequest& request)
+{
+    const std::vector<ov::Tensor>& input = tensors[current];
+    const std::vector<ov::Tensor>& output = tensors[current ^ 1];
+    for (size_t i = 0; i < in_ports.size(); ++i) {
+        request.set_tensor(in_ports[i], input[i]);
+        request.set_tensor(out_ports[i], output[i]);
+    }
+}
+
+void RecurrentState::Reset()
+{
+    for (auto& tensor : tensors[current]) {
+        std::memset(tensor.data(), 0, tensor.get_byte_size());
+    }
+}
+
+void RecurrentState::ResetSlot(size_t slot, size_t batch_size)
+{
+    for (auto& tensor : tensors[current]) {
+        size_t slot_bytes = tensor.get_byte_size() / batch_size;
+        std::memset(static_cast<char*>(tensor.data()) + slot * slot_bytes, 0, slot_bytes);
+    }
+}
+
+RecurrentState::Snapshot RecurrentState::Save() const
+{
+    Snapshot snapshot;
+    for (const auto& tensor : tensors[current]) {
+        const float* ptr = tensor.data<float>();
+        snapshot.shapes.push_back(tensor.get_shape());
+        snapshot.data.emplace_back(ptr, ptr + tensor.get_size());
+    }
+    return snapshot;
+}
+
+bool RecurrentState::Restore(const Snapshot& snapshot)
+{
+    const std::vector<ov::Tensor>& input = tensors[current];
+    if (snapshot.shapes.size() != input.size() || snapshot.data.size() != input.size()) return false;
+    for (size_t i = 0; i < input.size(); ++i) {
+        if (snapshot.shapes[i] != input[i].get_shape() || snapshot.data[i].size() != input[i].get_size())
+            return false;
+    }
+    for (size_t i = 0; i < input.size(); ++i) {
+        std::memcpy(input[i].data(), snapshot.data[i].data(), input[i].get_byte_size());
+    }
+    return true;
+}
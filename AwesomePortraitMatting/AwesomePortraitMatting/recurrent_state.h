@@ -0,0 +1,95 @@
+﻿#pragma once
+
+#ifndef RECURRENT_STATE_H
+#define RECURRENT_STATE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <openvino/openvino.hpp>
+
+/**
+ * @brief 模型隐藏状态（s1~s4）的管理器。
+ * 状态的名称与形状从编译模型的端口推导：除 img 以外，名称以 i 结尾、并且存在同名以 o 结尾
+ * 输出的输入端口都被视为隐藏状态。管理器预先分配两组对齐的状态张量 A、B，逐帧交替使用：
+ *  * 第 k 帧以 A 为输入、B 为输出，第 k+1 帧以 B 为输入、A 为输出；
+ *  * 每帧只需用缓存好的端口重新绑定张量，没有名称查找，也没有内存分配。
+ */
+class RecurrentState
+{
+public:
+    /**
+     * @brief 保存在内存中的一份隐藏状态快照。
+     */
+    struct Snapshot
+    {
+        //! 每个隐藏状态的形状
+        std::vector<ov::Shape> shapes;
+        //! 每个隐藏状态的数据
+        std::vector<std::vector<float>> data;
+    };
+
+    /**
+     * @brief 从编译模型推导隐藏状态，并分配两组全 0 的状态张量。
+     * @param compiled_model 编译后的模型。
+     */
+    explicit RecurrentState(const ov::CompiledModel& compiled_model);
+
+    /**
+     * @brief 将当前这一组状态绑定为推理请求的输入，另一组绑定为输出。每次推理前调用。
+     */
+    void Bind(ov::InferRequest& request);
+
+    /**
+     * @brief 推理完成后调用，刚写入的输出成为下一帧的输入。
+     */
+    void Advance() { current ^= 1; }
+
+    /**
+     * @brief 将当前输入状态清零，即回到视频的第一帧。
+     */
+    void Reset();
+
+    /**
+     * @brief 将 batch 中指定槽位的当前输入状态清零。
+     * @param slot 槽位编号。
+     * @param batch_size 状态张量第 0 维的大小。
+     */
+    void ResetSlot(size_t slot, size_t batch_size);
+
+    /**
+     * @brief 将当前输入状态拷贝为快照。
+     */
+    Snapshot Save() const;
+
+    /**
+     * @brief 从快照恢复当前输入状态。
+     * @return 快照与模型的状态形状不一致时返回 false，状态保持不变。
+     */
+    bool Restore(const Snapshot& snapshot);
+
+    //! 隐藏状态的个数
+    size_t Count() const { return in_ports.size(); }
+
+    //! 第 i 个隐藏状态当前的输入张量
+    const ov::Tensor& Current(size_t i) const { return tensors[current][i]; }
+
+    //! 第 i 个隐藏状态的输入名称
+    std::string Name(size_t i) const { return in_ports[i].get_any_name(); }
+
+private:
+    //! 按 64 字节对齐的状态缓冲区
+    struct AlignedDeleter { void operator()(float* ptr) const; };
+    using AlignedBuffer = std::unique_ptr<float[], AlignedDeleter>;
+
+    std::vector<ov::Output<const ov::Node>> in_ports;
+    std::vector<ov::Output<const ov::Node>> out_ports;
+    //! 两组状态张量，tensors[current] 为下一次推理的输入
+    std::vector<ov::Tensor> tensors[2];
+    std::vector<AlignedBuffer> buffers;
+    int current = 0;
+};
+
+#endif // RECURRENT_STATE_H
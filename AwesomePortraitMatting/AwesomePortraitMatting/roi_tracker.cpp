@@ -0,0 +1,189 @@
+﻿#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "roi_tracker.h"
+#include "matting_kernels.h"
+
+namespace {
+    //! 裁剪尺寸，按宽高比（3:4、1:1、4:3）分组，每组从小到大
+    const cv::Size roi_shapes[3][2] = {
+        { cv::Size(480, 640), cv::Size(720, 960) },
+        { cv::Size(512, 512), cv::Size(768, 768) },
+        { cv::Size(640, 480), cv::Size(960, 720) }
+    };
+
+    //! outer 是否完全包含 inner
+    bool contains(const cv::Rect& outer, const cv::Rect2d& inner)
+    {
+        return inner.x >= outer.x && inner.y >= outer.y
+            && inner.x + inner.width <= outer.x + outer.width
+            && inner.y + inner.height <= outer.y + outer.height;
+    }
+}
+
+RoiTracker::RoiTracker(ModelCache& models, int refresh_interval, double padding)
+    : models(models), refresh_interval(std::max(0, refresh_interval)), padding(padding)
+{
+}
+
+bool RoiTracker::Infer(const cv::Mat& frame, cv::Mat& alpha)
+{
+    // ========  Step 1: 没有裁剪区域或达到整帧推理的间隔时整帧推理 =========
+    if (!this->Enabled() || region.empty() || since_full >= refresh_interval) return false;
+    if ((region & cv::Rect(0, 0, frame.cols, frame.rows)) != region) {
+        region = cv::Rect();
+        return false;
+    }
+
+    // ========  Step 2: 取得裁剪尺寸的模型，区域移动或更换尺寸时隐藏状态清零 =========
+    if (entry == nullptr || entry->size != shape) {
+        entry = models.GetExact(shape);
+        if (entry == nullptr) {
+            std::cerr << "[WARNING] ROI mode is disabled: the model can not be compiled for "
+                << shape.width << "x" << shape.height << "." << std::endl;
+            refresh_interval = 0;
+            return false;
+        }
+        request = entry->compiled_model.create_infer_request();
+        state = std::make_unique<RecurrentState>(entry->compiled_model);
+        // 输入缓冲区与指向它的 img 张量只在更换模型时创建并绑定，之后逐帧写入同一块内存
+        const bool yuv = entry->color != ModelCache::ColorFormat::BGR;
+        input.create(shape, CV_8UC3);
+        if (yuv) yuv_input.create(shape.height * 3 / 2, shape.width, CV_8UC1);
+        request.set_tensor(entry->img_port, ov::Tensor(entry->img_port.get_element_type(),
+            entry->img_port.get_shape(), yuv ? yuv_input.data : input.data));
+    }
+    if (moved) {
+        state->Reset();
+        moved = false;
+    }
+
+    // ========  Step 3: 裁剪并缩放到已绑定的输入缓冲区（YUV 输入的模型再转换颜色），推理 =========
+    cv::resize(frame(region), input, shape);
+    if (entry->color != ModelCache::ColorFormat::BGR)
+        matting::BgrToYuv420(input, yuv_input, entry->color == ModelCache::ColorFormat::NV12);
+    state->Bind(request);
+    request.start_async();
+    request.wait();
+    state->Advance();
+
+    // ========  Step 4: 将 alpha 贴回整帧，区域外为 0 =========
+    ov::Tensor alp_tensor = request.get_tensor(entry->alp_port);
+    const ov::Shape alp_shape = alp_tensor.get_shape(); // [1, 1, H, W]
+    const int alp_type = alp_tensor.get_element_type() == ov::element::u8 ? CV_8UC1 : CV_32FC1;
+    cv::Mat crop_alpha(static_cast<int>(alp_shape.at(2)), static_cast<int>(alp_shape.at(3)),
+        alp_type, alp_tensor.data());
+    alpha.create(frame.size(), CV_8UC1);
+    // 只清零区域外的上下左右四条带，区域内由贴回的 alpha 覆盖，不再整帧写两遍
+    const int right = region.x + region.width, bottom = region.y + region.height;
+    alpha.rowRange(0, region.y).setTo(0);
+    alpha.rowRange(bottom, frame.rows).setTo(0);
+    alpha(cv::Rect(0, region.y, region.x, region.height)).setTo(0);
+    alpha(cv::Rect(right, region.y, frame.cols - right, region.height)).setTo(0);
+    cv::Mat pasted = alpha(region);
+    if (alp_type == CV_32FC1)
+        matting::AlphaToMask(crop_alpha, pasted);
+    else
+        cv::resize(crop_alpha, pasted, pasted.size());
+
+    // ========  Step 5: 由裁剪区域的 alpha 决定下一帧的区域 =========
+    const cv::Rect covered = region;
+    this->update_region(crop_alpha, covered, frame.size());
+    ++since_full;
+    ++roi_frames;
+    return true;
+}
+
+void RoiTracker::Update(const cv::Mat& alpha, const cv::Size& frame_size)
+{
+    // 先于 Enabled 的判断清零：ROI 模式中途关闭（裁剪尺寸无法编译）后 SinceFull 不会一直大于 0
+    since_full = 0;
+    if (!this->Enabled()) return;
+    ++full_frames;
+    this->update_region(alpha, cv::Rect(cv::Point(), frame_size), frame_size);
+}
+
+void RoiTracker::Reset()
+{
+    region = cv::Rect();
+    since_full = 0;
+}
+
+void RoiTracker::update_region(const cv::Mat& alpha, const cv::Rect& covered, const cv::Size& frame_size)
+{
+    // ========  Step 1: 在缩小的 alpha 上求人物的包围框，人物离开画面时整帧推理 =========
+    const int width = std::min(mask_width, alpha.cols);
+    const int height = std::max(1, alpha.rows * width / alpha.cols);
+    cv::resize(alpha, small, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+    cv::compare(small, alpha.type() == CV_8UC1 ? 25.0 : 0.1, mask, cv::CMP_GT);
+    const cv::Rect subject = cv::boundingRect(mask);
+    if (subject.empty()) {
+        region = cv::Rect();
+        return;
+    }
+
+    // ========  Step 2: 人物触及裁剪区域的边缘（帧的边缘除外）时可能已超出区域，整帧推理 =========
+    if (covered.size() != frame_size
+        && ((subject.x == 0 && covered.x > 0)
+            || (subject.y == 0 && covered.y > 0)
+            || (subject.br().x == small.cols && covered.br().x < frame_size.width)
+            || (subject.br().y == small.rows && covered.br().y < frame_size.height))) {
+        region = cv::Rect();
+        return;
+    }
+
+    // ========  Step 3: 映射到帧坐标 =========
+    const double sx = static_cast<double>(covered.width) / small.cols;
+    const double sy = static_cast<double>(covered.height) / small.rows;
+    const cv::Rect2d box(covered.x + subject.x * sx, covered.y + subject.y * sy,
+        subject.width * sx, subject.height * sy);
+    const cv::Rect2d frame_rect(0, 0, frame_size.width, frame_size.height);
+    auto pad = [&box, &frame_rect](double ratio) {
+        return cv::Rect2d(box.x - box.width * ratio, box.y - box.height * ratio,
+            box.width * (1 + 2 * ratio), box.height * (1 + 2 * ratio)) & frame_rect;
+    };
+
+    // ========  Step 4: 人物仍在当前区域内时区域保持不动，否则按两倍外扩选择新的区域 =========
+    if (!region.empty() && contains(region, pad(padding))) return;
+    if (!this->fit_region(pad(2 * padding), frame_size)) region = cv::Rect();
+}
+
+bool RoiTracker::fit_region(const cv::Rect2d& wanted, const cv::Size& frame_size)
+{
+    // ========  Step 1: 各组裁剪尺寸按宽高比与包围框的接近程度排序 =========
+    const double aspect = wanted.width / wanted.height;
+    int order[3] = { 0, 1, 2 };
+    auto cost = [aspect](int group) {
+        return std::abs(std::log(static_cast<double>(roi_shapes[group][0].width) / roi_shapes[group][0].height / aspect));
+    };
+    std::sort(std::begin(order), std::end(order), [&cost](int a, int b) { return cost(a) < cost(b); });
+
+    for (int group : order) {
+        // ========  Step 2: 扩展为该组的宽高比，放不进帧内或面积过大时尝试下一组 =========
+        const cv::Size* shapes = roi_shapes[group];
+        const double shape_aspect = static_cast<double>(shapes[0].width) / shapes[0].height;
+        double w = wanted.width, h = wanted.height;
+        if (w / h < shape_aspect)
+            w = h * shape_aspect;
+        else
+            h = w / shape_aspect;
+        if (w > frame_size.width || h > frame_size.height || w * h > max_area_ratio * frame_size.area())
+            continue;
+
+        // ========  Step 3: 保持中心，移入帧内 =========
+        double x = wanted.x + (wanted.width - w) / 2, y = wanted.y + (wanted.height - h) / 2;
+        x = std::min(std::max(x, 0.0), frame_size.width - w);
+        y = std::min(std::max(y, 0.0), frame_size.height - h);
+        const cv::Rect next = cv::Rect(cvRound(x), cvRound(y), cvRound(w), cvRound(h))
+            & cv::Rect(cv::Point(), frame_size);
+
+        // ========  Step 4: 优先选择不需要缩小的一档分辨率 =========
+        const cv::Size next_shape = shapes[0].width >= next.width ? shapes[0] : shapes[1];
+        moved = moved || next != region || next_shape != shape;
+        region = next;
+        shape = next_shape;
+        return true;
+    }
+    return false;
+}
\ No newline at end of file
@@ -0,0 +1,118 @@
+﻿#pragma once
+
+#ifndef ROI_TRACKER_H
+#define ROI_TRACKER_H
+
+#include <memory>
+
+#include <opencv2/opencv.hpp>
+#include <openvino/openvino.hpp>
+
+#include "model_cache.h"
+#include "recurrent_state.h"
+
+/**
+ * @brief ROI 模式：人物只占画面的一部分时，只对人物所在的裁剪区域推理。
+ * 1080p 的画面即使人物只占三分之一，也要整帧送入网络。ROI 模式由上一帧的 alpha 推导人物的包围框：
+ *  * 包围框外扩后取与之宽高比最接近、并且能放入帧内的裁剪尺寸（3:4、1:1、4:3，各有两档分辨率），
+ *    优先选择不需要缩小的一档，人物边缘的细节不会因为缩小而丢失；
+ *  * 裁剪区域缩放到该尺寸后在单独编译的模型上推理，alpha 贴回整帧，区域外为 0；
+ *  * 人物仍在裁剪区域内时区域保持不动，隐藏状态在同一区域内逐帧传递；区域移动或更换尺寸时隐藏状态清零；
+ *  * 人物触及裁剪区域的边缘（变大、移出区域）、离开画面、区域超过画面的一半，或者连续 ROI 推理达到
+ *    refresh_interval 帧（发现新进入画面的人物）时，回到整帧推理。
+ * 整帧推理仍由调用方完成，推理后调用 Update 更新包围框。ROI 推理期间整帧的隐藏状态不会前进，
+ * 回到整帧推理时（SinceFull 大于 0）调用方将其清零，不从多帧之前、另一个视野的状态继续。
+ */
+class RoiTracker
+{
+public:
+    /**
+     * @param models 用于编译裁剪尺寸的模型缓存，生命周期需长于 RoiTracker。
+     * @param refresh_interval 连续 ROI 推理的最大帧数，达到后整帧推理一次；0 表示关闭 ROI 模式。
+     * @param padding 判断人物是否仍在区域内时，人物包围框每边外扩的比例；新的区域按其两倍外扩。
+     */
+    RoiTracker(ModelCache& models, int refresh_interval, double padding = 0.1);
+
+    //! 是否开启 ROI 模式
+    bool Enabled() const { return refresh_interval > 0; }
+
+    /**
+     * @brief 尝试只对人物所在的区域推理。
+     * @param frame 当前帧（CV_8UC3）。
+     * @param alpha 输出，帧尺寸的 CV_8UC1 alpha，区域外为 0。
+     * @return 完成 ROI 推理时返回 true；没有可用的区域时返回 false，此时需要整帧推理并调用 Update。
+     */
+    bool Infer(const cv::Mat& frame, cv::Mat& alpha);
+
+    /**
+     * @brief 整帧推理后，由其 alpha 更新人物的包围框。
+     * @param alpha 网络输出的整帧 alpha，CV_32FC1（模型尺寸）或 CV_8UC1。
+     * @param frame_size 帧的尺寸。
+     */
+    void Update(const cv::Mat& alpha, const cv::Size& frame_size);
+
+    /**
+     * @brief 丢弃包围框，下一帧整帧推理。
+     */
+    void Reset();
+
+    //! ROI 推理的帧数
+    int RoiCount() const { return roi_frames; }
+    //! 整帧推理的帧数
+    int FullCount() const { return full_frames; }
+    //! 自上次整帧推理以来 ROI 推理的帧数。大于 0 时回到整帧推理，整帧的隐藏状态已过期，调用方需清零
+    int SinceFull() const { return since_full; }
+
+protected:
+    RoiTracker(const RoiTracker&) = delete;
+    RoiTracker& operator=(const RoiTracker&) = delete;
+
+private:
+    /**
+     * @brief 由 alpha 推导人物在帧中的包围框，并决定下一帧的裁剪区域。
+     * @param alpha 区域 region 的 alpha，任意尺寸。
+     * @param region alpha 覆盖的帧区域，整帧推理时为整个帧。
+     * @param frame_size 帧的尺寸。
+     */
+    void update_region(const cv::Mat& alpha, const cv::Rect& region, const cv::Size& frame_size);
+
+    /**
+     * @brief 为外扩后的人物包围框选择裁剪尺寸，并将其扩展为该尺寸的宽高比，放入帧内。
+     * @return 任何宽高比都放不进帧内或超过帧面积的一半时返回 false。
+     */
+    bool fit_region(const cv::Rect2d& wanted, const cv::Size& frame_size);
+
+    ModelCache& models;
+    int refresh_interval;
+    double padding;
+
+    //! 当前的裁剪区域，为空表示整帧推理
+    cv::Rect region;
+    //! 裁剪区域对应的模型输入尺寸
+    cv::Size shape;
+    //! 裁剪区域自上次推理后是否移动或更换了尺寸
+    bool moved = false;
+    //! 自上次整帧推理以来连续 ROI 推理的帧数
+    int since_full = 0;
+
+    //! 裁剪尺寸的模型，以及其上的推理请求与隐藏状态
+    ModelCache::Entry* entry = nullptr;
+    ov::InferRequest request;
+    std::unique_ptr<RecurrentState> state;
+    //! 缩放后的裁剪区域，推理时作为 img 输入；与 yuv_input 一样在更换模型时分配，推理请求的 img 张量指向它
+    cv::Mat input;
+    //! YUV 输入的模型：input 转换后的单平面 YUV，代替 input 作为 img 输入
+    cv::Mat yuv_input;
+    //! 复用的缓冲区
+    cv::Mat small, mask;
+
+    int roi_frames = 0;
+    int full_frames = 0;
+
+    //! 区域超过帧面积的该比例时整帧推理
+    static constexpr double max_area_ratio = 0.5;
+    //! 推导包围框时 alpha 缩小到的宽度
+    static constexpr int mask_width = 160;
+};
+
+#endif // ROI_TRACKER_H
\ No newline at end of file
@@ -0,0 +1,46 @@
+﻿#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "stage_stats.h"
+
+namespace {
+    //! 最近秩分位数：已排序样本中第 ceil(p * n) 个
+    double percentile(const std::vector<double>& sorted, double p)
+    {
+        size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+        return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+    }
+}
+
+void StageStats::Add(const std::string& stage, double ms)
+{
+    auto it = samples.find(stage);
+    if (it == samples.end()) {
+        order.push_back(stage);
+        it = samples.emplace(stage, std::vector<double>()).first;
+    }
+    it->second.push_back(ms);
+}
+
+StageStats::Summary StageStats::Summarize(const std::string& stage) const
+{
+    Summary summary;
+    auto it = samples.find(stage);
+    if (it == samples.end() || it->second.empty()) return summary;
+    std::vector<double> sorted = it->second;
+    std::sort(sorted.begin(), sorted.end());
+    summary.count = sorted.size();
+    summary.mean = std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size();
+    summary.p50 = percentile(sorted, 0.50);
+    summary.p90 = percentile(sorted, 0.90);
+    summary.p99 = percentile(sorted, 0.99);
+    summary.max = sorted.back();
+    return summary;
+}
+
+void StageStats::Clear()
+{
+    order.clear();
+    samples.clear();
+}
\ No newline at end of file
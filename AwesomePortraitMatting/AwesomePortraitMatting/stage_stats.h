@@ -0,0 +1,83 @@
+﻿#pragma once
+
+#ifndef STAGE_STATS_H
+#define STAGE_STATS_H
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * @brief 按阶段（解码、前处理、推理、后处理、编码等）记录的耗时样本与分位数统计。
+ * 单个总耗时会掩盖各阶段的长尾，也无法判断一次优化落在哪个阶段。StageStats 保存每个阶段的全部样本，
+ * 统计时排序，按最近秩（nearest-rank）计算分位数。
+ *
+ * @note 非线程安全，每个线程（或每条流水线）使用各自的对象。
+ */
+class StageStats
+{
+public:
+    /**
+     * @brief 某个阶段的统计结果，单位 ms。
+     */
+    struct Summary
+    {
+        //! 样本数
+        size_t count = 0;
+        double mean = 0;
+        double p50 = 0;
+        double p90 = 0;
+        double p99 = 0;
+        double max = 0;
+    };
+
+    /**
+     * @brief 计时辅助：析构时将自构造起经过的时间（steady_clock）记入指定阶段。
+     */
+    class Scope
+    {
+    public:
+        Scope(StageStats& stats, const std::string& stage)
+            : stats(stats), stage(stage), start(std::chrono::steady_clock::now()) {}
+        ~Scope()
+        {
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            stats.Add(stage, elapsed.count());
+        }
+
+    protected:
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        StageStats& stats;
+        std::string stage;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    /**
+     * @brief 记录一个样本。
+     * @param stage 阶段名称，第一次出现时追加到 Stages() 的末尾。
+     * @param ms 耗时（ms）。
+     */
+    void Add(const std::string& stage, double ms);
+
+    /**
+     * @brief 统计指定阶段的样本，没有样本时返回全 0。
+     */
+    Summary Summarize(const std::string& stage) const;
+
+    //! 按第一次记录的顺序排列的阶段名称
+    const std::vector<std::string>& Stages() const { return order; }
+
+    //! 丢弃所有样本
+    void Clear();
+
+private:
+    std::vector<std::string> order;
+    std::map<std::string, std::vector<double>> samples;
+};
+
+#endif // STAGE_STATS_H
\ No newline at end of file
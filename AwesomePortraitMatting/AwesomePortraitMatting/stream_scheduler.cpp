@@ -0,0 +1,56 @@
+﻿#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+#include "stream_scheduler.h"
+
+
+StreamScheduler::StreamScheduler(ov::CompiledModel& compiled_model, size_t max_requests)
+{
+    size_t count = OptimalRequests(compiled_model, max_requests);
+    requests.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        requests.push_back(compiled_model.create_infer_request());
+    }
+}
+
+size_t StreamScheduler::OptimalRequests(ov::CompiledModel& compiled_model, size_t max_requests)
+{
+    size_t optimal = 1;
+    try {
+        optimal = compiled_model.get_property(ov::optimal_number_of_infer_requests);
+    }
+    catch (const std::exception& ex) {
+        std::cerr << "[WARNING] Can not query optimal number of infer requests: " << ex.what() << std::endl;
+    }
+    size_t count = std::max<size_t>(optimal, 1);
+    if (max_requests > 0) count = std::min(count, max_requests);
+    return count;
+}
+
+void StreamScheduler::Run(size_t job_count, const Job& job)
+{
+    std::atomic<size_t> next_job(0);
+    auto worker = [&](ov::InferRequest& request) {
+        for (size_t i = next_job++; i < job_count; i = next_job++) {
+            try {
+                job(request, i);
+            }
+            catch (const std::exception& ex) {
+                std::cerr << "[ERROR] Job " << i << " failed: " << ex.what() << std::endl;
+            }
+        }
+    };
+
+    // 工作线程数不超过任务数，多余的推理请求保持空闲
+    size_t worker_count = std::min(requests.size(), job_count);
+    std::vector<std::thread> workers;
+    workers.reserve(worker_count);
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers.emplace_back(worker, std::ref(requests[i]));
+    }
+    for (auto& t : workers) {
+        t.join();
+    }
+}
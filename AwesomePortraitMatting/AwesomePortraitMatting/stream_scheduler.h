@@ -0,0 +1,64 @@
+﻿#pragma once
+
+#ifndef STREAM_SCHEDULER_H
+#define STREAM_SCHEDULER_H
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include <openvino/openvino.hpp>
+
+/**
+ * @brief 多路流调度器：在同一个编译模型上创建多个推理请求，并发处理多个相互独立的任务。
+ * 以 THROUGHPUT 模式编译的模型会在设备上建立多个执行流，只有同时有多个推理请求在运行时
+ * 这些执行流才会被用满。调度器为每个推理请求分配一个工作线程，工作线程不断领取下一个任务
+ * （例如一段视频），并在自己独占的推理请求上完成该任务。
+ */
+class StreamScheduler
+{
+public:
+    /**
+     * @brief 任务回调。
+     * @param request 执行该任务的工作线程独占的推理请求，任务之间不会共享。
+     * @param job 任务编号，范围为 [0, job_count)。
+     */
+    using Job = std::function<void(ov::InferRequest& request, size_t job)>;
+
+    /**
+     * @brief 在编译模型上创建推理请求。
+     * @param compiled_model 共享的编译模型。
+     * @param max_requests 推理请求数量的上限，0 表示不设上限。
+     *
+     * @note 推理请求数量取 ov::optimal_number_of_infer_requests，至少为 1。
+     */
+    explicit StreamScheduler(ov::CompiledModel& compiled_model, size_t max_requests = 0);
+
+    /**
+     * @brief 编译模型建议的推理请求数量，至少为 1。
+     * @param compiled_model 编译模型。
+     * @param max_requests 上限，0 表示不设上限。
+     */
+    static size_t OptimalRequests(ov::CompiledModel& compiled_model, size_t max_requests = 0);
+
+    /**
+     * @brief 并发执行 job_count 个任务，所有任务完成后返回。
+     * @param job_count 任务数量。
+     * @param job 任务回调，在工作线程中被调用。
+     *
+     * @note 单个任务抛出的异常会被捕获并输出错误信息，不影响其他任务。
+     */
+    void Run(size_t job_count, const Job& job);
+
+    //! 推理请求（即并发的流）数量
+    size_t StreamCount() const { return requests.size(); }
+
+protected:
+    StreamScheduler(const StreamScheduler&) = delete;
+    StreamScheduler& operator=(const StreamScheduler&) = delete;
+
+private:
+    std::vector<ov::InferRequest> requests;
+};
+
+#endif // STREAM_SCHEDULER_H
@@ -0,0 +1,489 @@
+﻿// apm_bench.cpp : APM 的基准测试程序。生成合成视频，按阶段统计耗时分位数与吞吐，输出 JSON，
+// 并可与保存的基线比较，出现性能回退时以非 0 退出。
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include <openvino/openvino.hpp>
+
+#include "../AwesomePortraitMatting/argengine.hpp"
+#include "../AwesomePortraitMatting/matting_kernels.h"
+#include "../AwesomePortraitMatting/model_cache.h"
+#include "../AwesomePortraitMatting/portrait_matting.h"
+#include "../AwesomePortraitMatting/recurrent_state.h"
+#include "../AwesomePortraitMatting/stage_stats.h"
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief 命令行参数。
+     */
+    struct Options
+    {
+        std::string model_path = "model/awesome_portrait_matting.xml";
+        std::string device = "AUTO:GPU,CPU";
+        std::vector<cv::Size> sizes = { cv::Size(1920, 1080) };
+        //! 计时的帧数
+        int frames = 200;
+        //! 预热帧数，不计入统计
+        int warmup = 10;
+        //! alpha 或 merge
+        std::string mode = "merge";
+        std::string output_path = "apm_bench.json";
+        std::string baseline_path;
+        //! 允许的相对回退
+        double tolerance = 0.10;
+        //! 是否测试 VideoMatting 流水线的吞吐
+        bool pipeline = true;
+        //! 是否对比后处理内核与 OpenCV 实现
+        bool kernels = false;
+    };
+
+    /**
+     * @brief 一种分辨率的测试结果。
+     */
+    struct RunResult
+    {
+        cv::Size size;
+        //! 计时的帧数（不含预热帧）
+        int frames = 0;
+        //! 各阶段串行执行的吞吐（fps）
+        double sequential_fps = 0;
+        //! VideoMatting 流水线的吞吐（fps），未测试时为 0
+        double pipeline_fps = 0;
+        StageStats stats;
+    };
+
+    //! 回退判断忽略的绝对差（ms），避免亚毫秒级阶段的噪声被判为回退
+    const double noise_floor_ms = 0.2;
+
+    //! 返回自 t 起经过的毫秒数，并将 t 更新为当前时刻
+    double lap(Clock::time_point& t)
+    {
+        Clock::time_point now = Clock::now();
+        std::chrono::duration<double, std::milli> elapsed = now - t;
+        t = now;
+        return elapsed.count();
+    }
+
+    std::string size_name(const cv::Size& size)
+    {
+        return std::to_string(size.width) + "x" + std::to_string(size.height);
+    }
+
+    /**
+     * @brief 解析 "1920x1080,1280x720" 形式的分辨率列表，格式错误时返回 false。
+     */
+    bool parse_sizes(const std::string& text, std::vector<cv::Size>& sizes)
+    {
+        sizes.clear();
+        std::stringstream stream(text);
+        std::string item;
+        while (std::getline(stream, item, ',')) {
+            size_t x = item.find('x');
+            if (x == std::string::npos) return false;
+            cv::Size size(std::atoi(item.substr(0, x).c_str()), std::atoi(item.substr(x + 1).c_str()));
+            if (size.width <= 0 || size.height <= 0) return false;
+            sizes.push_back(size);
+        }
+        return !sizes.empty();
+    }
+
+    /**
+     * @brief 生成合成视频：固定的渐变与纹理背景，前景是沿水平方向往复运动的人形（头部与躯干）。
+     * @return 无法写入时返回 false。
+     */
+    bool generate_clip(const std::string& path, const cv::Size& size, int frame_count, double fps)
+    {
+        cv::VideoWriter writer(path, cv::VideoWriter::fourcc('m', 'p', '4', 'v'), fps, size, true);
+        if (!writer.isOpened()) return false;
+        cv::Mat background(size, CV_8UC3), noise(size, CV_8UC3), frame;
+        for (int y = 0; y < size.height; ++y) {
+            cv::Vec3b* row = background.ptr<cv::Vec3b>(y);
+            for (int x = 0; x < size.width; ++x) {
+                row[x] = cv::Vec3b(static_cast<uchar>(x * 200 / size.width),
+                    static_cast<uchar>(y * 200 / size.height), 96);
+            }
+        }
+        cv::randu(noise, cv::Scalar::all(0), cv::Scalar::all(40));
+        background += noise;
+        const int unit = size.height / 8;
+        for (int i = 0; i < frame_count; ++i) {
+            background.copyTo(frame);
+            const int cx = size.width / 2 + static_cast<int>(size.width * 0.2 * std::sin(i / fps * 1.5));
+            cv::ellipse(frame, cv::Point(cx, size.height / 2 - unit), cv::Size(unit * 3 / 4, unit),
+                0, 0, 360, cv::Scalar(90, 120, 200), cv::FILLED, cv::LINE_AA);
+            cv::ellipse(frame, cv::Point(cx, size.height), cv::Size(unit * 2, unit * 3),
+                0, 180, 360, cv::Scalar(50, 50, 60), cv::FILLED, cv::LINE_AA);
+            writer.write(frame);
+        }
+        return true;
+    }
+
+    /**
+     * @brief 逐帧串行执行解码、前处理、推理、后处理、编码，分别计时。
+     */
+    void run_sequential(ModelCache& models, const std::string& clip_path, const std::string& output_path,
+        const Options& options, RunResult& result)
+    {
+        // ========  Step 1: 打开输入输出，选择原生尺寸的模型 =========
+        cv::VideoCapture capture(clip_path);
+        const bool merge_mode = options.mode != "alpha";
+        cv::VideoWriter writer(output_path, cv::VideoWriter::fourcc('m', 'p', '4', 'v'), 30, result.size, merge_mode);
+        if (!capture.isOpened() || !writer.isOpened()) {
+            std::cerr << "[ERROR] Can not open the synthetic clip or the output: " << clip_path << std::endl;
+            return;
+        }
+        ModelCache::Entry& entry = models.Get(result.size);
+        ov::InferRequest request = entry.compiled_model.create_infer_request();
+        RecurrentState state(entry.compiled_model);
+
+        // ========  Step 2: 逐帧计时，预热帧记入单独的统计后丢弃 =========
+        StageStats warmup_stats;
+        cv::Mat frame, resized, yuv, input, mask;
+        double timed_ms = 0;
+        for (int i = 0;; ++i) {
+            StageStats& stats = i < options.warmup ? warmup_stats : result.stats;
+            Clock::time_point frame_start = Clock::now();
+            Clock::time_point t = frame_start;
+            // 解码
+            if (!capture.read(frame) || frame.empty()) break;
+            stats.Add("decode", lap(t));
+            // 前处理，YUV 输入的模型再转换为模型的格式（与 VideoMatting 的主机端转换一致）
+            if (!entry.size.empty() && frame.size() != entry.size) {
+                cv::resize(frame, resized, entry.size);
+                input = resized;
+            }
+            else {
+                input = frame;
+            }
+            if (entry.color != ModelCache::ColorFormat::BGR) {
+                matting::BgrToYuv420(input, yuv, entry.color == ModelCache::ColorFormat::NV12);
+                input = yuv;
+            }
+            const ov::Shape img_shape = entry.size.empty()
+                ? ov::Shape{ 1, static_cast<size_t>(input.rows), static_cast<size_t>(input.cols), 3 }
+                : entry.img_port.get_shape();
+            request.set_tensor(entry.img_port, ov::Tensor(entry.img_port.get_element_type(), img_shape, input.data));
+            stats.Add("preprocess", lap(t));
+            // 推理
+            state.Bind(request);
+            request.start_async();
+            request.wait();
+            state.Advance();
+            stats.Add("inference", lap(t));
+            // 后处理
+            ov::Tensor alp_tensor = request.get_tensor(entry.alp_port);
+            const ov::Shape alp_shape = alp_tensor.get_shape();
+            cv::Mat alpha(static_cast<int>(alp_shape.at(2)), static_cast<int>(alp_shape.at(3)),
+                alp_tensor.get_element_type() == ov::element::u8 ? CV_8UC1 : CV_32FC1, alp_tensor.data());
+            if (alpha.type() == CV_8UC1 && alpha.size() != frame.size())
+                cv::resize(alpha, alpha, frame.size());
+            if (merge_mode) {
+                matting::CompositeOnBlack(alpha, frame, frame);
+            }
+            else if (alpha.type() == CV_8UC1) {
+                mask = alpha;
+            }
+            else {
+                mask.create(frame.size(), CV_8UC1);
+                matting::AlphaToMask(alpha, mask);
+            }
+            stats.Add("postprocess", lap(t));
+            // 编码
+            writer.write(merge_mode ? frame : mask);
+            stats.Add("encode", lap(t));
+            const double total = lap(frame_start);
+            stats.Add("total", total);
+            if (i >= options.warmup) {
+                ++result.frames;
+                timed_ms += total;
+            }
+        }
+        result.sequential_fps = timed_ms > 0 ? result.frames * 1000.0 / timed_ms : 0;
+    }
+
+    /**
+     * @brief 对比后处理的融合内核（各指令集）与原先的 OpenCV 实现（resize -> merge -> convertTo -> multiply -> convertTo）。
+     */
+    void run_kernels(const cv::Size& alpha_size, RunResult& result, int iterations)
+    {
+        cv::Mat alpha(alpha_size, CV_32FC1), frame(result.size, CV_8UC3), dst;
+        cv::randu(alpha, 0.0, 1.0);
+        cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(256));
+
+        // ========  Step 1: OpenCV 实现 =========
+        cv::Mat resized, alpha3, frame_f;
+        for (int i = 0; i < iterations; ++i) {
+            Clock::time_point t = Clock::now();
+            cv::resize(alpha, resized, frame.size());
+            cv::merge(std::vector<cv::Mat>{ resized, resized, resized }, alpha3);
+            frame.convertTo(frame_f, CV_32FC3);
+            cv::multiply(frame_f, alpha3, frame_f);
+            frame_f.convertTo(dst, CV_8UC3);
+            result.stats.Add("kernel_opencv", lap(t));
+        }
+
+        // ========  Step 2: 融合内核，逐个指令集 =========
+        const matting::Isa supported = matting::SupportedIsa();
+        const std::vector<std::pair<matting::Isa, std::string>> isas = {
+            { matting::Isa::Scalar, "kernel_scalar" },
+            { matting::Isa::AVX2, "kernel_avx2" },
+            { matting::Isa::AVX512, "kernel_avx512" }
+        };
+        for (const auto& isa : isas) {
+            if (isa.first > supported) continue;
+            matting::SetIsa(isa.first);
+            for (int i = 0; i < iterations; ++i) {
+                Clock::time_point t = Clock::now();
+                matting::CompositeOnBlack(alpha, frame, dst);
+                result.stats.Add(isa.second, lap(t));
+            }
+        }
+        matting::SetIsa(supported);
+    }
+
+    void print_result(const RunResult& result)
+    {
+        std::cout << "[INFO] " << size_name(result.size) << "   Frames: " << result.frames
+            << "   Sequential: " << result.sequential_fps << " fps";
+        if (result.pipeline_fps > 0) std::cout << "   Pipeline: " << result.pipeline_fps << " fps";
+        std::cout << std::endl;
+        printf("    %-16s%10s%10s%10s%10s%10s  (ms)\n", "stage", "mean", "p50", "p90", "p99", "max");
+        for (const auto& stage : result.stats.Stages()) {
+            StageStats::Summary s = result.stats.Summarize(stage);
+            printf("    %-16s%10.3f%10.3f%10.3f%10.3f%10.3f\n", stage.c_str(), s.mean, s.p50, s.p90, s.p99, s.max);
+        }
+    }
+
+    /**
+     * @brief 以 JSON 格式输出所有结果。
+     */
+    std::string to_json(const std::vector<RunResult>& results, const Options& options)
+    {
+        cv::FileStorage fs("apm_bench.json", cv::FileStorage::WRITE | cv::FileStorage::MEMORY | cv::FileStorage::FORMAT_JSON);
+        fs << "model" << options.model_path
+            << "device" << options.device
+            << "mode" << options.mode
+            << "isa" << matting::IsaName(matting::SupportedIsa());
+        fs << "runs" << "[";
+        for (const auto& result : results) {
+            fs << "{"
+                << "resolution" << size_name(result.size)
+                << "frames" << result.frames
+                << "sequential_fps" << result.sequential_fps
+                << "pipeline_fps" << result.pipeline_fps;
+            fs << "stages" << "{";
+            for (const auto& stage : result.stats.Stages()) {
+                StageStats::Summary s = result.stats.Summarize(stage);
+                fs << stage << "{"
+                    << "count" << static_cast<int>(s.count)
+                    << "mean" << s.mean << "p50" << s.p50 << "p90" << s.p90 << "p99" << s.p99 << "max" << s.max
+                    << "}";
+            }
+            fs << "}" << "}";
+        }
+        fs << "]";
+        return fs.releaseAndGetString();
+    }
+
+    /**
+     * @brief 与基线比较：吞吐下降或某阶段的 p50、p90 上升超过 tolerance（且超过噪声下限）视为回退。
+     * @return 回退的项数；无法读取基线，或基线中没有任何一项与本次的结果比较过时返回 -1。
+     *
+     * @note 本次没有运行的基线分辨率输出警告后跳过。
+     */
+    int compare_baseline(const std::vector<RunResult>& results, const std::string& baseline_path, double tolerance)
+    {
+        cv::FileStorage fs(baseline_path, cv::FileStorage::READ);
+        if (!fs.isOpened()) {
+            std::cerr << "[ERROR] Can not read baseline from: " << baseline_path << std::endl;
+            return -1;
+        }
+        int regressions = 0, compared = 0;
+        cv::FileNode runs = fs["runs"];
+        for (cv::FileNodeIterator it = runs.begin(); it != runs.end(); ++it) {
+            cv::FileNode run = *it;
+            const std::string resolution = static_cast<std::string>(run["resolution"]);
+            auto result = std::find_if(results.begin(), results.end(),
+                [&resolution](const RunResult& r) { return size_name(r.size) == resolution; });
+            if (result == results.end()) {
+                std::cerr << "[WARNING] Baseline resolution " << resolution << " was not benchmarked, skipped." << std::endl;
+                continue;
+            }
+
+            // ========  吞吐 =========
+            const std::pair<const char*, double> throughputs[] = {
+                { "sequential_fps", result->sequential_fps }, { "pipeline_fps", result->pipeline_fps }
+            };
+            for (const auto& fps : throughputs) {
+                const double base = static_cast<double>(run[fps.first]);
+                if (base <= 0 || fps.second <= 0) continue;
+                const bool regressed = fps.second < base * (1 - tolerance);
+                printf("    %s %-16s%-6s%10.2f ->%10.2f fps %s\n", resolution.c_str(), fps.first, "",
+                    base, fps.second, regressed ? "[REGRESSION]" : "");
+                regressions += regressed;
+                ++compared;
+            }
+            // ========  各阶段的 p50、p90 =========
+            for (const auto& stage : result->stats.Stages()) {
+                cv::FileNode node = run["stages"][stage];
+                if (node.empty()) continue;
+                StageStats::Summary s = result->stats.Summarize(stage);
+                const std::pair<const char*, double> values[] = { { "p50", s.p50 }, { "p90", s.p90 } };
+                for (const auto& value : values) {
+                    const double base = static_cast<double>(node[value.first]);
+                    const bool regressed = value.second > base * (1 + tolerance) && value.second - base > noise_floor_ms;
+                    printf("    %s %-16s%-6s%10.3f ->%10.3f ms  %s\n", resolution.c_str(), stage.c_str(), value.first,
+                        base, value.second, regressed ? "[REGRESSION]" : "");
+                    regressions += regressed;
+                    ++compared;
+                }
+            }
+        }
+        // 没有比较任何一项时不能报告没有回退
+        if (compared == 0) {
+            std::cerr << "[ERROR] Nothing in the baseline matches this run, use the same --resolutions." << std::endl;
+            return -1;
+        }
+        return regressions;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    std::string sizes_text;
+
+    // ========  Step 0: 准备输入参数 =========
+    juzzlin::Argengine ae(argc, argv);
+    ae.setHelpText("APM benchmark - times each stage on synthetic clips and reports percentiles as JSON.");
+    ae.addOption({ "--model" }, [&options](std::string value) { options.model_path = value; },
+        false, "Path to the IR model (.xml). Default is model/awesome_portrait_matting.xml.", "MODEL_PATH");
+    ae.addOption({ "--device" }, [&options](std::string value) { options.device = value; },
+        false, "Device of the per-stage run. Default is AUTO:GPU,CPU. The pipeline run uses the same device as apm.exe.", "DEVICE");
+    ae.addOption({ "--resolutions" }, [&sizes_text](std::string value) { sizes_text = value; },
+        false, "Comma separated clip sizes, e.g. 1920x1080,1280x720. Default is 1920x1080.", "WxH[,WxH...]");
+    ae.addOption({ "--frames" }, [&options](std::string value) { options.frames = std::atoi(value.c_str()); },
+        false, "Timed frames per resolution. Default is 200.", "N");
+    ae.addOption({ "--warmup" }, [&options](std::string value) { options.warmup = std::atoi(value.c_str()); },
+        false, "Frames run before timing starts. Default is 10.", "N");
+    ae.addOption({ "--mode" }, [&options](std::string value) { options.mode = value; },
+        false, "alpha or merge. Default is merge.", "MODE");
+    ae.addOption({ "--output" }, [&options](std::string value) { options.output_path = value; },
+        false, "Path of the JSON report. Default is apm_bench.json.", "JSON_PATH");
+    ae.addOption({ "--baseline" }, [&options](std::string value) { options.baseline_path = value; },
+        false, "Compare with a saved report and exit with 1 on regression.", "JSON_PATH");
+    ae.addOption({ "--tolerance" }, [&options](std::string value) { options.tolerance = std::atof(value.c_str()); },
+        false, "Allowed relative regression against the baseline. Default is 0.1.", "RATIO");
+    ae.addOption({ "--skip-pipeline" }, [&options]() { options.pipeline = false; },
+        false, "Do not measure the throughput of the VideoMatting pipeline.");
+    ae.addOption({ "--kernels" }, [&options]() { options.kernels = true; },
+        false, "Also time the fused post-processing kernel for each ISA against the OpenCV chain.");
+    try {
+        ae.parse();
+    }
+    catch (std::runtime_error& e) {
+        std::cerr << e.what() << std::endl << std::endl;
+        ae.printHelp();
+        return EXIT_FAILURE;
+    }
+    if (!sizes_text.empty() && !parse_sizes(sizes_text, options.sizes)) {
+        std::cerr << "[ERROR] Wrong resolutions, use WxH[,WxH...], e.g. 1920x1080,1280x720." << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (options.frames <= 0 || options.warmup < 0 || (options.mode != "alpha" && options.mode != "merge")) {
+        std::cerr << "[ERROR] Wrong arguments: frames must be positive, warmup non-negative, mode alpha or merge." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // ========  Step 1: 编译模型 =========
+    ov::Core core;
+    core.set_property(ov::cache_dir("cl_cache"));
+    std::shared_ptr<ov::Model> model = core.read_model(options.model_path);
+    std::cout << "[INFO] Compiling and loading model into device...";
+    const bool dynamic_input = model->input("img").get_partial_shape().is_dynamic();
+    ModelCache models(core, model, dynamic_input ? "CPU" : options.device,
+        ov::AnyMap{ ov::hint::performance_mode(ov::hint::PerformanceMode::THROUGHPUT) });
+    std::cout << "done!" << std::endl;
+    std::unique_ptr<PortraitMatting> matte;
+    if (options.pipeline) matte = std::make_unique<PortraitMatting>(options.model_path);
+
+    // ========  Step 2: 逐个分辨率测试 =========
+    const std::filesystem::path temp_dir = std::filesystem::temp_directory_path();
+    std::vector<RunResult> results(options.sizes.size());
+    for (size_t i = 0; i < options.sizes.size(); ++i) {
+        RunResult& result = results[i];
+        result.size = options.sizes[i];
+        const std::string name = size_name(result.size);
+        const std::string clip_path = (temp_dir / ("apm_bench_" + name + ".mp4")).generic_string();
+        const std::string output_path = (temp_dir / ("apm_bench_" + name + "_result.mp4")).generic_string();
+
+        // ========  Step 2-1: 生成合成视频 =========
+        std::cout << "[INFO] Generating synthetic clip: " << name << std::endl;
+        const int clip_frames = options.warmup + options.frames;
+        if (!generate_clip(clip_path, result.size, clip_frames, 30)) {
+            std::cerr << "[ERROR] Can not write synthetic clip to: " << clip_path << std::endl;
+            return EXIT_FAILURE;
+        }
+        // ========  Step 2-2: 各阶段串行计时 =========
+        run_sequential(models, clip_path, output_path, options, result);
+        // ========  Step 2-3: [可选] VideoMatting 流水线的吞吐 =========
+        // 计时前编译并预热该尺寸的原生模型；预热帧与打开输入输出的开销由只含预热帧的短视频抵消：
+        // 先以短视频预热一遍流水线（编解码器的初始化），再分别计时完整视频与短视频，取两者之差
+        if (matte) {
+            matte->Warmup(result.size);
+            const std::string warmup_clip = (temp_dir / ("apm_bench_" + name + "_warmup.mp4")).generic_string();
+            const bool has_warmup = options.warmup > 0 && generate_clip(warmup_clip, result.size, options.warmup, 30);
+            double warmup_ms = 0;
+            if (has_warmup) matte->VideoMatting(warmup_clip, output_path, options.mode, 0.0);
+            Clock::time_point t = Clock::now();
+            matte->VideoMatting(clip_path, output_path, options.mode, 0.0);
+            const double full_ms = lap(t);
+            if (has_warmup) {
+                matte->VideoMatting(warmup_clip, output_path, options.mode, 0.0);
+                warmup_ms = lap(t);
+                std::filesystem::remove(warmup_clip);
+            }
+            const int timed_frames = has_warmup ? options.frames : clip_frames;
+            result.pipeline_fps = full_ms > warmup_ms ? timed_frames * 1000.0 / (full_ms - warmup_ms) : 0;
+        }
+        // ========  Step 2-4: [可选] 后处理内核对比，alpha 为模型输出的尺寸 =========
+        if (options.kernels) {
+            const cv::Size alpha_size = models.NativeSize(result.size);
+            run_kernels(alpha_size.empty() ? result.size : alpha_size, result, 100);
+        }
+        std::filesystem::remove(clip_path);
+        std::filesystem::remove(output_path);
+        print_result(result);
+    }
+
+    // ========  Step 3: 输出 JSON =========
+    const std::string json = to_json(results, options);
+    std::ofstream(options.output_path) << json;
+    std::cout << "[INFO] Report: " << options.output_path << std::endl;
+
+    // ========  Step 4: [可选] 与基线比较 =========
+    if (!options.baseline_path.empty()) {
+        std::cout << "[INFO] Comparing with baseline: " << options.baseline_path
+            << " (tolerance " << options.tolerance * 100 << "%)" << std::endl;
+        const int regressions = compare_baseline(results, options.baseline_path, options.tolerance);
+        if (regressions != 0) {
+            if (regressions > 0) std::cerr << "[ERROR] " << regressions << " regression(s) found." << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << "[INFO] No regression." << std::endl;
+    }
+    return 0;
+}
\ No newline at end of file
@@ -17,6 +17,11 @@ class StaticExporter:
                             choices=['deep_guided_filter', 'fast_guided_filter'])
         parser.add_argument('--checkpoint', type=str, required=False)
         parser.add_argument('--output', type=str, required=True)
+        parser.add_argument('--batch-size', type=int, default=1,
+                            help='Number of independent streams packed into one inference')
+        parser.add_argument('--dynamic-ratio', action='store_true',
+                            help='Export downsample_ratio as an input so it can be chosen at runtime, '
+                                 'the height and width of the recurrent states become dynamic')
         self.args = parser.parse_args()
 
     def init_model(self):
@@ -34,27 +39,40 @@ class StaticExporter:
     def export(self):
         print(self.args)
         # rec = (torch.zeros([1, 1, 1, 1]).to(self.args.device, self.precision),) * 4
-        src = torch.randn(1, 3, 1080, 1920).to(self.device, self.precision)  # h=720 w=1280
+        n = self.args.batch_size  # 每个 batch 槽位对应一路独立的视频流，拥有各自的隐藏状态
+        src = torch.randn(n, 3, 1080, 1920).to(self.device, self.precision)  # h=720 w=1280
         # r1i = torch.randn(1, 16, 135, 240).to(self.device, self.precision)
         # r2i = torch.randn(1, 20, 68, 120).to(self.device, self.precision)
         # r3i = torch.randn(1, 40, 34, 60).to(self.device, self.precision)
         # r4i = torch.randn(1, 64, 17, 30).to(self.device, self.precision)
-        r1i = torch.randn(1, 16, 216, 384).to(self.device, self.precision)
-        r2i = torch.randn(1, 20, 108, 192).to(self.device, self.precision)
-        r3i = torch.randn(1, 40, 54, 96).to(self.device, self.precision)
-        r4i = torch.randn(1, 64, 27, 48).to(self.device, self.precision)
+        r1i = torch.randn(n, 16, 216, 384).to(self.device, self.precision)
+        r2i = torch.randn(n, 20, 108, 192).to(self.device, self.precision)
+        r3i = torch.randn(n, 40, 54, 96).to(self.device, self.precision)
+        r4i = torch.randn(n, 64, 27, 48).to(self.device, self.precision)
         # 假设你的model的forward方法，已经指定downsample_ratio的默认值为torch.tensor([0.125]).
         # downsample_ratio = torch.tensor([0.375]).to(self.args.device)
+        inputs = (src, r1i, r2i, r3i, r4i)  # 不需要导出downsample_ratio，直接使用默认值
+        input_names = ['img', 's1i', 's2i', 's3i', 's4i']
+        dynamic_axes = None
+        if self.args.dynamic_ratio:
+            # downsample_ratio 作为输入导出，img 保持静态，隐藏状态的 H、W 随比例变化
+            # C++ 端编译前将其固定为常量，并由图推导隐藏状态的形状（见 ModelCache）
+            downsample_ratio = torch.tensor([0.4]).to(self.device, self.precision)
+            inputs = (*inputs, downsample_ratio)
+            input_names.append('downsample_ratio')
+            dynamic_state = {2: 'height', 3: 'width'}
+            dynamic_axes = {name: dynamic_state for name in ['s1i', 's2i', 's3i', 's4i', 's1o', 's2o', 's3o', 's4o']}
 
         torch.onnx.export(
             self.model,
-            (src, r1i, r2i, r3i, r4i),  # 不需要导出downsample_ratio，直接使用默认值
+            inputs,
             self.args.output,
             export_params=True,
             opset_version=12,
             do_constant_folding=True,
-            input_names=['img', 's1i', 's2i', 's3i', 's4i'],  # 不需要导出downsample_ratio，直接使用默认值
-            output_names=['fgr', 'alp', 's1o', 's2o', 's3o', 's4o'])
+            input_names=input_names,
+            output_names=['fgr', 'alp', 's1o', 's2o', 's3o', 's4o'],
+            dynamic_axes=dynamic_axes)
 
 
 if __name__ == '__main__':
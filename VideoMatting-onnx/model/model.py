@@ -44,8 +44,11 @@ class MattingNetwork(nn.Module):
                 segmentation_pass: bool = False):
         
         if torch.onnx.is_in_onnx_export():
-            # src_sm = CustomOnnxResizeByFactorOp.apply(src, downsample_ratio)
-            src_sm = self._interpolate(src, scale_factor=downsample_ratio)
+            if isinstance(downsample_ratio, Tensor):
+                # downsample_ratio 作为模型输入导出，运行时选择骨干网络的分辨率
+                src_sm = CustomOnnxResizeByFactorOp.apply(src, downsample_ratio)
+            else:
+                src_sm = self._interpolate(src, scale_factor=downsample_ratio)
         elif downsample_ratio != 1:
             src_sm = self._interpolate(src, scale_factor=downsample_ratio)
         else: